@@ -7,6 +7,7 @@
 #include "common/Geometry.h"
 #include "thread/ThreadPool.h"
 #include "editor/Editor.h"
+#include "document/ShapeCache.h"
 #include "render/Renderer.h"
 #include <fmt/core.h>
 #include <Logger.h>
@@ -49,7 +50,8 @@ int app(int argc, char** argv, char** envp)
         .height = args.value<uint32_t>("height", 1080)
     };
 
-    ThreadPool::initializeMainThreadPool();
+    // 0 picks the default number of threads
+    ThreadPool::initializeMainThreadPool(args.value<uint32_t>("threads", 0));
 
     Window window(rect);
     window.show();
@@ -74,6 +76,7 @@ int app(int argc, char** argv, char** envp)
     ThreadPool::destroyMainThreadPool();
     Editor::destroy();
     Renderer::destroy();
+    ShapeCache::destroy();
     return ret;
 }
 } // namespace spurv
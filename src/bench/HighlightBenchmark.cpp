@@ -0,0 +1,90 @@
+#include <CLexer.h>
+#include <Chrono.h>
+#include <EventLoopUv.h>
+#include <Rope.h>
+#include <ThreadPool.h>
+#include <fmt/core.h>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <string>
+
+using namespace spurv;
+
+// highlights lines of generated c with CLexer on the main thread pool, then types a
+// character at the top, which re-lexes a line, and opens a comment there, which
+// re-lexes all of them. prints how long each took
+static int highlight(std::size_t lines)
+{
+    const std::u16string code[] = {
+        u"static int parse(const char* data, unsigned long size, struct state* out)\n",
+        u"{\n",
+        u"    for (int i = 0; i < size; ++i) { out->sum += data[i] * 0x1f; }\n",
+        u"    if (size > 4096 && out->flags != 0) { return parse_slow(data, \"slow \\\"path\\\"\", 3.5e2); }\n",
+        u"    // a line comment, which is the rest of the line\n",
+        u"    return out->sum == 0 ? 'x' : '\\n';\n",
+        u"}\n",
+        u"\n"
+    };
+    std::u16string text;
+    for (std::size_t line = 0; line < lines; ++line) {
+        text += code[line % std::size(code)];
+    }
+    Rope rope(text);
+
+    EventLoopUv loop;
+    loop.install();
+    auto lexer = std::make_shared<CLexer>();
+    Highlighter highlighter(nullptr, lexer);
+
+    // the highlighter runs on the loop, each step is timed until it's done
+    struct Step
+    {
+        const char* name;
+        std::u16string_view insert;
+    };
+    const Step steps[] = {
+        { "all lines", {} },
+        { "typing at the top", u"x" },
+        { "opening a comment at the top", u"/*" }
+    };
+    std::size_t step = 0;
+    uint64_t started = 0;
+    auto run = [&]() -> void {
+        started = timeNow();
+        if (steps[step].insert.empty()) {
+            highlighter.reset(rope);
+        } else {
+            rope.insert(0, steps[step].insert);
+            highlighter.edit(rope, 0, 0, 0);
+        }
+    };
+    const uint32_t timer = loop.startTimer([&](uint32_t) -> void {
+        if (!highlighter.isDone()) {
+            return;
+        }
+        fmt::print("{:>30}: {}ms\n", steps[step].name, timeNow() - started);
+        if (++step == std::size(steps)) {
+            loop.stop(0);
+            return;
+        }
+        run();
+    }, 1, EventLoop::TimerMode::Repeat);
+
+    fmt::print("highlighting {} lines\n", rope.numLines());
+    loop.post(run);
+    const int32_t ret = loop.run();
+    loop.stopTimer(timer);
+    loop.uninstall();
+    return ret;
+}
+
+// the arguments are the number of lines, 100000 by default, and the number of
+// threads, 0 picks the default
+int main(int argc, char** argv)
+{
+    ThreadPool::initializeMainThreadPool(argc > 2 ? strtoul(argv[2], nullptr, 10) : 0);
+    const int ret = highlight(argc > 1 ? strtoul(argv[1], nullptr, 10) : 100000);
+    ThreadPool::destroyMainThreadPool();
+    return ret;
+}
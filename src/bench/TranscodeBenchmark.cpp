@@ -0,0 +1,115 @@
+#include <Transcode.h>
+#include <Chrono.h>
+#include <fmt/core.h>
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+using namespace spurv;
+
+// transcodes generated text in each supported encoding and prints the throughput.
+// the first argument is the size of the text in megabytes, 64 by default
+int main(int argc, char** argv)
+{
+    const std::size_t megabytes = argc > 1 ? strtoul(argv[1], nullptr, 10) : 64;
+
+    // one line with ascii, latin1, greek, cjk and a surrogate pair
+    const std::u16string mixedLine = u"The quick brown fox Ærøskøbing naïve café λόγος 日本語 \U0001F600\n";
+    const std::u16string latin1Line = u"The quick brown fox jumps over the lazy dog Ærøskøbing naïve café\n";
+    const std::u16string asciiLine = u"    for (std::size_t n = 0; n < size; ++n) { words += data[n]; }\n";
+
+    auto generate = [megabytes](const std::u16string& line) -> std::u16string {
+        std::u16string text;
+        const std::size_t units = (megabytes * 1024 * 1024) / sizeof(char16_t);
+        text.reserve(units + line.size());
+        while (text.size() < units) {
+            text += line;
+        }
+        return text;
+    };
+    const std::u16string mixed = generate(mixedLine);
+    const std::u16string latin1Text = generate(latin1Line);
+    const std::u16string asciiText = generate(asciiLine);
+
+    auto toUtf8 = [](const std::u16string& text) -> std::string {
+        std::string utf8;
+        utf8.resize(simdutf::utf8_length_from_utf16(text.data(), text.size()));
+        utf8.resize(simdutf::convert_utf16_to_utf8(text.data(), text.size(), utf8.data()));
+        return utf8;
+    };
+    auto toUtf16 = [](const std::u16string& text, bool bigEndian) -> std::string {
+        std::string utf16(text.size() * sizeof(char16_t), '\0');
+        if (bigEndian) {
+            simdutf::change_endianness_utf16(text.data(), text.size(), reinterpret_cast<char16_t*>(utf16.data()));
+        } else {
+            memcpy(utf16.data(), text.data(), utf16.size());
+        }
+        return utf16;
+    };
+    auto toUtf32 = [](const std::u16string& text, bool bigEndian) -> std::string {
+        std::string utf32(simdutf::utf32_length_from_utf16(text.data(), text.size()) * sizeof(char32_t), '\0');
+        char32_t* out = reinterpret_cast<char32_t*>(utf32.data());
+        const std::size_t words = simdutf::convert_utf16_to_utf32(text.data(), text.size(), out);
+        if (bigEndian) {
+            for (std::size_t n = 0; n < words; ++n) {
+                out[n] = static_cast<char32_t>(__builtin_bswap32(out[n]));
+            }
+        }
+        return utf32;
+    };
+    auto toLatin1 = [](const std::u16string& text) -> std::string {
+        std::string latin1(text.size(), '\0');
+        std::transform(text.begin(), text.end(), latin1.begin(), [](char16_t ch) {
+            return static_cast<char>(ch);
+        });
+        return latin1;
+    };
+
+    struct Input
+    {
+        const char* name;
+        simdutf::encoding_type encoding;
+        std::string data;
+    };
+    const Input inputs[] = {
+        { "latin1", simdutf::Latin1, toLatin1(latin1Text) },
+        { "utf-8 (ascii)", simdutf::UTF8, toUtf8(asciiText) },
+        { "utf-8", simdutf::UTF8, toUtf8(mixed) },
+        { "utf-16le", simdutf::UTF16_LE, toUtf16(mixed, false) },
+        { "utf-16be", simdutf::UTF16_BE, toUtf16(mixed, true) },
+        { "utf-32le", simdutf::UTF32_LE, toUtf32(mixed, false) },
+        { "utf-32be", simdutf::UTF32_BE, toUtf32(mixed, true) }
+    };
+
+    // transcode in the same chunk size as the loader does
+    const std::size_t chunkSize = 65536;
+    std::u16string text;
+    for (const auto& input : inputs) {
+        std::size_t bytes = 0, words = 0;
+        const uint64_t started = timeNow();
+        uint64_t elapsed = 0;
+        // run for at least half a second to get a usable number out of a millisecond clock
+        do {
+            std::size_t pos = 0;
+            while (pos < input.data.size()) {
+                const std::size_t end = std::min(input.data.size(), pos + chunkSize);
+                const std::size_t len = codePointBoundary(input.encoding, input.data.data() + pos, end - pos, end == input.data.size());
+                if (len == 0) {
+                    break;
+                }
+                transcodeToUtf16(input.encoding, input.data.data() + pos, len, text);
+                words += text.size();
+                pos += len;
+            }
+            bytes += pos;
+            elapsed = timeNow() - started;
+        } while (elapsed < 500);
+
+        const double seconds = static_cast<double>(std::max<uint64_t>(elapsed, 1)) / 1000.;
+        fmt::print("{:>14}: {:8.1f} MB/s ({} bytes to {} utf-16 words in {}ms)\n", input.name,
+                   (static_cast<double>(bytes) / (1024. * 1024.)) / seconds, bytes, words, elapsed);
+    }
+    return 0;
+}
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <vector>
+
+namespace spurv {
+
+// prefix sums over a sequence of values with O(log n) updates and lookups
+template<typename Type>
+class FenwickTree
+{
+public:
+    FenwickTree() = default;
+    explicit FenwickTree(std::size_t size);
+
+    // replaces all the values, O(n)
+    void assign(const std::vector<Type>& values);
+    void clear();
+
+    std::size_t size() const;
+
+    void add(std::size_t idx, Type delta);
+    // the sum of the first count values
+    Type prefix(std::size_t count) const;
+    Type at(std::size_t idx) const;
+    Type total() const;
+
+    // the index of the value that position falls in, that is the idx where
+    // prefix(idx) <= position < prefix(idx + 1). values can't be negative.
+    // returns size() if position is at or past the total
+    std::size_t find(Type position) const;
+
+private:
+    // one based, mTree[i] is the sum of the values in (i - lowbit(i), i]
+    std::vector<Type> mTree = std::vector<Type>(1);
+};
+
+template<typename Type>
+FenwickTree<Type>::FenwickTree(std::size_t size)
+    : mTree(size + 1)
+{
+}
+
+template<typename Type>
+void FenwickTree<Type>::assign(const std::vector<Type>& values)
+{
+    mTree.assign(values.size() + 1, Type {});
+    for (std::size_t i = 1; i <= values.size(); ++i) {
+        mTree[i] += values[i - 1];
+        const std::size_t parent = i + (i & (~i + 1));
+        if (parent <= values.size()) {
+            mTree[parent] += mTree[i];
+        }
+    }
+}
+
+template<typename Type>
+void FenwickTree<Type>::clear()
+{
+    mTree.assign(1, Type {});
+}
+
+template<typename Type>
+inline std::size_t FenwickTree<Type>::size() const
+{
+    return mTree.size() - 1;
+}
+
+template<typename Type>
+void FenwickTree<Type>::add(std::size_t idx, Type delta)
+{
+    assert(idx < size());
+    for (std::size_t i = idx + 1; i < mTree.size(); i += i & (~i + 1)) {
+        mTree[i] += delta;
+    }
+}
+
+template<typename Type>
+Type FenwickTree<Type>::prefix(std::size_t count) const
+{
+    assert(count <= size());
+    Type sum {};
+    for (std::size_t i = count; i > 0; i -= i & (~i + 1)) {
+        sum += mTree[i];
+    }
+    return sum;
+}
+
+template<typename Type>
+inline Type FenwickTree<Type>::at(std::size_t idx) const
+{
+    return prefix(idx + 1) - prefix(idx);
+}
+
+template<typename Type>
+inline Type FenwickTree<Type>::total() const
+{
+    return prefix(size());
+}
+
+template<typename Type>
+std::size_t FenwickTree<Type>::find(Type position) const
+{
+    std::size_t step = 1;
+    while (step * 2 <= size()) {
+        step *= 2;
+    }
+    std::size_t idx = 0;
+    for (; step > 0; step /= 2) {
+        if (idx + step <= size() && !(position < mTree[idx + step])) {
+            idx += step;
+            position -= mTree[idx];
+        }
+    }
+    return idx;
+}
+
+} // namespace spurv
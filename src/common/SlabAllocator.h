@@ -0,0 +1,353 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <mutex>
+#include <new>
+#include <utility>
+#include <sys/mman.h>
+
+namespace spurv {
+
+// allocates objects of one type out of big aligned slabs mapped straight
+// from the system. a slab is unmapped once all of its slots are free,
+// except for one spare to avoid thrashing when a single object comes and
+// goes. the slab of an object is found by masking its address so SlabSize
+// must be a power of two. thread safe, each thread keeps a few free slots
+// of its own and only takes the lock to move a batch of them to or from
+// the slabs. a thread's slots are given back when it exits
+template<typename Type, std::size_t SlabSize = 1024 * 1024>
+class SlabAllocator
+{
+public:
+    SlabAllocator() = default;
+    ~SlabAllocator();
+
+    template<typename ...Args>
+    Type* create(Args&& ...args);
+    void destroy(Type* object);
+
+    // objects includes the free slots that threads hold on to
+    struct Stats
+    {
+        std::size_t slabs = 0;
+        std::size_t objects = 0;
+        std::size_t bytes = 0;
+    };
+    Stats stats() const;
+
+private:
+    struct Slot
+    {
+        Slot* next;
+    };
+
+    struct Slab
+    {
+        // slabs with free slots are kept in a list
+        Slab* prev = nullptr;
+        Slab* next = nullptr;
+        Slot* free = nullptr;
+        std::size_t used = 0;
+        // slots past this have never been handed out
+        std::size_t carved = 0;
+    };
+
+    // the free slots of a thread, they belong to one allocator at a time
+    struct Cache
+    {
+        ~Cache();
+
+        SlabAllocator* owner = nullptr;
+        Slot* free = nullptr;
+        std::size_t count = 0;
+    };
+
+    static constexpr std::size_t roundUp(std::size_t size, std::size_t alignment);
+    // a free slot holds a Slot so it has to be aligned for one as well
+    static constexpr std::size_t SlotAlignment = std::max(alignof(Type), alignof(Slot));
+    static constexpr std::size_t SlotSize = roundUp(std::max(sizeof(Type), sizeof(Slot)), SlotAlignment);
+    static constexpr std::size_t SlotsOffset = roundUp(sizeof(Slab), SlotAlignment);
+    static constexpr std::size_t SlotsPerSlab = (SlabSize - SlotsOffset) / SlotSize;
+
+    // number of slots moved between a thread and the slabs at a time, up to 64KiB
+    // worth so that idle threads don't sit on much memory
+    static constexpr std::size_t CacheBatch = std::clamp<std::size_t>(65536 / SlotSize, 1, 32);
+
+    static_assert((SlabSize & (SlabSize - 1)) == 0, "SlabSize must be a power of two");
+    static_assert(SlotsPerSlab > 0, "SlabSize is too small for Type");
+
+    static Slab* slabFor(void* ptr);
+    static char* slotAt(Slab* slab, std::size_t idx);
+    static void* mapSlab();
+    static void unmapSlab(void* slab);
+
+    static Cache& cache();
+
+    void* allocate();
+    void deallocate(void* ptr);
+    void adopt(Cache& cache);
+    void refill(Cache& cache);
+    void release(Cache& cache, std::size_t num);
+    // these need mMutex to be held
+    void* takeSlot();
+    void returnSlot(void* ptr);
+    void link(Slab* slab);
+    void unlink(Slab* slab);
+
+private:
+    SlabAllocator(const SlabAllocator&) = delete;
+    SlabAllocator& operator=(const SlabAllocator&) = delete;
+
+private:
+    mutable std::mutex mMutex;
+    Slab* mAvailable = nullptr;
+    Slab* mSpare = nullptr;
+    std::size_t mSlabs = 0, mObjects = 0;
+};
+
+template<typename Type, std::size_t SlabSize>
+SlabAllocator<Type, SlabSize>::~SlabAllocator()
+{
+    // slabs that still have objects in them are leaked on purpose
+    if (mSpare) {
+        unmapSlab(mSpare);
+    }
+}
+
+template<typename Type, std::size_t SlabSize>
+constexpr std::size_t SlabAllocator<Type, SlabSize>::roundUp(std::size_t size, std::size_t alignment)
+{
+    return (size + alignment - 1) / alignment * alignment;
+}
+
+template<typename Type, std::size_t SlabSize>
+typename SlabAllocator<Type, SlabSize>::Slab* SlabAllocator<Type, SlabSize>::slabFor(void* ptr)
+{
+    return reinterpret_cast<Slab*>(reinterpret_cast<uintptr_t>(ptr) & ~static_cast<uintptr_t>(SlabSize - 1));
+}
+
+template<typename Type, std::size_t SlabSize>
+char* SlabAllocator<Type, SlabSize>::slotAt(Slab* slab, std::size_t idx)
+{
+    return reinterpret_cast<char*>(slab) + SlotsOffset + idx * SlotSize;
+}
+
+template<typename Type, std::size_t SlabSize>
+void* SlabAllocator<Type, SlabSize>::mapSlab()
+{
+    // map twice the size and trim it down to an aligned slab
+    void* mem = mmap(nullptr, SlabSize * 2, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) {
+        std::abort();
+    }
+    const uintptr_t start = reinterpret_cast<uintptr_t>(mem);
+    const uintptr_t aligned = (start + SlabSize - 1) & ~static_cast<uintptr_t>(SlabSize - 1);
+    if (aligned > start) {
+        munmap(mem, aligned - start);
+    }
+    const uintptr_t end = start + SlabSize * 2;
+    if (end > aligned + SlabSize) {
+        munmap(reinterpret_cast<void*>(aligned + SlabSize), end - (aligned + SlabSize));
+    }
+    return reinterpret_cast<void*>(aligned);
+}
+
+template<typename Type, std::size_t SlabSize>
+void SlabAllocator<Type, SlabSize>::unmapSlab(void* slab)
+{
+    munmap(slab, SlabSize);
+}
+
+template<typename Type, std::size_t SlabSize>
+void SlabAllocator<Type, SlabSize>::link(Slab* slab)
+{
+    slab->prev = nullptr;
+    slab->next = mAvailable;
+    if (mAvailable) {
+        mAvailable->prev = slab;
+    }
+    mAvailable = slab;
+}
+
+template<typename Type, std::size_t SlabSize>
+void SlabAllocator<Type, SlabSize>::unlink(Slab* slab)
+{
+    if (slab->prev) {
+        slab->prev->next = slab->next;
+    } else {
+        assert(mAvailable == slab);
+        mAvailable = slab->next;
+    }
+    if (slab->next) {
+        slab->next->prev = slab->prev;
+    }
+    slab->prev = slab->next = nullptr;
+}
+
+template<typename Type, std::size_t SlabSize>
+void* SlabAllocator<Type, SlabSize>::takeSlot()
+{
+    if (!mAvailable) {
+        void* mem = mSpare;
+        if (mem) {
+            mSpare = nullptr;
+        } else {
+            mem = mapSlab();
+            ++mSlabs;
+        }
+        link(new (mem) Slab);
+    }
+    Slab* slab = mAvailable;
+    void* ptr;
+    if (slab->free) {
+        ptr = slab->free;
+        slab->free = slab->free->next;
+    } else {
+        assert(slab->carved < SlotsPerSlab);
+        ptr = slotAt(slab, slab->carved++);
+    }
+    if (++slab->used == SlotsPerSlab) {
+        unlink(slab);
+    }
+    ++mObjects;
+    return ptr;
+}
+
+template<typename Type, std::size_t SlabSize>
+void SlabAllocator<Type, SlabSize>::returnSlot(void* ptr)
+{
+    Slab* slab = slabFor(ptr);
+    assert(slab->used > 0);
+    if (slab->used == SlotsPerSlab) {
+        link(slab);
+    }
+    --mObjects;
+    if (--slab->used == 0) {
+        unlink(slab);
+        slab->~Slab();
+        if (!mSpare) {
+            mSpare = slab;
+        } else {
+            unmapSlab(slab);
+            --mSlabs;
+        }
+        return;
+    }
+    auto slot = static_cast<Slot*>(ptr);
+    slot->next = slab->free;
+    slab->free = slot;
+}
+
+template<typename Type, std::size_t SlabSize>
+SlabAllocator<Type, SlabSize>::Cache::~Cache()
+{
+    if (owner) {
+        owner->release(*this, count);
+    }
+}
+
+template<typename Type, std::size_t SlabSize>
+typename SlabAllocator<Type, SlabSize>::Cache& SlabAllocator<Type, SlabSize>::cache()
+{
+    static thread_local Cache cache;
+    return cache;
+}
+
+template<typename Type, std::size_t SlabSize>
+void SlabAllocator<Type, SlabSize>::adopt(Cache& cache)
+{
+    // the slots of another allocator go back to it first
+    if (cache.owner) {
+        cache.owner->release(cache, cache.count);
+    }
+    cache.owner = this;
+}
+
+template<typename Type, std::size_t SlabSize>
+void SlabAllocator<Type, SlabSize>::refill(Cache& cache)
+{
+    std::lock_guard lock(mMutex);
+    for (std::size_t idx = 0; idx < CacheBatch; ++idx) {
+        auto slot = static_cast<Slot*>(takeSlot());
+        slot->next = cache.free;
+        cache.free = slot;
+    }
+    cache.count += CacheBatch;
+}
+
+template<typename Type, std::size_t SlabSize>
+void SlabAllocator<Type, SlabSize>::release(Cache& cache, std::size_t num)
+{
+    std::lock_guard lock(mMutex);
+    for (std::size_t idx = 0; idx < num; ++idx) {
+        Slot* slot = cache.free;
+        cache.free = slot->next;
+        returnSlot(slot);
+    }
+    cache.count -= num;
+}
+
+template<typename Type, std::size_t SlabSize>
+void* SlabAllocator<Type, SlabSize>::allocate()
+{
+    Cache& cache = SlabAllocator::cache();
+    if (cache.owner != this) {
+        adopt(cache);
+    }
+    if (!cache.free) {
+        refill(cache);
+    }
+    Slot* slot = cache.free;
+    cache.free = slot->next;
+    --cache.count;
+    return slot;
+}
+
+template<typename Type, std::size_t SlabSize>
+void SlabAllocator<Type, SlabSize>::deallocate(void* ptr)
+{
+    Cache& cache = SlabAllocator::cache();
+    if (cache.owner != this) {
+        adopt(cache);
+    }
+    auto slot = static_cast<Slot*>(ptr);
+    slot->next = cache.free;
+    cache.free = slot;
+    // keep a batch around so that a thread going back and forth doesn't lock every time
+    if (++cache.count > CacheBatch * 2) {
+        release(cache, CacheBatch);
+    }
+}
+
+template<typename Type, std::size_t SlabSize>
+template<typename ...Args>
+Type* SlabAllocator<Type, SlabSize>::create(Args&& ...args)
+{
+    void* ptr = allocate();
+    if constexpr (sizeof...(Args) == 0) {
+        // default initialize, don't zero big arrays
+        return new (ptr) Type;
+    } else {
+        return new (ptr) Type(std::forward<Args>(args)...);
+    }
+}
+
+template<typename Type, std::size_t SlabSize>
+void SlabAllocator<Type, SlabSize>::destroy(Type* object)
+{
+    object->~Type();
+    deallocate(object);
+}
+
+template<typename Type, std::size_t SlabSize>
+typename SlabAllocator<Type, SlabSize>::Stats SlabAllocator<Type, SlabSize>::stats() const
+{
+    std::lock_guard lock(mMutex);
+    return { mSlabs, mObjects, mSlabs * SlabSize };
+}
+
+} // namespace spurv
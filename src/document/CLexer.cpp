@@ -0,0 +1,119 @@
+#include "CLexer.h"
+#include "TextClasses.h"
+#include <algorithm>
+#include <array>
+
+using namespace spurv;
+
+enum LexerState : uint32_t {
+    Code,
+    BlockComment
+};
+
+// sorted, for the binary search
+static constexpr std::array<std::u16string_view, 44> Keywords = {
+    u"auto", u"bool", u"break", u"case", u"char", u"class", u"const", u"constexpr", u"continue",
+    u"default", u"delete", u"do", u"double", u"else", u"enum", u"extern", u"false", u"float",
+    u"for", u"goto", u"if", u"inline", u"int", u"long", u"namespace", u"new", u"nullptr",
+    u"private", u"protected", u"public", u"return", u"short", u"signed", u"sizeof", u"static",
+    u"struct", u"switch", u"template", u"true", u"typedef", u"union", u"unsigned", u"void", u"while"
+};
+
+static inline bool isIdentifierStart(char16_t ch)
+{
+    return (ch >= u'a' && ch <= u'z') || (ch >= u'A' && ch <= u'Z') || ch == u'_';
+}
+
+static inline bool isDigit(char16_t ch)
+{
+    return ch >= u'0' && ch <= u'9';
+}
+
+static inline bool isIdentifier(char16_t ch)
+{
+    return isIdentifierStart(ch) || isDigit(ch);
+}
+
+// where the block comment going on at pos ends, after its */ or at the end of the line
+static inline std::size_t commentEnd(std::u16string_view line, std::size_t pos, uint32_t& state)
+{
+    const std::size_t end = line.find(u"*/", pos);
+    if (end == std::u16string_view::npos) {
+        return line.size();
+    }
+    state = Code;
+    return end + 2;
+}
+
+CLexer::CLexer()
+{
+    auto classes = TextClasses::instance();
+    mComment = classes->registerTextClass("comment");
+    mString = classes->registerTextClass("string");
+    mNumber = classes->registerTextClass("number");
+    mKeyword = classes->registerTextClass("keyword");
+}
+
+uint32_t CLexer::lexLine(std::u16string_view line, uint32_t state, std::vector<SyntaxToken>& tokens) const
+{
+    const std::size_t size = line.size();
+    auto add = [&tokens](std::size_t start, std::size_t end, uint32_t clazz) -> void {
+        tokens.push_back({ static_cast<uint32_t>(start), static_cast<uint32_t>(end - start), clazz });
+    };
+
+    std::size_t pos = 0;
+    while (pos < size) {
+        if (state == BlockComment) {
+            const std::size_t start = pos;
+            pos = commentEnd(line, pos, state);
+            add(start, pos, mComment);
+            continue;
+        }
+
+        const char16_t ch = line[pos];
+        const char16_t next = pos + 1 < size ? line[pos + 1] : u'\0';
+        if (ch == u'/' && next == u'*') {
+            // the * of the opener can't be the start of the closer, /*/ doesn't end the comment
+            const std::size_t start = pos;
+            state = BlockComment;
+            pos = commentEnd(line, pos + 2, state);
+            add(start, pos, mComment);
+            continue;
+        }
+        if (ch == u'/' && next == u'/') {
+            add(pos, size, mComment);
+            break;
+        }
+        if (ch == u'"' || ch == u'\'') {
+            const std::size_t start = pos++;
+            while (pos < size && line[pos] != ch) {
+                // skip whatever is escaped, a quote included
+                pos += line[pos] == u'\\' ? 2 : 1;
+            }
+            pos = std::min(pos + 1, size);
+            add(start, pos, mString);
+            continue;
+        }
+        if (isDigit(ch)) {
+            // hex digits, suffixes and exponents are all part of the number
+            const std::size_t start = pos;
+            while (pos < size && (isIdentifier(line[pos]) || line[pos] == u'.')) {
+                ++pos;
+            }
+            add(start, pos, mNumber);
+            continue;
+        }
+        if (isIdentifierStart(ch)) {
+            const std::size_t start = pos;
+            while (pos < size && isIdentifier(line[pos])) {
+                ++pos;
+            }
+            if (std::binary_search(Keywords.begin(), Keywords.end(), line.substr(start, pos - start))) {
+                add(start, pos, mKeyword);
+            }
+            continue;
+        }
+        ++pos;
+    }
+    return state;
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include "Highlighter.h"
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+namespace spurv {
+
+// a small lexer for c like languages. knows block and line comments, string and
+// character literals, numbers and keywords, which get the text classes comment,
+// string, number and keyword. has to be created on the thread that registers text classes
+class CLexer : public SyntaxLexer
+{
+public:
+    CLexer();
+
+    virtual uint32_t lexLine(std::u16string_view line, uint32_t state, std::vector<SyntaxToken>& tokens) const override;
+
+private:
+    uint32_t mComment, mString, mNumber, mKeyword;
+};
+
+} // namespace spurv
@@ -1,60 +1,80 @@
 #include "Document.h"
+#include "Transcode.h"
+#include <Chrono.h>
 #include <EventLoop.h>
 #include <Formatting.h>
 #include <Logger.h>
 #include <ThreadPool.h>
-#include <simdutf.h>
 #include <fmt/core.h>
 #include <algorithm>
 #include <atomic>
 #include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <optional>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 using namespace spurv;
 
-static inline bool isTextClass(const std::vector<uint32_t>& classes, uint32_t clazz)
+namespace spurv {
+// std::function needs to be copyable so we can't use EventLoop::post(std::function)
+// to hand over a chunk of the rope
+class DocumentChunkEvent : public EventLoop::Event
 {
-    return classes.size() == 1 && classes[0] == clazz;
-}
+public:
+    DocumentChunkEvent(Document* doc, Rope&& chunk)
+        : mDoc(doc), mChunk(std::move(chunk))
+    {
+    }
 
-static inline bool hasTextClass(const std::vector<uint32_t>& classes, uint32_t clazz)
-{
-    return std::find(classes.begin(), classes.end(), clazz) != classes.end();
-}
+protected:
+    virtual void execute() override
+    {
+        mDoc->loadChunk(std::move(mChunk));
+    }
 
-static inline void addTextClass(std::vector<uint32_t>& classes, uint32_t clazz)
-{
-    classes.push_back(clazz);
-}
+private:
+    Document* mDoc;
+    Rope mChunk;
+};
+} // namespace spurv
 
-static inline void addTextClass(std::vector<uint32_t>& classes, const std::vector<uint32_t>& newClasses)
-{
-    classes.reserve(classes.size() + newClasses.size());
-    classes.insert(classes.end(), newClasses.begin(), newClasses.end());
-}
+// number of input bytes transcoded into each rope leaf when loading a mapped file
+static constexpr std::size_t MappedChunkSize = 65536;
+// bounds for the byte ranges of a mapped file that are transcoded in parallel
+static constexpr std::size_t MappedRangeMinSize = 1024 * 1024;
+static constexpr std::size_t MappedRangeMaxSize = 16 * 1024 * 1024;
 
-static inline void removeTextClass(std::vector<uint32_t>& classes, uint32_t clazz)
+static inline double megabytesPerSecond(std::size_t bytes, uint64_t ms)
 {
-    auto it = std::find(classes.begin(), classes.end(), clazz);
-    if (it != classes.end()) {
-        classes.erase(it);
+    if (ms == 0) {
+        ms = 1;
     }
+    return (static_cast<double>(bytes) / (1024. * 1024.)) / (static_cast<double>(ms) / 1000.);
 }
 
-static inline std::vector<uint32_t> removedTextClass(const std::vector<uint32_t>& classes, uint32_t clazz)
+// rounds a byte count up to a whole number of chunks
+static inline std::size_t alignedChunkSize(std::size_t bytes)
 {
-    auto it = std::find(classes.begin(), classes.end(), clazz);
-    if (it == classes.end()) {
-        return classes;
-    }
-    auto newClasses = classes;
-    newClasses.erase(it);
-    return newClasses;
+    return ((bytes + MappedChunkSize - 1) / MappedChunkSize) * MappedChunkSize;
 }
 
 Document::Document()
     : mTextClasses(TextClasses::instance())
 {
     setSelector("document");
+    resetTextPalette();
+    onAppliedStylesheet().connect([this]() {
+        compileTextClassStyles();
+        // the styles in the palette are out of date, views get new spans built with a new one
+        resetTextPalette();
+        if (mLayout.numLines() > 0) {
+            mOnPropertiesChanged.emit(0, mLayout.numLines() - 1);
+        }
+    });
 }
 
 Document::~Document()
@@ -66,7 +86,7 @@ void Document::updateLayout(const Rect& rect)
     (void)rect;
 }
 
-void Document::load(const std::filesystem::path& path)
+void Document::load(const std::filesystem::path& path, LoadMode mode)
 {
     mLayout.reset(Layout::Mode::Chunked);
     mLayout.onReady().connect([this]() {
@@ -76,95 +96,57 @@ void Document::load(const std::filesystem::path& path)
     });
     mRope = Rope();
     mDocumentSize = 0;
+    mLoadStarted = timeNow();
+    resetHighlighter();
 
     auto loop = EventLoop::eventLoop();
     auto pool = ThreadPool::mainThreadPool();
     auto doc = this;
+    if (mode == LoadMode::Mapped) {
+        pool->post([loop, path, doc]() -> void {
+            loadMapped(loop, path, doc);
+        });
+        return;
+    }
     pool->post([loop, path, doc]() -> void {
         // the fact that there's no file read api in std::filesystem is fascinating
 
         simdutf::encoding_type encoding = {};
+        std::size_t bytes = 0;
         FILE* f = fopen(path.c_str(), "r");
         if (f) {
             std::size_t bufOffset = 0;
             char buf[32768];
-            char16_t utf16buf[32768];
             std::u16string chunk;
             while (!feof(f)) {
                 int r = fread(buf + bufOffset, 1, sizeof(buf) - bufOffset, f);
                 if (r > 0) {
+                    bytes += r;
+                    const char* in = buf;
+                    std::size_t avail = bufOffset + r;
+                    const bool last = feof(f) != 0;
                     if (encoding == simdutf::unspecified) {
-                        encoding = simdutf::autodetect_encoding(buf, r);
-                    }
-                    switch (encoding) {
-                    case simdutf::Latin1: {
-                        const std::size_t words = simdutf::convert_latin1_to_utf16(buf, r, utf16buf);
-                        chunk = std::u16string(utf16buf, words);
-                        break; }
-                    case simdutf::UTF8: {
-                        const std::size_t utf8len = simdutf::trim_partial_utf8(buf, r);
-                        assert(utf8len < sizeof(utf16buf));
-                        const std::size_t words = simdutf::convert_utf8_to_utf16(buf, utf8len, utf16buf);
-                        if (utf8len != static_cast<std::size_t>(r)) {
-                            assert(utf8len < static_cast<std::size_t>(r));
-                            memmove(buf, buf + utf8len, r - utf8len);
-                            bufOffset = r - utf8len;
-                        } else {
-                            bufOffset = 0;
-                        }
-                        chunk = std::u16string(utf16buf, words);
-                        break; }
-                    case simdutf::UTF16_BE: {
-                        // assume we're a little endian system, flip the bytes
-                        // ### could probably optimize this
-                        const std::size_t utf16len = r / sizeof(char16_t);
-                        for (std::size_t n = 0; n < utf16len; ++n) {
-                            *(reinterpret_cast<uint16_t*>(buf) + n) = __builtin_bswap16(*(reinterpret_cast<uint16_t*>(buf) + n));
-                        }
-                        [[ fallthrough ]]; }
-                    case simdutf::UTF16_LE: {
-                        const std::size_t utf16len = r / sizeof(char16_t);
-                        const std::size_t utf16len8 = utf16len * sizeof(char16_t);
-                        chunk = std::u16string(reinterpret_cast<char16_t*>(buf), utf16len);
-                        if (utf16len8 != static_cast<std::size_t>(r)) {
-                            assert(utf16len8 < static_cast<std::size_t>(r));
-                            memmove(buf, buf + utf16len8, r - utf16len8);
-                            bufOffset = r - utf16len8;
-                        } else {
-                            bufOffset = 0;
-                        }
-                        break; }
-                    case simdutf::UTF32_BE: {
-                        // assume we're a little endian system, flip the bytes
-                        // ### could probably optimize this
-                        const std::size_t utf32len = r / sizeof(char32_t);
-                        for (std::size_t n = 0; n < utf32len; ++n) {
-                            *(reinterpret_cast<uint32_t*>(buf) + n) = __builtin_bswap32(*(reinterpret_cast<uint32_t*>(buf) + n));
+                        std::size_t bomSize;
+                        encoding = detectEncoding(in, avail, last, bomSize);
+                        if (encoding == simdutf::unspecified) {
+                            spdlog::info("No text encoding detected");
+                            break;
                         }
-                        [[ fallthrough ]]; }
-                    case simdutf::UTF32_LE: {
-                        const std::size_t utf32len = r / sizeof(char32_t);
-                        const std::size_t utf32len8 = utf32len * sizeof(char32_t);
-                        const std::size_t words = simdutf::convert_utf32_to_utf16(reinterpret_cast<char32_t*>(buf), utf32len, utf16buf);
-                        if (utf32len8 != static_cast<std::size_t>(r)) {
-                            assert(utf32len8 < static_cast<std::size_t>(r));
-                            memmove(buf, buf + utf32len8, r - utf32len8);
-                            bufOffset = r - utf32len8;
-                        } else {
-                            bufOffset = 0;
-                        }
-                        chunk = std::u16string(utf16buf, words);
-                        break; }
-                    case simdutf::unspecified:
-                        spdlog::info("No text encoding detected");
-                        break;
+                        // the byte order mark doesn't go in the document
+                        in += bomSize;
+                        avail -= bomSize;
+                    }
+                    const std::size_t inlen = codePointBoundary(encoding, in, avail, last);
+                    transcodeToUtf16(encoding, in, inlen, chunk);
+                    // keep the partial code point at the end for the next read
+                    bufOffset = avail - inlen;
+                    if (bufOffset > 0) {
+                        memmove(buf, in + inlen, bufOffset);
                     }
 
                     if (!chunk.empty()) {
-                        loop->post([doc, chunk = std::move(chunk)]() mutable -> void {
-                            doc->loadChunk(std::move(chunk));
-                        });
-                        chunk.clear();
+                        // build the rope (and its line breaks) here and hand it over to the document
+                        loop->post(std::make_unique<DocumentChunkEvent>(doc, Rope(chunk)));
                     }
                 }
             }
@@ -172,12 +154,170 @@ void Document::load(const std::filesystem::path& path)
         } else {
             spdlog::info("Unable to open file {}", path);
         }
-        loop->post([doc]() -> void {
-            doc->loadComplete();
+        loop->post([doc, bytes]() -> void {
+            doc->loadComplete(LoadMode::Read, bytes);
         });
     });
 }
 
+void Document::loadMapped(EventLoop* loop, const std::filesystem::path& path, Document* doc)
+{
+    auto complete = [loop, doc](std::size_t bytes) -> void {
+        loop->post([doc, bytes]() -> void {
+            doc->loadComplete(LoadMode::Mapped, bytes);
+        });
+    };
+
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        spdlog::info("Unable to open file {}", path);
+        complete(0);
+        return;
+    }
+    struct stat st;
+    if (::fstat(fd, &st) == -1) {
+        spdlog::info("Unable to stat file {}", path);
+        ::close(fd);
+        complete(0);
+        return;
+    }
+    const std::size_t size = static_cast<std::size_t>(st.st_size);
+    if (size == 0) {
+        ::close(fd);
+        complete(0);
+        return;
+    }
+    void* map = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    // the mapping keeps its own reference to the file
+    ::close(fd);
+    if (map == MAP_FAILED) {
+        spdlog::info("Unable to map file {}", path);
+        complete(0);
+        return;
+    }
+    // the ranges are read by several workers at once, all over the file. sequential readahead
+    // only follows one stream and drops pages behind it, so ask for the whole file up front
+    ::madvise(map, size, MADV_WILLNEED);
+
+    const char* data = static_cast<const char*>(map);
+    std::size_t bomSize;
+    const auto encoding = detectEncoding(data, size, true, bomSize);
+    if (encoding == simdutf::unspecified) {
+        spdlog::info("No text encoding detected");
+        ::munmap(map, size);
+        complete(0);
+        return;
+    }
+
+    // split the file into ranges that start and end on code point boundaries
+    // so that each of them can be transcoded on its own
+    auto pool = ThreadPool::mainThreadPool();
+    const std::size_t rangeSize = alignedChunkSize(std::clamp<std::size_t>(size / (std::max<std::size_t>(pool->numThreads(), 1) * 4),
+                                                                           MappedRangeMinSize, MappedRangeMaxSize));
+    std::vector<std::pair<std::size_t, std::size_t>> ranges;
+    // the byte order mark doesn't go in the document
+    std::size_t pos = bomSize;
+    while (pos < size) {
+        const std::size_t len = codePointBoundary(encoding, data + pos, std::min(size - pos, rangeSize), pos + rangeSize >= size);
+        if (len == 0) {
+            // trailing partial code unit
+            break;
+        }
+        ranges.push_back(std::make_pair(pos, len));
+        pos += len;
+    }
+    if (ranges.empty()) {
+        ::munmap(map, size);
+        complete(size);
+        return;
+    }
+
+    struct MappedLoad
+    {
+        EventLoop* loop;
+        Document* doc;
+        std::filesystem::path path;
+        void* map;
+        std::size_t size;
+        uint64_t started;
+
+        std::mutex mutex;
+        std::vector<std::optional<std::vector<Rope>>> results;
+        std::size_t next = 0;
+    };
+    auto load = std::make_shared<MappedLoad>();
+    load->loop = loop;
+    load->doc = doc;
+    load->path = path;
+    load->map = map;
+    load->size = size;
+    load->started = timeNow();
+    load->results.resize(ranges.size());
+
+    for (std::size_t idx = 0; idx < ranges.size(); ++idx) {
+        const auto [start, length] = ranges[idx];
+        pool->post([load, encoding, data, start, length, idx]() -> void {
+            std::vector<Rope> chunks;
+            chunks.reserve(length / MappedChunkSize + 1);
+            std::size_t off = 0;
+            while (off < length) {
+                const std::size_t chunkEnd = std::min(length, off + MappedChunkSize);
+                const std::size_t inlen = codePointBoundary(encoding, data + start + off, chunkEnd - off, chunkEnd == length);
+                if (inlen == 0) {
+                    // trailing partial code unit
+                    break;
+                }
+                // transcode straight into the leaves of the rope. a slice is as big as always fits in
+                // what's left of the leaf, text that transcodes to less takes a few slices to fill one
+                const char* in = data + start + off;
+                Rope::Builder builder;
+                std::size_t pos = 0;
+                while (pos < inlen) {
+                    const std::size_t sliceEnd = std::min(inlen, pos + maxBytesForUtf16Length(encoding, builder.room()));
+                    const std::size_t slice = codePointBoundary(encoding, in + pos, sliceEnd - pos, sliceEnd == inlen);
+                    if (slice == 0) {
+                        break;
+                    }
+                    builder.commit(transcodeToUtf16(encoding, in + pos, slice, builder.leaf()));
+                    pos += slice;
+                }
+                off += inlen;
+                // build the rope (and its line breaks) here and hand it over to the document
+                auto rope = builder.build();
+                if (!rope.empty()) {
+                    chunks.push_back(std::move(rope));
+                }
+            }
+
+            // hand over every range that is now complete, in file order
+            std::lock_guard lock(load->mutex);
+            load->results[idx] = std::move(chunks);
+            if (load->results[load->next].has_value()) {
+                do {
+                    for (auto& chunk : *load->results[load->next]) {
+                        load->loop->post(std::make_unique<DocumentChunkEvent>(load->doc, std::move(chunk)));
+                    }
+                    load->results[load->next].reset();
+                    ++load->next;
+                } while (load->next < load->results.size() && load->results[load->next].has_value());
+
+                if (load->next == load->results.size()) {
+                    ::munmap(load->map, load->size);
+
+                    const uint64_t elapsed = timeNow() - load->started;
+                    spdlog::info("transcoded {} bytes from {} in {} ranges in {}ms, {:.1f} MB/s", load->size, load->path,
+                                 load->results.size(), elapsed, megabytesPerSecond(load->size, elapsed));
+                    auto doc = load->doc;
+                    const auto bytes = load->size;
+                    load->loop->post([doc, bytes]() -> void {
+                        doc->loadComplete(LoadMode::Mapped, bytes);
+                    });
+                }
+            }
+        });
+    }
+}
+
 void Document::load(const std::u16string& data)
 {
     mDocumentSize = data.size();
@@ -188,87 +328,98 @@ void Document::load(const std::u16string& data)
         mDocumentLines = mLayout.numLines();
         mOnReady.emit();
     });
-    mLayout.calculate(mRope.toString(), mRope.linebreaks());
-    initialize(0);
+    mLayout.calculate(mRope);
+    resetHighlighter();
 }
 
 void Document::load(std::u16string&& data)
 {
-    mDocumentSize = data.size();
-    mRope = Rope(std::move(data));
-    mLayout.reset(Layout::Mode::Single);
-    mLayout.onReady().connect([this]() {
-        mReady = true;
-        mDocumentLines = mLayout.numLines();
-        mOnReady.emit();
-    });
-    mLayout.calculate(mRope.toString(), mRope.linebreaks());
-    initialize(0);
+    load(static_cast<const std::u16string&>(data));
 }
 
-void Document::loadChunk(std::u16string&& data)
+void Document::insert(std::size_t offset, std::u16string_view text)
 {
-    mDocumentSize += data.size();
-    mRope.append(data);
-    mLayout.calculate(std::move(data), mRope.lastLinebreaks());
+    replace(offset, 0, text);
 }
 
-void Document::loadComplete()
+void Document::remove(std::size_t offset, std::size_t length)
 {
-    spdlog::info("completed loading doc {}", mRope.length());
-    spdlog::info("- linebreaks {}", mRope.linebreaks());
-    mLayout.finalize();
-    initialize(0);
-}
-
-void Document::initialize(std::size_t offset)
-{
-    // if we have a valid rope, take out a chunk
-    if (offset < mRope.length()) {
-        auto handle = mRope.remove(offset, std::min<std::size_t>(mRope.length(), ChunkSize));
-        mChunk = handle->treeToString();
-        mChunkStart = offset;
-        mChunkOffset = 0;
-    } else if (offset > 0 && offset == mRope.length()) {
-        // end of document
-        mChunk = {};
-        mChunkStart = offset;
-        mChunkOffset = 0;
-    } else {
-        assert(offset == 0 && mRope.length() == 0);
-        // no valid rope, empty document
-        mChunk = {};
-        mChunkStart = mChunkOffset = 0;
+    replace(offset, length, {});
+}
+
+void Document::replace(std::size_t offset, std::size_t length, std::u16string_view text)
+{
+    offset = std::min(offset, mRope.length());
+    length = std::min(length, mRope.length() - offset);
+    if (length == 0 && text.empty()) {
+        return;
+    }
+    const std::size_t oldLines = mLayout.numLines();
+    // the lines of the rope, the layout might not have all of them yet
+    const std::size_t oldRopeLines = mRope.numLines();
+    const std::size_t firstLine = mRope.lineForOffset(offset);
+    const std::size_t removedLines = mRope.lineForOffset(offset + length) - firstLine;
+    if (length > 0) {
+        mRope.remove(offset, length);
+    }
+    if (!text.empty()) {
+        mRope.insert(offset, text);
     }
-    spdlog::info("initialize doc {} {}", mChunkStart, mChunk.size());
+    mDocumentSize = mRope.length();
+    // only relayouts the lines that were touched
+    mLayout.edit(mRope, offset, length, text.size());
+    mTextClassEntries.edit(offset, length, text.size());
+    mSyntaxClassEntries.edit(offset, length, text.size());
+    if (mHighlighter) {
+        mHighlighter->edit(mRope, firstLine, removedLines, mRope.numLines() + removedLines - oldRopeLines);
+    }
+    mDocumentLines = mLayout.numLines();
+
+    const std::size_t startLine = mRope.lineForOffset(offset > 0 ? offset - 1 : 0);
+    const std::size_t endLine = mDocumentLines != oldLines ? mDocumentLines : mRope.lineForOffset(offset + text.size()) + 1;
+    mOnTextChanged.emit(startLine, std::min(endLine, mDocumentLines));
 }
 
-void Document::commit(Commit mode, std::size_t offset)
+void Document::loadChunk(Rope&& chunk)
 {
-    mRope.insert(mChunkStart, std::move(mChunk));
-    if (mode == Commit::Reinitialize) {
-        initialize(offset != std::numeric_limits<std::size_t>::max() ? offset : mChunkStart);
-    } else {
-        assert(offset == std::numeric_limits<std::size_t>::max());
-        mChunk = {};
-        mChunkStart = mChunkOffset = 0;
+    mDocumentSize += chunk.length();
+    mRope.append(std::move(chunk));
+    // hands a snapshot to the layout, no text is copied
+    mLayout.calculate(mRope);
+}
+
+void Document::loadComplete(LoadMode mode, std::size_t bytes)
+{
+    const uint64_t elapsed = timeNow() - mLoadStarted;
+    spdlog::info("completed loading doc {} ({} bytes, {} mode) in {}ms, {:.1f} MB/s", mRope.length(), bytes,
+                 mode == LoadMode::Mapped ? "mapped" : "read", elapsed, megabytesPerSecond(bytes, elapsed));
+    spdlog::info("- lines {}", mRope.numLines());
+    // the node allocators are shared by all ropes so this is only exact with a single document
+    const auto memory = Rope::memoryStats();
+    const double textMegabytes = static_cast<double>(mRope.length() * sizeof(char16_t)) / (1024. * 1024.);
+    if (textMegabytes > 0.) {
+        const double overhead = static_cast<double>(memory.bytes) / (1024. * 1024.) - textMegabytes;
+        spdlog::info("- rope {} leaves, {} branches, {:.1f} KB overhead per MB of text", memory.leaves, memory.branches,
+                     (overhead * 1024.) / textMegabytes);
     }
+    mLayout.finalize();
+    resetHighlighter();
 }
 
 TextLine Document::textForLine(std::size_t line) const
 {
-    if (line < mLayout.numLines()) {
+    if (line < mLayout.numLines() && mLayout.isShaped(line)) {
         const auto& ll = mLayout.lineAt(line);
         return {
             line, ll.startOffset,
-            hb_buffer_reference(ll.buffer),
-            ll.font
+            ll.glyphs, 0, ll.glyphs.size(),
+            internedFont(ll.glyphs.font())
         };
     }
     return {
         static_cast<std::size_t>(0),
         static_cast<std::size_t>(0),
-        nullptr,
+        GlyphRun {}, 0, 0,
         Font {}
     };
 }
@@ -284,68 +435,113 @@ std::vector<TextLine> Document::textForRange(std::size_t start, std::size_t end)
     std::vector<TextLine> out;
     out.reserve(end - start);
     for (std::size_t l = start; l < end; ++l) {
+        if (!mLayout.isShaped(l)) {
+            // not shaped yet, the lines after it will be part of a later range
+            break;
+        }
         const auto& ll = mLayout.lineAt(l);
         out.push_back({
                 l, ll.startOffset,
-                hb_buffer_reference(ll.buffer),
-                ll.font
+                ll.glyphs, 0, ll.glyphs.size(),
+                internedFont(ll.glyphs.font())
             });
     }
     return out;
 }
 
-TextProperty Document::propertyForClasses(std::size_t start, std::size_t end, const std::vector<uint32_t>& classes) const
+std::vector<TextLine> Document::textForRows(std::size_t start, std::size_t end)
 {
-    // ### should parse these up front
-    TextProperty prop = { start, end };
-    for (auto dit = mMergedQss.cbegin(); dit < mMergedQss.cend(); ++dit) {
-        const auto& fragment = dit->first;
-        for (auto clazz : classes) {
-            const auto& maybeSelector = mTextClasses->mRegisteredClasses[clazz - 1];
-            assert(maybeSelector.has_value());
-            if (Styleable::isGeneralizedFrom(maybeSelector.value(), fragment.selector())) {
-                const auto& block = fragment.block();
-                for (auto bit = block.cbegin(); bit != block.cend(); ++bit) {
-                    // ### should extract the relevant code that handles these in Styleable.cpp
-                    // into a function that's callable from both there and here
-                    const auto& name = bit->first;
-                    if (name == "background-color") {
-                        auto color = parseColor(bit->second.first);
-                        if (color.has_value()) {
-                            prop.background = *color;
-                        }
-                    } else if (name == "color") {
-                        auto color = parseColor(bit->second.first);
-                        if (color.has_value()) {
-                            prop.foreground = *color;
-                        }
-                    }
-                }
-                break;
+    if (start >= mLayout.numRows() || end > mLayout.numRows() || start > end) {
+        return {};
+    }
+    std::vector<TextLine> out;
+    out.reserve(end - start);
+    auto [ line, rowInLine ] = mLayout.lineForRow(start);
+    for (std::size_t row = start; row < end; ++line, rowInLine = 0) {
+        if (!mLayout.isShaped(line)) {
+            // not shaped yet, the rows after it will be part of a later range
+            break;
+        }
+        if (mLayout.wrapWidth() > 0) {
+            // a long line is shaped as far as it's shown, and a row further so the last row is complete
+            const std::size_t needed = rowInLine + (end - row) + 1;
+            while (mLayout.lineAt(line).isPartial() && mLayout.wrapsForLine(line).size() < needed) {
+                mLayout.extendLine(line);
             }
         }
+        const auto& ll = mLayout.lineAt(line);
+        const auto& wraps = mLayout.wrapsForLine(line);
+        const Font& font = internedFont(ll.glyphs.font());
+        for (; rowInLine < wraps.size() && row < end; ++rowInLine, ++row) {
+            const uint32_t first = wraps[rowInLine];
+            const uint32_t last = rowInLine + 1 < wraps.size() ? wraps[rowInLine + 1] : ll.glyphs.size();
+            out.push_back({
+                    row, ll.startOffset,
+                    ll.glyphs, first, last,
+                    font
+                });
+        }
     }
-    return prop;
-}
-
-bool Document::TextClassEntry::operator==(const Document::TextClassEntry& other) const
-{
-    return start == other.start && end == other.end;
+    return out;
 }
 
-bool Document::TextClassEntry::operator<(const Document::TextClassEntry& other) const
+// resolves the colors of every registered text class against the merged stylesheet
+void Document::compileTextClassStyles() const
 {
-    return start < other.start || (start == other.start && end < other.end);
-}
+    const auto& registered = mTextClasses->mRegisteredClasses;
+    mTextClassStyles.assign(registered.size(), {});
+    mTextClassStylesGeneration = mTextClasses->generation();
 
-bool Document::overlaps(const Document::TextClassEntry& t1, const Document::TextClassEntry& t2)
-{
-    return t1.start < t2.end && t2.start < t1.end;
+    for (std::size_t idx = 0; idx < registered.size(); ++idx) {
+        if (!registered[idx].has_value() || registered[idx]->fragmentCount() == 0) {
+            continue;
+        }
+        const auto& selector = registered[idx].value();
+        auto& style = mTextClassStyles[idx];
+        // only the rules with the classes of the text class can apply, they come in order so the last one wins
+        for (auto rule : generalizableRules(selector[selector.fragmentCount() - 1])) {
+            const auto foreground = ruleColor(rule, ColorType::Foreground);
+            const auto background = ruleColor(rule, ColorType::Background);
+            if (!foreground.has_value() && !background.has_value()) {
+                continue;
+            }
+            if (!Styleable::isGeneralizedFrom(selector, ruleSelector(rule))) {
+                continue;
+            }
+            if (foreground.has_value()) {
+                style.foregroundRule = static_cast<int32_t>(rule);
+                style.foreground = *foreground;
+            }
+            if (background.has_value()) {
+                style.backgroundRule = static_cast<int32_t>(rule);
+                style.background = *background;
+            }
+        }
+    }
 }
 
-bool Document::contains(const Document::TextClassEntry& t1, const Document::TextClassEntry& t2)
+TextProperty Document::propertyForClasses(std::size_t start, std::size_t end, std::span<const uint32_t> classes) const
 {
-    return t2.start >= t1.start && t2.end <= t1.end;
+    if (mTextClassStylesGeneration != mTextClasses->generation()) {
+        compileTextClassStyles();
+    }
+    // a rule applies if it matches any of the classes, so the color of the
+    // last rule that sets it for one of them wins
+    TextProperty prop = { start, end };
+    int32_t foregroundRule = -1, backgroundRule = -1;
+    for (auto clazz : classes) {
+        assert(clazz > 0 && clazz <= mTextClassStyles.size());
+        const auto& style = mTextClassStyles[clazz - 1];
+        if (style.foregroundRule > foregroundRule) {
+            foregroundRule = style.foregroundRule;
+            prop.foreground = style.foreground;
+        }
+        if (style.backgroundRule > backgroundRule) {
+            backgroundRule = style.backgroundRule;
+            prop.background = style.background;
+        }
+    }
+    return prop;
 }
 
 std::vector<TextProperty> Document::propertiesForRange(std::size_t start, std::size_t end) const
@@ -354,31 +550,101 @@ std::vector<TextProperty> Document::propertiesForRange(std::size_t start, std::s
         return {};
     }
 
-    const auto& sinfo = mLayout.lineAt(start);
-    const auto& einfo = mLayout.lineAt(end > start ? end - 1 : start);
-
-    const std::size_t startCluster = sinfo.startCluster;
-    const std::size_t endCluster = einfo.endCluster + 1;
-
-    TextClassEntry findClass = {
-        startCluster, endCluster, {}
-    };
+    // clusters are text offsets so the range is known even for lines that aren't shaped yet
+    const std::size_t startCluster = mLayout.lineOffset(start);
+    const std::size_t endCluster = mLayout.lineOffset(end > start ? end : start + 1);
 
     std::vector<TextProperty> props;
+    auto add = [&](std::size_t from, std::size_t to, std::span<const uint32_t> classes) {
+        props.push_back(propertyForClasses(from, to, classes));
+    };
+    mTextClassEntries.forEachOverlapping(startCluster, endCluster, add);
+    const std::size_t numDocument = props.size();
+    mSyntaxClassEntries.forEachOverlapping(startCluster, endCluster, add);
+    std::inplace_merge(props.begin(), props.begin() + numDocument, props.end(), [](const TextProperty& a, const TextProperty& b) {
+        return a.start < b.start;
+    });
+    return props;
+}
 
-    auto it = std::lower_bound(mTextClassEntries.begin(), mTextClassEntries.end(), findClass);
-    // find the first entry that goes before us
-    while (it != mTextClassEntries.begin()) {
-        if (!overlaps(*(it - 1), findClass))
-            break;
-        --it;
+uint32_t Document::paletteIndex(std::span<const uint32_t> classes)
+{
+    const auto prop = propertyForClasses(0, 0, classes);
+    const TextSpanStyle style = { prop.foreground, prop.background, prop.style, prop.sizeDelta };
+    auto [ it, inserted ] = mTextPaletteIndex.try_emplace(style, static_cast<uint32_t>(mTextPalette.size()));
+    if (inserted) {
+        mTextPalette.push_back(style);
     }
-    while (it != mTextClassEntries.end() && overlaps(*it, findClass)) {
-        props.push_back(propertyForClasses(it->start, it->end, it->classes));
-        ++it;
+    return it->second;
+}
+
+void Document::resetTextPalette()
+{
+    mTextPalette.assign(1, TextSpanStyle());
+    mTextPaletteIndex.clear();
+    mTextPaletteIndex.emplace(TextSpanStyle(), 0);
+    ++mTextPaletteGeneration;
+}
+
+TextSpans Document::spansForRange(std::size_t start, std::size_t end)
+{
+    TextSpans spans;
+    if (start >= mLayout.numLines() || end > mLayout.numLines() || start > end) {
+        return spans;
     }
+    const std::size_t startCluster = mLayout.lineOffset(start);
+    const std::size_t endCluster = mLayout.lineOffset(end > start ? end : start + 1);
+    spans.start = spans.end = startCluster;
+
+    struct Range
+    {
+        std::size_t start, end;
+        std::span<const uint32_t> classes;
+    };
+    // in order of start
+    std::vector<Range> ranges;
+    auto add = [&](std::size_t from, std::size_t to, std::span<const uint32_t> classes) {
+        ranges.push_back({ std::max(from, startCluster), std::min(to, endCluster), classes });
+    };
+    mTextClassEntries.forEachOverlapping(startCluster, endCluster, add);
+    const std::size_t numDocument = ranges.size();
+    mSyntaxClassEntries.forEachOverlapping(startCluster, endCluster, add);
+    std::inplace_merge(ranges.begin(), ranges.begin() + numDocument, ranges.end(), [](const Range& a, const Range& b) {
+        return a.start < b.start;
+    });
 
-    return props;
+    // sweep over the boundaries of the ranges, keeping the ones that cover the current position
+    std::vector<const Range*> active;
+    std::vector<uint32_t> classes;
+    std::size_t pos = startCluster, next = 0;
+    while (pos < endCluster) {
+        std::erase_if(active, [pos](const Range* range) { return range->end <= pos; });
+        while (next < ranges.size() && ranges[next].start <= pos) {
+            active.push_back(&ranges[next++]);
+        }
+        std::size_t until = next < ranges.size() ? ranges[next].start : endCluster;
+        for (auto range : active) {
+            until = std::min(until, range->end);
+        }
+
+        uint32_t style = 0;
+        if (active.size() == 1) {
+            style = paletteIndex(active.front()->classes);
+        } else if (!active.empty()) {
+            classes.clear();
+            for (auto range : active) {
+                for (auto clazz : range->classes) {
+                    if (std::find(classes.begin(), classes.end(), clazz) == classes.end()) {
+                        classes.push_back(clazz);
+                    }
+                }
+            }
+            style = paletteIndex(classes);
+        }
+        spans.append(static_cast<uint32_t>(until - pos), style);
+        pos = until;
+    }
+    return spans;
 }
 
 std::vector<TextProperty> Document::propertiesForLine(std::size_t line) const
@@ -391,6 +657,16 @@ void Document::setFont(const Font& font)
     mLayout.setFont(font);
 }
 
+void Document::setWrapWidth(int32_t width)
+{
+    mLayout.setWrapWidth(width);
+}
+
+void Document::setViewport(std::size_t firstLine, std::size_t numLines)
+{
+    mLayout.setViewport(firstLine, numLines);
+}
+
 void Document::emitPropertiesChanged(std::size_t start, std::size_t end)
 {
     assert(start < end);
@@ -405,190 +681,43 @@ void Document::emitPropertiesChanged(std::size_t start, std::size_t end)
 void Document::addTextClassAtCluster(uint32_t clazz, std::size_t start, std::size_t end)
 {
     assert(start < end);
-    TextClassEntry newClass = {
-        start, end, { clazz }
-    };
-    auto it = std::lower_bound(mTextClassEntries.begin(), mTextClassEntries.end(), newClass);
-    if (it == mTextClassEntries.end()) {
-        mTextClassEntries.push_back(newClass);
-    } else {
-        if (it->start == start && it->end == end) {
-            addTextClass(it->classes, clazz);
-        } else {
-            mTextClassEntries.insert(it, newClass);
-        }
-    }
+    mTextClassEntries.add(clazz, start, end);
     emitPropertiesChanged(start, end);
 }
 
 void Document::removeTextClassAtCluster(uint32_t clazz, std::size_t start, std::size_t end)
 {
     assert(start < end);
-    TextClassEntry findClass = {
-        start, end, { clazz }
-    };
-    auto it = std::lower_bound(mTextClassEntries.begin(), mTextClassEntries.end(), findClass);
-    // find the first entry that goes before us
-    while (it != mTextClassEntries.begin()) {
-        if (!overlaps(*(it - 1), findClass))
-            break;
-        --it;
-    }
-    // we may have to split at the start
-    if (it->start < start) {
-        assert(it->end > start);
-        if (hasTextClass(it->classes, clazz)) {
-            // split
-            TextClassEntry newClass = {
-                start,
-                it->end,
-                removedTextClass(it->classes, clazz)
-            };
-            it = mTextClassEntries.insert(it, newClass);
-            (it - 1)->end = start;
-            ++it;
-        }
-    }
-    // remove clazz from all entries up until end
-    while (it != mTextClassEntries.end()) {
-        if (it->start > end) {
-            break;
-        }
-        assert(overlaps(*it, findClass));
-        if (end >= it->end) {
-            assert(contains(findClass, *it));
-            removeTextClass(it->classes, clazz);
-        } else {
-            // this entry has an end that goes beyond our end, we might have to split
-            if (hasTextClass(it->classes, clazz)) {
-                // if the previous entry equals us then we don't have to split
-                if (it != mTextClassEntries.begin() &&
-                    (it - 1)->start == it->start &&
-                    (it - 1)->end == end) {
-                    addTextClass((it - 1)->classes, removedTextClass(it->classes, clazz));
-                } else {
-                    // we need to split
-                    TextClassEntry newClass = {
-                        it->start,
-                        end,
-                        removedTextClass(it->classes, clazz)
-                    };
-                    // put it past the inserted value, which should be the value
-                    // we're currently looking at
-                    assert(it == mTextClassEntries.begin() || *(it - 1) < newClass);
-
-                    it = mTextClassEntries.insert(it, newClass) + 1;
-                    it->start = end + 1;
-                    assert(it->start < it->end);
-                }
-            }
-        }
-        ++it;
-    }
+    mTextClassEntries.remove(clazz, start, end);
     emitPropertiesChanged(start, end);
 }
 
 void Document::overwriteTextClassesAtCluster(uint32_t clazz, std::size_t start, std::size_t end)
 {
     assert(start < end);
-    TextClassEntry findClass = {
-        start, end, { clazz }
-    };
-    auto it = std::lower_bound(mTextClassEntries.begin(), mTextClassEntries.end(), findClass);
-    // find the first entry that goes before us
-    while (it != mTextClassEntries.begin()) {
-        if (!overlaps(*(it - 1), findClass))
-            break;
-        --it;
-    }
-    // we may have to split at the start
-    if (it->start < start) {
-        assert(it->end > start);
-        if (!isTextClass(it->classes, clazz)) {
-            // split
-            TextClassEntry newClass = {
-                start,
-                it->end,
-                { clazz }
-            };
-            it = mTextClassEntries.insert(it, newClass);
-            (it - 1)->end = start;
-            ++it;
-        }
-    }
-    while (it != mTextClassEntries.end()) {
-        if (it->start > end) {
-            break;
-        }
-        assert(overlaps(*it, findClass));
-        if (end >= it->end) {
-            assert(contains(findClass, *it));
-            it->classes = { clazz };
-        } else {
-            // this entry has an end that goes beyond our end, we might have to split
-            if (!isTextClass(it->classes, clazz)) {
-                // if the previous entry equals us then we don't have to split
-                if (it != mTextClassEntries.begin() &&
-                    (it - 1)->start == it->start &&
-                    (it - 1)->end == end) {
-                    (it - 1)->classes = { clazz };
-                } else {
-                    // we need to split
-                    TextClassEntry newClass = {
-                        it->start,
-                        end,
-                        { clazz }
-                    };
-                    // put it past the inserted value, which should be the value
-                    // we're currently looking at
-                    assert(it == mTextClassEntries.begin() || *(it - 1) < newClass);
-
-                    it = mTextClassEntries.insert(it, newClass) + 1;
-                    it->start = end + 1;
-                    assert(it->start < it->end);
-                }
-            }
-        }
-        ++it;
-    }
+    mTextClassEntries.overwrite(clazz, start, end);
     emitPropertiesChanged(start, end);
 }
 
 void Document::clearTextClassesAtCluster(std::size_t start, std::size_t end)
 {
     assert(start < end);
-    TextClassEntry findClass = {
-        start, end, {}
-    };
-    auto it = std::lower_bound(mTextClassEntries.begin(), mTextClassEntries.end(), findClass);
-    // find the first entry that goes before us
-    while (it != mTextClassEntries.begin()) {
-        if (!overlaps(*(it - 1), findClass))
-            break;
-        --it;
-    }
-    if (it->start < start) {
-        assert(it->end > start);
+    mTextClassEntries.clear(start, end);
+    emitPropertiesChanged(start, end);
+}
 
-        // adjust end
-        it->end = start;
-        ++it;
+void Document::applyTextClassChanges(std::span<const TextClassChange> changes, TextClassLayer layer)
+{
+    if (changes.empty()) {
+        return;
     }
-    while (it != mTextClassEntries.end()) {
-        if (it->start > end) {
-            break;
-        }
-        assert(overlaps(*it, findClass));
-        if (end >= it->end) {
-            assert(contains(findClass, *it));
-            it = mTextClassEntries.erase(it);
-        } else {
-            // this entry has an end that goes beyond our end, adjust start
-            it->start = end;
-            assert(it->start < it->end);
-            ++it;
-        }
+    auto& entries = layer == TextClassLayer::Syntax ? mSyntaxClassEntries : mTextClassEntries;
+    std::size_t start = std::numeric_limits<std::size_t>::max(), end = 0;
+    for (const auto& change : changes) {
+        start = std::min(start, change.start);
+        end = std::max(end, change.end);
     }
+    entries.apply(changes);
     emitPropertiesChanged(start, end);
 }
 
@@ -597,3 +726,26 @@ void Document::clearTextClasses()
     mTextClassEntries.clear();
     emitPropertiesChanged(0, std::numeric_limits<std::size_t>::max());
 }
+
+void Document::setSyntaxLexer(std::shared_ptr<const SyntaxLexer> lexer)
+{
+    if (lexer) {
+        mHighlighter = std::make_unique<Highlighter>(this, std::move(lexer));
+    } else {
+        mHighlighter.reset();
+    }
+    resetHighlighter();
+}
+
+// drops the syntax classes and lexes all of the text again
+void Document::resetHighlighter()
+{
+    const bool hadClasses = !mSyntaxClassEntries.empty();
+    mSyntaxClassEntries.clear();
+    if (mHighlighter) {
+        mHighlighter->reset(mRope);
+    }
+    if (hadClasses && mLayout.numLines() > 0) {
+        emitPropertiesChanged(0, std::numeric_limits<std::size_t>::max());
+    }
+}
@@ -1,18 +1,24 @@
 #pragma once
 
+#include "Highlighter.h"
 #include "Layout.h"
+#include "Rope.h"
+#include "TextClassTree.h"
 #include "TextClasses.h"
 #include "Styleable.h"
 #include <EventEmitter.h>
 #include <Font.h>
 #include <TextLine.h>
 #include <TextProperty.h>
-#include <rope.hpp>
+#include <TextSpans.h>
+#include <UnorderedDense.h>
 #include <filesystem>
 #include <limits>
 #include <memory>
 #include <optional>
+#include <span>
 #include <string>
+#include <string_view>
 #include <vector>
 
 namespace spurv {
@@ -23,19 +29,28 @@ struct DocumentSelectorInternal;
 class Document : public Styleable
 {
 public:
-    using Rope = proj::rope;
-    using RopeNode = proj::rope_node;
-
     Document();
     ~Document();
 
-    void load(const std::filesystem::path& path);
+    enum class LoadMode { Read, Mapped };
+    void load(const std::filesystem::path& path, LoadMode mode = LoadMode::Mapped);
     void load(const std::u16string& data);
     void load(std::u16string&& data);
 
+    // editing, offsets are in utf-16 code units
+    void insert(std::size_t offset, std::u16string_view text);
+    void remove(std::size_t offset, std::size_t length);
+    void replace(std::size_t offset, std::size_t length, std::u16string_view text);
+
     // styling
     void setFont(const Font& font);
 
+    // the lines that are visible, these get laid out first
+    void setViewport(std::size_t firstLine, std::size_t numLines);
+    // soft wraps lines at width, in font units. 0 turns it off
+    void setWrapWidth(int32_t width);
+    int32_t wrapWidth() const;
+
     void addTextClassAtCluster(uint32_t clazz, std::size_t start, std::size_t end);
     void removeTextClassAtCluster(uint32_t clazz, std::size_t start, std::size_t end);
     void overwriteTextClassesAtCluster(uint32_t clazz, std::size_t start, std::size_t end);
@@ -43,18 +58,50 @@ public:
     void clearTextClassesAtCluster(std::size_t start, std::size_t end);
     void clearTextClasses();
 
+    // applies many text class changes in order, onPropertiesChanged is emitted
+    // once for the lines covering all of them. the whole batch goes into the
+    // tree at once, a highlighter should make its changes in one go
+    using TextClassChange = TextClassTree::Change;
+    // the classes from the syntax highlighter are kept apart from the others,
+    // the two are combined when the text is styled
+    enum class TextClassLayer { Document, Syntax };
+    void applyTextClassChanges(std::span<const TextClassChange> changes, TextClassLayer layer = TextClassLayer::Document);
+
+    // highlights the text with lexer in the background and keeps it highlighted
+    // as the text changes. a null lexer removes the syntax classes
+    void setSyntaxLexer(std::shared_ptr<const SyntaxLexer> lexer);
+    std::shared_ptr<const SyntaxLexer> syntaxLexer() const;
+
     bool isReady() const;
     EventEmitter<void()>& onReady();
     EventEmitter<void(std::size_t, std::size_t)>& onPropertiesChanged();
+    // the range of lines that changed, up to the end of the document if lines were added or removed
+    EventEmitter<void(std::size_t, std::size_t)>& onTextChanged();
 
     std::size_t numLines() const;
+    // rows are lines with soft wrapping, the same as lines without it
+    std::size_t numRows() const;
+    std::size_t rowForLine(std::size_t line) const;
+    std::size_t lineForRow(std::size_t row) const;
+
+    // an immutable copy of the text that's safe to read from other threads, O(1)
+    Rope snapshot() const;
 
     TextLine textForLine(std::size_t line) const;
     std::vector<TextLine> textForRange(std::size_t start, std::size_t end);
+    std::vector<TextLine> textForRows(std::size_t start, std::size_t end);
 
     std::vector<TextProperty> propertiesForLine(std::size_t line) const;
     std::vector<TextProperty> propertiesForRange(std::size_t start, std::size_t end) const;
 
+    // the styles of the lines [start, end) as runs of indexes into the text palette.
+    // overlapping class ranges are flattened, a code unit gets the style of all its classes
+    TextSpans spansForRange(std::size_t start, std::size_t end);
+    // an index keeps meaning the same style until the palette is rebuilt,
+    // which happens when the stylesheet changes and bumps the generation
+    const std::vector<TextSpanStyle>& textPalette() const;
+    uint64_t textPaletteGeneration() const;
+
 protected:
     virtual void updateLayout(const Rect& rect) override;
 
@@ -65,17 +112,18 @@ private:
     Document& operator=(const Document&) = delete;
 
 private:
-    void initialize(std::size_t offset);
-
-    enum class Commit { Finalize, Reinitialize };
-    void commit(Commit mode, std::size_t offset = std::numeric_limits<std::size_t>::max());
+    void loadChunk(Rope&& chunk);
+    void loadComplete(LoadMode mode, std::size_t bytes);
 
-    void loadChunk(std::u16string&& data);
-    void loadComplete();
+    static void loadMapped(EventLoop* loop, const std::filesystem::path& path, Document* doc);
 
     void removeSelector(const DocumentSelectorInternal* selector);
+    void resetHighlighter();
 
-    TextProperty propertyForClasses(std::size_t start, std::size_t end, const std::vector<uint32_t>& classes) const;
+    TextProperty propertyForClasses(std::size_t start, std::size_t end, std::span<const uint32_t> classes) const;
+    void compileTextClassStyles() const;
+    uint32_t paletteIndex(std::span<const uint32_t> classes);
+    void resetTextPalette();
     void emitPropertiesChanged(std::size_t start, std::size_t end);
 
 private:
@@ -83,59 +131,82 @@ private:
     Layout mLayout;
     Rope mRope;
 
-    enum { ChunkSize = 1000 };
-    std::u16string mChunk;
-    std::size_t mChunkStart = 0, mChunkOffset = 0;
     std::size_t mDocumentSize = 0, mDocumentLines = 0;
+    uint64_t mLoadStarted = 0;
 
     TextClasses* mTextClasses = nullptr;
 
-    struct TextClassEntry
+    // what the stylesheet resolves to for each text class, indexed by class - 1.
+    // rebuilt when the stylesheet is applied or the registered classes change
+    struct TextClassStyle
     {
-        std::size_t start;
-        std::size_t end;
-        std::vector<uint32_t> classes;
-
-        bool operator==(const TextClassEntry& other) const;
-        bool operator<(const TextClassEntry& other) const;
+        // the index of the rule that set the color, a later rule wins
+        int32_t foregroundRule = -1, backgroundRule = -1;
+        Color foreground = {}, background = {};
     };
-    std::vector<TextClassEntry> mTextClassEntries;
+    mutable std::vector<TextClassStyle> mTextClassStyles;
+    mutable uint64_t mTextClassStylesGeneration = 0;
+    std::vector<TextSpanStyle> mTextPalette;
+    unordered_dense::map<TextSpanStyle, uint32_t, TextSpanStyleHash> mTextPaletteIndex;
+    uint64_t mTextPaletteGeneration = 0;
 
-    static bool overlaps(const TextClassEntry& t1, const TextClassEntry& t2);
-    static bool contains(const TextClassEntry& t1, const TextClassEntry& t2);
+    TextClassTree mTextClassEntries;
+    TextClassTree mSyntaxClassEntries;
+    std::unique_ptr<Highlighter> mHighlighter;
 
     bool mReady = false;
     EventEmitter<void()> mOnReady;
     EventEmitter<void(std::size_t, std::size_t)> mOnPropertiesChanged;
+    EventEmitter<void(std::size_t, std::size_t)> mOnTextChanged;
 
     friend class Cursor;
+    friend class DocumentChunkEvent;
     friend struct DocumentSelectorInternal;
 };
 
-/*
-inline void Document::insert(char32_t uc)
+inline std::size_t Document::numLines() const
 {
-    if (!mReady) {
-        return;
-    }
-
-    mChunk.insert(mChunk.begin() + (mChunkOffset++), uc);
-    ++mDocumentSize;
-
-    if (mChunkStart + mChunkOffset == mDocumentSize) {
-        // at the end of the document
-        if (mChunkOffset == ChunkSize) {
-            commit(Commit::Reinitialize);
-        }
-    } else if (mChunkOffset == mChunk.size()) {
-        commit(Commit::Reinitialize);
-    }
+    return mDocumentLines;
 }
-*/
 
-inline std::size_t Document::numLines() const
+inline int32_t Document::wrapWidth() const
 {
-    return mDocumentLines;
+    return mLayout.wrapWidth();
+}
+
+inline std::size_t Document::numRows() const
+{
+    return mLayout.numRows();
+}
+
+inline std::size_t Document::rowForLine(std::size_t line) const
+{
+    return mLayout.rowForLine(line);
+}
+
+inline std::size_t Document::lineForRow(std::size_t row) const
+{
+    return mLayout.lineForRow(row).first;
+}
+
+inline std::shared_ptr<const SyntaxLexer> Document::syntaxLexer() const
+{
+    return mHighlighter ? mHighlighter->lexer() : nullptr;
+}
+
+inline const std::vector<TextSpanStyle>& Document::textPalette() const
+{
+    return mTextPalette;
+}
+
+inline uint64_t Document::textPaletteGeneration() const
+{
+    return mTextPaletteGeneration;
+}
+
+inline Rope Document::snapshot() const
+{
+    return mRope;
 }
 
 inline bool Document::isReady() const
@@ -153,4 +224,9 @@ inline EventEmitter<void(std::size_t, std::size_t)>& Document::onPropertiesChang
     return mOnPropertiesChanged;
 }
 
+inline EventEmitter<void(std::size_t, std::size_t)>& Document::onTextChanged()
+{
+    return mOnTextChanged;
+}
+
 } // namespace spurv
@@ -0,0 +1,485 @@
+#include "Highlighter.h"
+#include "Document.h"
+#include <Chrono.h>
+#include <EventLoop.h>
+#include <Logger.h>
+#include <ThreadPool.h>
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <string>
+
+// lines lexed from a state that's known to be right, lexing stops before this if it converges
+static constexpr std::size_t DirtyBatchLines = 1000;
+// lines that have never been lexed go in bigger batches, lexed in parallel
+static constexpr std::size_t UnlexedBatchLines = 4000;
+// line states are kept in pages of up to twice this many
+static constexpr std::size_t StatesPerPage = 256;
+
+// [start, end) of the text, without copying it if it's all in one chunk. only moves the iterator forward
+static std::u16string_view lineText(spurv::Rope::ChunkIterator& it, std::size_t start, std::size_t end, std::u16string& buffer)
+{
+    while (it.isValid() && it.offset() + it.chunk().size() <= start) {
+        it.next();
+    }
+    if (!it.isValid()) {
+        return {};
+    }
+    if (it.offset() <= start && it.offset() + it.chunk().size() >= end) {
+        return it.chunk().substr(start - it.offset(), end - start);
+    }
+    buffer.clear();
+    while (it.isValid() && it.offset() < end) {
+        const auto chunk = it.chunk();
+        const std::size_t from = start > it.offset() ? start - it.offset() : 0;
+        const std::size_t to = std::min(chunk.size(), end - it.offset());
+        buffer.append(chunk.substr(from, to - from));
+        if (it.offset() + chunk.size() > end) {
+            break;
+        }
+        it.next();
+    }
+    return buffer;
+}
+
+namespace spurv {
+struct HighlightResult
+{
+    std::size_t first = 0;
+    // lexed from a state that was a guess, the changes wait until it's known to be right
+    bool guessed = false;
+    // the state the first line was lexed from and the ones each line ended in
+    uint32_t state = 0;
+    std::vector<uint32_t> ends;
+    // the syntax classes of the lines, replacing what they had
+    std::vector<Document::TextClassChange> changes;
+};
+
+class HighlightJob
+{
+public:
+    // the snapshot the lines are lexed from
+    Rope text;
+    std::shared_ptr<const SyntaxLexer> lexer;
+    // set when the text changes, workers check it between lines
+    std::atomic<bool> cancelled = false;
+    Highlighter* highlighter = nullptr;
+
+    // lexes up to numLines lines starting with first. expected has the states the
+    // lines after first were lexed from before, lexing stops once it gets to one of them
+    static void lex(std::shared_ptr<HighlightJob> job, EventLoop* loop, std::size_t first, uint32_t state,
+                    std::size_t numLines, std::vector<std::optional<uint32_t>>&& expected, bool guessed);
+};
+
+void HighlightJob::lex(std::shared_ptr<HighlightJob> job, EventLoop* loop, std::size_t first, uint32_t state,
+                       std::size_t numLines, std::vector<std::optional<uint32_t>>&& expected, bool guessed)
+{
+    const Rope& text = job->text;
+    const std::size_t totalLines = text.numLines();
+    const std::size_t last = std::min(first + numLines, totalLines);
+
+    HighlightResult result;
+    result.first = first;
+    result.guessed = guessed;
+    result.state = state;
+    result.ends.reserve(last - first);
+
+    const std::size_t start = text.offsetForLine(first);
+    Rope::ChunkIterator it(text, start);
+    std::u16string buffer;
+    std::vector<SyntaxToken> tokens;
+    // replaced by the clear once the end is known
+    result.changes.push_back({});
+
+    std::size_t line = first;
+    std::size_t lineStart = start;
+    while (line < last) {
+        if (job->cancelled.load(std::memory_order_relaxed)) {
+            return;
+        }
+        const std::size_t next = text.offsetForLine(line + 1);
+        auto view = lineText(it, lineStart, next, buffer);
+        if (line + 1 < totalLines && !view.empty()) {
+            // a CR+LF is a single line break
+            const bool crlf = view.size() > 1 && view.back() == u'\n' && view[view.size() - 2] == u'\r';
+            view.remove_suffix(crlf ? 2 : 1);
+        }
+
+        tokens.clear();
+        state = job->lexer->lexLine(view, state, tokens);
+        result.ends.push_back(state);
+        for (const auto& token : tokens) {
+            if (token.start >= view.size() || token.length == 0 || token.clazz == 0) {
+                continue;
+            }
+            const std::size_t from = lineStart + token.start;
+            const std::size_t to = lineStart + std::min<std::size_t>(token.start + token.length, view.size());
+            result.changes.push_back({ Document::TextClassChange::Type::Add, token.clazz, from, to });
+        }
+
+        const std::size_t idx = line - first;
+        ++line;
+        lineStart = next;
+        if (idx < expected.size() && expected[idx] == state) {
+            // the next line was lexed from this state before, it and everything after it still holds
+            break;
+        }
+    }
+
+    if (lineStart > start) {
+        result.changes.front() = { Document::TextClassChange::Type::Clear, 0, start, lineStart };
+    } else {
+        result.changes.clear();
+    }
+    loop->post([job = std::move(job), result = std::move(result)]() mutable -> void {
+        // the highlighter cancels its job before it goes away
+        if (!job->cancelled.load(std::memory_order_relaxed)) {
+            job->highlighter->install(job, std::move(result));
+        }
+    });
+}
+} // namespace spurv
+
+using namespace spurv;
+
+Highlighter::Highlighter(Document* document, std::shared_ptr<const SyntaxLexer> lexer)
+    : mDocument(document), mLexer(std::move(lexer))
+{
+}
+
+Highlighter::~Highlighter()
+{
+    cancelJob();
+}
+
+void Highlighter::reset(const Rope& text)
+{
+    mLines.assign(text.numLines());
+    mHeld.clear();
+    mFirstDirty = 0;
+    mNextUnlexed = 0;
+    mResetStarted = timeNow();
+    restart(text);
+}
+
+void Highlighter::edit(const Rope& text, std::size_t firstLine, std::size_t removedLines, std::size_t insertedLines)
+{
+    if (firstLine + removedLines >= mLines.size() || mLines.size() - removedLines + insertedLines != text.numLines()) {
+        // the text changed some other way, like while loading
+        reset(text);
+        return;
+    }
+    // lines that guessed never got their classes, they're lexed again
+    for (const auto& held : mHeld) {
+        const std::size_t last = held.first + held.ends.size();
+        mLines.scan(held.first, [last](std::size_t line, LineState& state) -> bool {
+            state.lexed = false;
+            return line + 1 < last;
+        });
+        mNextUnlexed = std::min(mNextUnlexed, held.first);
+    }
+    mHeld.clear();
+    mLines.replace(firstLine + 1, removedLines, insertedLines);
+    // the line before might end in a CR that a LF was inserted or removed after
+    const std::size_t dirty = firstLine > 0 ? firstLine - 1 : 0;
+    for (std::size_t line = dirty; line <= firstLine + insertedLines; ++line) {
+        mLines[line].lexed = false;
+    }
+    mFirstDirty = std::min(mFirstDirty, dirty);
+    // the lines the edit made dirty are lexed from mFirstDirty, looking for lines to lex
+    // ahead goes on where it was instead of going through all the lines after the edit
+    if (mNextUnlexed > firstLine + removedLines) {
+        mNextUnlexed = mNextUnlexed - removedLines + insertedLines;
+    } else {
+        mNextUnlexed = std::min(mNextUnlexed, dirty);
+    }
+    restart(text);
+}
+
+void Highlighter::restart(const Rope& text)
+{
+    cancelJob();
+    mJob = std::make_shared<HighlightJob>();
+    mJob->text = text;
+    mJob->lexer = mLexer;
+    mJob->highlighter = this;
+    schedule();
+}
+
+void Highlighter::cancelJob()
+{
+    if (mJob) {
+        mJob->cancelled.store(true, std::memory_order_relaxed);
+    }
+    mJob.reset();
+    mClaimed.clear();
+}
+
+std::size_t Highlighter::claimedUntil(std::size_t line) const
+{
+    for (const auto& [ first, last ] : mClaimed) {
+        if (line >= first && line < last) {
+            return last;
+        }
+    }
+    return 0;
+}
+
+uint32_t Highlighter::stateBefore(std::size_t line) const
+{
+    return line > 0 ? mLines[line - 1].end : mLexer->initialState();
+}
+
+void Highlighter::advanceFirstDirty()
+{
+    if (mFirstDirty >= mLines.size()) {
+        return;
+    }
+    // up to the first line that's being lexed
+    std::size_t until = mLines.size();
+    for (const auto& [ first, last ] : mClaimed) {
+        if (last > mFirstDirty) {
+            until = std::min(until, std::max(first, mFirstDirty));
+        }
+    }
+    // lines that were lexed from the state the line before ended in are done
+    uint32_t before = stateBefore(mFirstDirty);
+    mFirstDirty = mLines.scan(mFirstDirty, [until, &before](std::size_t line, const LineState& state) -> bool {
+        if (line >= until || !state.lexed || state.start != before) {
+            return false;
+        }
+        before = state.end;
+        return true;
+    });
+}
+
+bool Highlighter::claimBatch(std::size_t& first, uint32_t& state, std::size_t& numLines, std::vector<std::optional<uint32_t>>& expected,
+                             bool& guessed)
+{
+    advanceFirstDirty();
+    if (mFirstDirty >= mLines.size()) {
+        return false;
+    }
+
+    // up to the next lines that are being lexed
+    auto limit = [this](std::size_t from, std::size_t count) -> std::size_t {
+        std::size_t until = std::min(from + count, mLines.size());
+        for (const auto& claimed : mClaimed) {
+            if (claimed.first > from) {
+                until = std::min(until, claimed.first);
+            }
+        }
+        return until - from;
+    };
+
+    expected.clear();
+    if (claimedUntil(mFirstDirty) == 0) {
+        // the right state is known here
+        guessed = false;
+        first = mFirstDirty;
+        state = stateBefore(first);
+        numLines = limit(first, DirtyBatchLines);
+        expected.reserve(numLines);
+        mLines.scan(first + 1, [&expected, last = first + numLines](std::size_t line, const LineState& lineState) -> bool {
+            if (line >= last) {
+                return false;
+            }
+            expected.push_back(lineState.lexed ? std::optional<uint32_t>(lineState.start) : std::nullopt);
+            return true;
+        });
+        return true;
+    }
+
+    // lex ahead from a guess, it gets checked when the lines before are done
+    mNextUnlexed = std::max(mNextUnlexed, mFirstDirty);
+    while (mNextUnlexed < mLines.size()) {
+        if (const std::size_t until = claimedUntil(mNextUnlexed)) {
+            mNextUnlexed = until;
+            continue;
+        }
+        // up to the next lines that are being lexed
+        const std::size_t next = mNextUnlexed + limit(mNextUnlexed, mLines.size());
+        mNextUnlexed = mLines.scan(mNextUnlexed, [next](std::size_t line, const LineState& lineState) -> bool {
+            return line < next && lineState.lexed;
+        });
+        if (mNextUnlexed < next) {
+            break;
+        }
+    }
+    if (mNextUnlexed >= mLines.size()) {
+        return false;
+    }
+    guessed = true;
+    first = mNextUnlexed;
+    state = first > 0 && mLines[first - 1].lexed ? mLines[first - 1].end : mLexer->initialState();
+    // up to the next line that has been lexed
+    const std::size_t last = first + limit(first, UnlexedBatchLines);
+    numLines = mLines.scan(first + 1, [last](std::size_t line, const LineState& lineState) -> bool {
+        return line < last && !lineState.lexed;
+    });
+    numLines = std::min(numLines, last) - first;
+    mNextUnlexed = first + numLines;
+    return true;
+}
+
+void Highlighter::schedule()
+{
+    if (!mJob) {
+        return;
+    }
+    auto pool = ThreadPool::mainThreadPool();
+    auto loop = EventLoop::eventLoop();
+    const std::size_t maxWorkers = std::max<std::size_t>(pool->numThreads(), 1);
+    std::size_t first, numLines;
+    uint32_t state;
+    std::vector<std::optional<uint32_t>> expected;
+    bool guessed;
+    while (mClaimed.size() < maxWorkers && claimBatch(first, state, numLines, expected, guessed)) {
+        mClaimed.push_back(std::make_pair(first, first + numLines));
+        pool->post([job = mJob, loop, first, state, numLines, expected = std::move(expected), guessed]() mutable -> void {
+            HighlightJob::lex(std::move(job), loop, first, state, numLines, std::move(expected), guessed);
+        });
+    }
+}
+
+void Highlighter::install(const std::shared_ptr<HighlightJob>& job, HighlightResult&& result)
+{
+    if (job != mJob) {
+        return;
+    }
+    std::erase_if(mClaimed, [&result](const auto& claimed) { return claimed.first == result.first; });
+    assert(result.first + result.ends.size() <= mLines.size());
+    mLines.scan(result.first, [&result](std::size_t line, LineState& state) -> bool {
+        const std::size_t idx = line - result.first;
+        if (idx >= result.ends.size()) {
+            return false;
+        }
+        state.start = idx > 0 ? result.ends[idx - 1] : result.state;
+        state.end = result.ends[idx];
+        state.lexed = true;
+        return true;
+    });
+    // a batch that converged early leaves the rest of what it claimed
+    mNextUnlexed = std::min(mNextUnlexed, result.first + result.ends.size());
+
+    if (result.guessed) {
+        mHeld.push_back(std::move(result));
+    } else {
+        trimHeld(result.first, result.first + result.ends.size());
+        applyChanges(result);
+    }
+    // held results are right once the lines before them are
+    advanceFirstDirty();
+    for (const auto& held : mHeld) {
+        if (held.first < mFirstDirty) {
+            applyChanges(held);
+        }
+    }
+    std::erase_if(mHeld, [this](const HighlightResult& held) { return held.first < mFirstDirty; });
+    schedule();
+
+    if (mResetStarted != 0 && isDone()) {
+        spdlog::info("highlighted {} lines in {}ms", mLines.size(), timeNow() - mResetStarted);
+        mResetStarted = 0;
+    }
+}
+
+void Highlighter::applyChanges(const HighlightResult& result)
+{
+    if (!result.changes.empty() && mDocument != nullptr) {
+        mDocument->applyTextClassChanges(result.changes, Document::TextClassLayer::Syntax);
+    }
+}
+
+void Highlighter::trimHeld(std::size_t first, std::size_t last)
+{
+    for (auto& held : mHeld) {
+        const std::size_t heldLast = held.first + held.ends.size();
+        if (held.first >= last || heldLast <= first) {
+            continue;
+        }
+        // lexing from the right state starts before a held result, it can only be cut at the front
+        assert(first <= held.first);
+        const std::size_t cut = std::min(last, heldLast) - held.first;
+        held.state = held.ends[cut - 1];
+        held.ends.erase(held.ends.begin(), held.ends.begin() + cut);
+        held.first += cut;
+        if (held.ends.empty()) {
+            continue;
+        }
+        // the changes go line by line after the clear, the ones for the lines that were cut come first
+        const std::size_t offset = mJob->text.offsetForLine(held.first);
+        const auto it = std::find_if(held.changes.begin() + 1, held.changes.end(), [offset](const Document::TextClassChange& change) {
+            return change.start >= offset;
+        });
+        held.changes.erase(held.changes.begin() + 1, it);
+        held.changes.front().start = offset;
+    }
+    std::erase_if(mHeld, [](const HighlightResult& held) { return held.ends.empty(); });
+}
+
+void Highlighter::LineStates::assign(std::size_t count)
+{
+    mPages.clear();
+    for (std::size_t line = 0; line < count; line += StatesPerPage) {
+        mPages.emplace_back(std::min(count - line, StatesPerPage));
+    }
+    mSize = count;
+    rebuildIndex();
+}
+
+void Highlighter::LineStates::replace(std::size_t first, std::size_t removed, std::size_t inserted)
+{
+    assert(first + removed <= mSize);
+    bool changed = false;
+    while (removed > 0) {
+        const std::size_t p = mPageLines.find(first);
+        auto& page = mPages[p];
+        const std::size_t idx = first - mPageLines.prefix(p);
+        const std::size_t num = std::min(removed, page.size() - idx);
+        page.erase(page.begin() + idx, page.begin() + idx + num);
+        // wraps around, the sums still come out right
+        mPageLines.add(p, -num);
+        changed = changed || page.empty();
+        removed -= num;
+        mSize -= num;
+    }
+    if (inserted > 0) {
+        // at the end of the page before, unless it's the first line
+        const std::size_t p = first > 0 ? mPageLines.find(first - 1) : 0;
+        if (p == mPages.size()) {
+            mPages.emplace_back();
+            changed = true;
+        }
+        auto& page = mPages[p];
+        const std::size_t idx = first - mPageLines.prefix(p);
+        page.insert(page.begin() + idx, inserted, LineState());
+        mPageLines.add(p, inserted);
+        mSize += inserted;
+        if (page.size() > StatesPerPage * 2) {
+            // split it up
+            std::vector<std::vector<LineState>> pages;
+            for (std::size_t off = 0; off < page.size(); off += StatesPerPage) {
+                const std::size_t num = std::min(page.size() - off, StatesPerPage);
+                pages.emplace_back(page.begin() + off, page.begin() + off + num);
+            }
+            mPages.erase(mPages.begin() + p);
+            mPages.insert(mPages.begin() + p, std::make_move_iterator(pages.begin()), std::make_move_iterator(pages.end()));
+            changed = true;
+        }
+    }
+    if (changed) {
+        std::erase_if(mPages, [](const std::vector<LineState>& page) { return page.empty(); });
+        rebuildIndex();
+    }
+}
+
+void Highlighter::LineStates::rebuildIndex()
+{
+    std::vector<std::size_t> counts;
+    counts.reserve(mPages.size());
+    for (const auto& page : mPages) {
+        counts.push_back(page.size());
+    }
+    mPageLines.assign(counts);
+}
@@ -0,0 +1,199 @@
+#pragma once
+
+#include "Rope.h"
+#include <FenwickTree.h>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace spurv {
+
+class Document;
+class HighlightJob;
+struct HighlightResult;
+
+// a token of a line, offsets are relative to the start of the line
+struct SyntaxToken
+{
+    uint32_t start, length;
+    // a class registered with TextClasses
+    uint32_t clazz;
+};
+
+// turns lines into tokens. lexing a line only depends on the state the line
+// starts in, which is whatever the previous line ended in. a lexer is used by
+// several workers at the same time so lexLine can't modify anything
+class SyntaxLexer
+{
+public:
+    virtual ~SyntaxLexer() = default;
+
+    // the state the first line starts in
+    virtual uint32_t initialState() const { return 0; }
+
+    // appends the tokens of line, which doesn't include its line break, and
+    // returns the state the next line starts in. text without a class doesn't
+    // need a token
+    virtual uint32_t lexLine(std::u16string_view line, uint32_t state, std::vector<SyntaxToken>& tokens) const = 0;
+};
+
+/*
+   Highlighter keeps a document's syntax classes up to date with its text.
+
+   It remembers the state each line started and ended in. An edit only makes
+   the lines it touched dirty, lexing goes on from there until a line ends in
+   the state that the next line was lexed with before. Everything after that is
+   still right.
+
+   Lines are lexed in batches on the thread pool. Lines that haven't been lexed
+   at all are lexed in parallel, each batch starting in the state its line had
+   before or the initial state. A batch that guessed wrong is lexed again from
+   the right state once the lines before it are done, which usually converges
+   after a line or two. The classes of a batch that guessed are held back until
+   the lines before it are done, so wrong guesses never show.
+*/
+
+class Highlighter
+{
+public:
+    // without a document lines are only lexed, for benchmarking
+    Highlighter(Document* document, std::shared_ptr<const SyntaxLexer> lexer);
+    ~Highlighter();
+
+    const std::shared_ptr<const SyntaxLexer>& lexer() const;
+
+    // lexes every line of text again
+    void reset(const Rope& text);
+    // text is the result of replacing removedLines lines after firstLine with insertedLines
+    // lines, the line firstLine itself changed as well
+    void edit(const Rope& text, std::size_t firstLine, std::size_t removedLines, std::size_t insertedLines);
+
+    bool isDone() const;
+
+private:
+    void restart(const Rope& text);
+    void cancelJob();
+    void schedule();
+    bool claimBatch(std::size_t& first, uint32_t& state, std::size_t& numLines, std::vector<std::optional<uint32_t>>& expected,
+                    bool& guessed);
+    void advanceFirstDirty();
+    // the end of the claimed lines that line is in, or 0 if it isn't claimed
+    std::size_t claimedUntil(std::size_t line) const;
+    uint32_t stateBefore(std::size_t line) const;
+    void install(const std::shared_ptr<HighlightJob>& job, HighlightResult&& result);
+    void applyChanges(const HighlightResult& result);
+    // drops what held results have for the lines [first, last), they were lexed again
+    void trimHeld(std::size_t first, std::size_t last);
+
+private:
+    Highlighter(const Highlighter&) = delete;
+    Highlighter(Highlighter&&) = delete;
+    Highlighter& operator=(const Highlighter&) = delete;
+    Highlighter& operator=(Highlighter&&) = delete;
+
+private:
+    Document* mDocument;
+    std::shared_ptr<const SyntaxLexer> mLexer;
+
+    // what each line was last lexed from and ended in, only meaningful for lexed lines
+    struct LineState
+    {
+        uint32_t start = 0, end = 0;
+        bool lexed = false;
+    };
+    // the states in pages of lines, an edit only moves the lines of the page it's in
+    class LineStates
+    {
+    public:
+        std::size_t size() const;
+        // count lines that haven't been lexed
+        void assign(std::size_t count);
+        // replaces removed lines at first with inserted ones that haven't been lexed
+        void replace(std::size_t first, std::size_t removed, std::size_t inserted);
+
+        LineState& operator[](std::size_t line);
+        const LineState& operator[](std::size_t line) const;
+
+        // calls func(line, state) for the lines from first on until it returns false,
+        // returns the line it stopped at or size(). cheaper than indexing line by line
+        template<typename Func>
+        std::size_t scan(std::size_t first, Func&& func);
+
+    private:
+        void rebuildIndex();
+
+    private:
+        std::vector<std::vector<LineState>> mPages;
+        FenwickTree<std::size_t> mPageLines;
+        std::size_t mSize = 0;
+    };
+    LineStates mLines;
+    // every line before this has been lexed from the right state
+    std::size_t mFirstDirty = 0;
+    // where to look for lines that have never been lexed
+    std::size_t mNextUnlexed = 0;
+
+    std::shared_ptr<HighlightJob> mJob;
+    // the lines [first, last) that workers are lexing
+    std::vector<std::pair<std::size_t, std::size_t>> mClaimed;
+    // results of batches that guessed their state, waiting for the lines before them
+    std::vector<HighlightResult> mHeld;
+    uint64_t mResetStarted = 0;
+
+    friend class HighlightJob;
+};
+
+inline const std::shared_ptr<const SyntaxLexer>& Highlighter::lexer() const
+{
+    return mLexer;
+}
+
+inline bool Highlighter::isDone() const
+{
+    return mFirstDirty >= mLines.size();
+}
+
+inline std::size_t Highlighter::LineStates::size() const
+{
+    return mSize;
+}
+
+inline Highlighter::LineState& Highlighter::LineStates::operator[](std::size_t line)
+{
+    const std::size_t page = mPageLines.find(line);
+    return mPages[page][line - mPageLines.prefix(page)];
+}
+
+inline const Highlighter::LineState& Highlighter::LineStates::operator[](std::size_t line) const
+{
+    const std::size_t page = mPageLines.find(line);
+    return mPages[page][line - mPageLines.prefix(page)];
+}
+
+template<typename Func>
+inline std::size_t Highlighter::LineStates::scan(std::size_t first, Func&& func)
+{
+    if (first >= mSize) {
+        return mSize;
+    }
+    std::size_t page = mPageLines.find(first);
+    std::size_t line = mPageLines.prefix(page);
+    std::size_t idx = first - line;
+    for (; page < mPages.size(); ++page) {
+        auto& states = mPages[page];
+        for (; idx < states.size(); ++idx) {
+            if (!func(line + idx, states[idx])) {
+                return line + idx;
+            }
+        }
+        line += states.size();
+        idx = 0;
+    }
+    return mSize;
+}
+
+} // namespace spurv
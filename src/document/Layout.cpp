@@ -1,156 +1,626 @@
 #include "Layout.h"
+#include "ShapeCache.h"
 #include <EventLoop.h>
 #include <Logger.h>
 #include <ThreadPool.h>
+#include <UnorderedDense.h>
 #include <uni_algo/ranges_word.h>
+#include <hb-ot.h>
+#include <algorithm>
+#include <atomic>
 #include <mutex>
 #include <cassert>
 #include <cstring>
 
+// number of lines shaped before they're handed over to the layout
+static constexpr std::size_t LayoutBatchLines = 1000;
+// smaller batches for the viewport so that it's spread over all the workers
+static constexpr std::size_t ViewportBatchLines = 64;
+// lines around the viewport that are shaped along with it
+static constexpr std::size_t ViewportMargin = 200;
+// lines longer than this are shaped in segments, and only as far as they're shown
+static constexpr std::size_t LongLineLength = 64 * 1024;
+// segments are cut a bit shorter, where it's safe to break
+static constexpr std::size_t SegmentLength = 8 * 1024;
+
+// copies [start, end) of the text to out, only ever moving the iterator forward
+static void copyText(spurv::Rope::ChunkIterator& it, std::size_t start, std::size_t end, std::u16string& out)
+{
+    out.clear();
+    while (it.isValid() && it.offset() + it.chunk().size() <= start) {
+        it.next();
+    }
+    while (it.isValid() && it.offset() < end) {
+        const auto chunk = it.chunk();
+        const std::size_t from = start > it.offset() ? start - it.offset() : 0;
+        const std::size_t to = std::min(chunk.size(), end - it.offset());
+        out.append(chunk.substr(from, to - from));
+        if (it.offset() + chunk.size() > end) {
+            break;
+        }
+        it.next();
+    }
+}
+
+// the number of lines in text that can be laid out
+static inline std::size_t linesIn(const spurv::Rope& text, bool complete)
+{
+    const auto summary = text.summary();
+    if (complete) {
+        return summary.linebreaks + 1;
+    }
+    // the last line isn't done yet and a CR at the end might still become a CR+LF
+    return summary.linebreaks - (summary.lastCr ? 1 : 0);
+}
+
+// where line idx ends, at its line break or at the CR of a CR+LF
+static inline std::size_t lineEnd(const spurv::Rope& text, std::size_t idx, std::size_t numBreaks)
+{
+    if (idx >= numBreaks) {
+        return text.length();
+    }
+    const std::size_t end = text.offsetForLine(idx + 1) - 1;
+    return end > 0 && text.at(end) == u'\n' && text.at(end - 1) == u'\r' ? end - 1 : end;
+}
+
+// the glyphs of the ascii range for a font where shaping ascii text is a one to
+// one mapping from characters to glyphs, with the same advance for all the
+// printable characters. fonts with ligatures or kerning don't qualify
+struct AsciiGlyphs
+{
+    bool usable = false;
+    hb_codepoint_t glyphs[128] = {};
+    hb_position_t advances[128] = {};
+};
+
+static bool hasFeature(hb_face_t* face, hb_tag_t table, std::initializer_list<hb_tag_t> features)
+{
+    hb_tag_t tags[64];
+    unsigned int start = 0, total;
+    do {
+        unsigned int count = sizeof(tags) / sizeof(tags[0]);
+        total = hb_ot_layout_table_get_feature_tags(face, table, start, &count, tags);
+        for (unsigned int idx = 0; idx < count; ++idx) {
+            if (std::find(features.begin(), features.end(), tags[idx]) != features.end()) {
+                return true;
+            }
+        }
+        start += count;
+        if (count == 0) {
+            break;
+        }
+    } while (start < total);
+    return false;
+}
+
+static AsciiGlyphs createAsciiGlyphs(hb_font_t* font)
+{
+    AsciiGlyphs ascii;
+    hb_face_t* face = hb_font_get_face(font);
+    // features that hb_shape applies by default and that can change plain ascii text
+    if (hasFeature(face, HB_OT_TAG_GSUB, { HB_TAG('l','i','g','a'), HB_TAG('c','l','i','g'), HB_TAG('c','a','l','t'),
+                                           HB_TAG('r','l','i','g'), HB_TAG('r','c','l','t') })
+        || hasFeature(face, HB_OT_TAG_GPOS, { HB_TAG('k','e','r','n'), HB_TAG('d','i','s','t') })) {
+        return ascii;
+    }
+    hb_blob_t* kern = hb_face_reference_table(face, HB_TAG('k','e','r','n'));
+    const bool legacyKern = hb_blob_get_length(kern) > 0;
+    hb_blob_destroy(kern);
+    if (legacyKern) {
+        return ascii;
+    }
+
+    // control characters aren't in here, lines with those go through hb_shape
+    for (hb_codepoint_t ch = 0x20; ch < 0x7f; ++ch) {
+        hb_codepoint_t glyph;
+        if (!hb_font_get_nominal_glyph(font, ch, &glyph)) {
+            return ascii;
+        }
+        ascii.glyphs[ch] = glyph;
+        ascii.advances[ch] = hb_font_get_glyph_h_advance(font, glyph);
+        if (ascii.advances[ch] != ascii.advances[0x20]) {
+            // not monospace
+            return ascii;
+        }
+    }
+    ascii.usable = true;
+    return ascii;
+}
+
+// null if the font doesn't qualify for the ascii fast path
+static const AsciiGlyphs* asciiGlyphsFor(const spurv::Font& font)
+{
+    static std::mutex mutex;
+    static spurv::unordered_dense::map<std::string, std::unique_ptr<AsciiGlyphs>> fonts;
+
+    const auto key = fmt::format("{}:{}", font.file().native(), font.size());
+    std::lock_guard lock(mutex);
+    auto& ascii = fonts[key];
+    if (!ascii) {
+        ascii = std::make_unique<AsciiGlyphs>(createAsciiGlyphs(font.font()));
+    }
+    return ascii->usable ? ascii.get() : nullptr;
+}
+
+// if every code unit is a printable ascii character. no early exit so that it vectorizes
+static inline bool isPrintableAscii(std::u16string_view text)
+{
+    // a bool accumulator keeps gcc from vectorizing it, a code unit wide one doesn't
+    uint16_t outside = 0;
+    for (const char16_t ch : text) {
+        outside |= static_cast<uint16_t>(ch - 0x20) >= 0x5f;
+    }
+    return outside == 0;
+}
+
+// what hb_shape would produce for a printable ascii line in a font that qualifies
+static spurv::GlyphRun shapeAscii(std::u16string_view line, const std::vector<uint32_t>& words,
+                                  uint16_t fontIdx, const AsciiGlyphs& ascii)
+{
+    auto run = spurv::GlyphRun::create(line.size(), words.size(), fontIdx);
+    auto glyphs = run.glyphs();
+    auto clusters = run.clusters();
+    auto advances = run.advances();
+    for (std::size_t idx = 0; idx < line.size(); ++idx) {
+        const char16_t ch = line[idx];
+        glyphs[idx] = static_cast<uint16_t>(ascii.glyphs[ch]);
+        clusters[idx] = idx;
+        advances[idx] = ascii.advances[ch];
+    }
+    std::copy(words.begin(), words.end(), run.wordBreaks().begin());
+    return run;
+}
+
+// breaks a line into rows that are at most width wide, at the last word break
+// that fits or in the middle of a word that's wider than a row. returns the
+// number of rows, starts gets the first glyph of each row
+static uint32_t wrapLine(const spurv::GlyphRun& glyphs, int32_t width, std::vector<uint32_t>* starts)
+{
+    if (starts) {
+        starts->assign(1, 0);
+    }
+    const auto advances = glyphs.advances();
+    const auto clusters = glyphs.clusters();
+    const auto words = glyphs.wordBreaks();
+    uint32_t rows = 1, rowStart = 0, breakGlyph = 0;
+    int64_t x = 0, breakX = 0;
+    std::size_t word = 0;
+    for (uint32_t idx = 0; idx < advances.size(); ++idx) {
+        // ### assumes that clusters go up, right to left text only wraps in the middle of words
+        while (word < words.size() && words[word] < clusters[idx]) {
+            ++word;
+        }
+        if (word < words.size() && words[word] == clusters[idx]) {
+            breakGlyph = idx;
+            breakX = x;
+        }
+        while (x + advances[idx] > width && idx > rowStart) {
+            if (breakGlyph > rowStart) {
+                rowStart = breakGlyph;
+                x -= breakX;
+            } else {
+                rowStart = breakGlyph = idx;
+                x = breakX = 0;
+            }
+            ++rows;
+            if (starts) {
+                starts->push_back(rowStart);
+            }
+        }
+        x += advances[idx];
+    }
+    return rows;
+}
+
+static void findWordBreaks(std::u16string_view line, std::vector<uint32_t>& words)
+{
+    words.clear();
+    auto u16words = una::views::word::utf16(line);
+    auto u16wordit = u16words.begin();
+    if (u16wordit != u16words.end()) {
+        words.push_back(u16wordit.begin() - line.begin());
+        while (u16wordit != u16words.end()) {
+            words.push_back(u16wordit.end() - line.begin());
+            ++u16wordit;
+        }
+    }
+}
+
+struct ShapedGlyphs
+{
+    std::vector<uint16_t> glyphs;
+    std::vector<uint32_t> clusters;
+    std::vector<int32_t> advances;
+};
+
+static spurv::GlyphRun runFromGlyphs(const ShapedGlyphs& shaped, const std::vector<uint32_t>& words, uint16_t fontIdx)
+{
+    auto run = spurv::GlyphRun::create(shaped.glyphs.size(), words.size(), fontIdx);
+    std::copy(shaped.glyphs.begin(), shaped.glyphs.end(), run.glyphs().begin());
+    std::copy(shaped.clusters.begin(), shaped.clusters.end(), run.clusters().begin());
+    std::copy(shaped.advances.begin(), shaped.advances.end(), run.advances().begin());
+    std::copy(words.begin(), words.end(), run.wordBreaks().begin());
+    return run;
+}
+
+// shapes a line from offset from until at least until, a segment at a time.
+// each segment ends at its last glyph that's not unsafe to break, the glyphs
+// before that come out the same as when shaping the whole line. line can be
+// the start of a line that's length code units long, returns where it stopped
+static std::size_t shapeSegments(std::u16string_view line, std::size_t length, std::size_t from, std::size_t until,
+                                 hb_font_t* shapeFont, hb_buffer_t* buf, ShapedGlyphs& out)
+{
+    std::size_t segmentStart = from;
+    while (segmentStart < until && segmentStart < line.size()) {
+        std::size_t segmentEnd = std::min(segmentStart + SegmentLength, line.size());
+        // don't split a surrogate pair
+        if (segmentEnd < line.size() && (line[segmentEnd] & 0xfc00) == 0xdc00) {
+            ++segmentEnd;
+        }
+        hb_buffer_clear_contents(buf);
+        // the text around the segment is context, clusters are offsets in the line
+        hb_buffer_add_utf16(buf, reinterpret_cast<const uint16_t*>(line.data()),
+                            line.size(), segmentStart, segmentEnd - segmentStart);
+        hb_buffer_guess_segment_properties(buf);
+        hb_shape(shapeFont, buf, nullptr, 0);
+        unsigned int count;
+        const hb_glyph_info_t* infos = hb_buffer_get_glyph_infos(buf, &count);
+        const hb_glyph_position_t* positions = hb_buffer_get_glyph_positions(buf, nullptr);
+
+        std::size_t cut = segmentEnd;
+        if (segmentEnd < length) {
+            // the end of the segment might still change with the text after it
+            uint32_t safe = segmentStart;
+            for (unsigned int idx = 0; idx < count; ++idx) {
+                if (infos[idx].cluster > safe && !(hb_glyph_info_get_glyph_flags(&infos[idx]) & HB_GLYPH_FLAG_UNSAFE_TO_BREAK)) {
+                    safe = infos[idx].cluster;
+                }
+            }
+            // ### if there's no safe place in the whole segment it's cut anyway
+            if (safe > segmentStart) {
+                cut = safe;
+            }
+        }
+        for (unsigned int idx = 0; idx < count; ++idx) {
+            if (infos[idx].cluster < cut) {
+                out.glyphs.push_back(static_cast<uint16_t>(infos[idx].codepoint));
+                out.clusters.push_back(infos[idx].cluster);
+                out.advances.push_back(positions[idx].x_advance);
+            }
+        }
+        segmentStart = cut;
+    }
+    return segmentStart;
+}
+
+// shapes a line starting at offset start in the text, buf and words are scratch space.
+// line can be just the start of a long line, lines longer than LongLineLength are
+// only shaped that far and extended by Layout::extendLine
+static spurv::Layout::LineInfo shapeLine(std::u16string_view line, std::size_t length, std::size_t start, hb_font_t* shapeFont,
+                                         const spurv::Font& font, uint16_t fontIdx, const AsciiGlyphs* ascii,
+                                         hb_buffer_t* buf, std::vector<uint32_t>& words)
+{
+    const bool partial = length > LongLineLength;
+    const std::u16string_view shaped = line.substr(0, partial ? LongLineLength : length);
+    const bool fastPath = ascii != nullptr && isPrintableAscii(shaped);
+
+    auto cache = spurv::ShapeCache::instance();
+    spurv::GlyphRun run;
+    std::size_t shapedLength = shaped.size();
+    if (fastPath) {
+        // no ligatures or kerning, it can be cut anywhere
+        findWordBreaks(shaped, words);
+        run = shapeAscii(shaped, words, fontIdx, *ascii);
+    } else if (partial) {
+        ShapedGlyphs glyphs;
+        shapedLength = shapeSegments(line, length, 0, LongLineLength, shapeFont, buf, glyphs);
+        findWordBreaks(line.substr(0, shapedLength), words);
+        run = runFromGlyphs(glyphs, words, fontIdx);
+    } else if (line.size() > spurv::ShapeCache::MaxLineLength || !cache->find(line, font, run)) {
+        findWordBreaks(line, words);
+        hb_buffer_clear_contents(buf);
+        // hb_buffer_set_cluster_level(buf, HB_BUFFER_CLUSTER_LEVEL_MONOTONE_CHARACTERS);
+        hb_buffer_add_utf16(buf, reinterpret_cast<const uint16_t*>(line.data()),
+                            line.size(), 0, line.size());
+        hb_buffer_guess_segment_properties(buf);
+        hb_shape(shapeFont, buf, nullptr, 0);
+        run = spurv::GlyphRun::fromBuffer(buf, words, fontIdx);
+        cache->insert(line, font, run);
+    }
+
+    return {
+        std::move(run),
+        start,
+        start + length,
+        1,
+        static_cast<uint32_t>(shapedLength)
+    };
+}
+
+// shapes lines [first, last) of text, returns false if it was cancelled before it got through them
+static bool shapeLines(const spurv::Rope& text, std::size_t first, std::size_t last, hb_font_t* shapeFont,
+                       const spurv::Font& font, std::vector<spurv::Layout::LineInfo>& out,
+                       const std::atomic<bool>* cancelled = nullptr)
+{
+    std::u16string lineText;
+    std::vector<uint32_t> words;
+    // one buffer for the whole batch, the glyphs are copied out of it
+    hb_buffer_t* buf = hb_buffer_create();
+    const uint16_t fontIdx = spurv::internFont(font);
+    const AsciiGlyphs* ascii = asciiGlyphsFor(font);
+    const std::size_t numBreaks = text.numLinebreaks();
+    std::size_t start = text.offsetForLine(first);
+    // stream the lines out of the leaves instead of looking each one up
+    spurv::Rope::ChunkIterator chunks(text, start);
+    for (std::size_t idx = first; idx < last; ++idx) {
+        if (cancelled && cancelled->load(std::memory_order_relaxed)) {
+            break;
+        }
+        // the line without its line break
+        const std::size_t next = idx < numBreaks ? text.offsetForLine(idx + 1) : text.length() + 1;
+        const std::size_t end = lineEnd(text, idx, numBreaks);
+        // only the start of a long line is shaped, with a segment after it for context
+        copyText(chunks, start, std::min(end, start + LongLineLength + SegmentLength + 1), lineText);
+        out.push_back(shapeLine(lineText, end - start, start, shapeFont, font, fontIdx, ascii, buf, words));
+        start = next;
+    }
+    hb_buffer_destroy(buf);
+    return out.size() == last - first;
+}
+
+// the rows of a line, the part of a line that isn't shaped yet is one more row
+static uint32_t rowsFor(const spurv::Layout::LineInfo& info, int32_t width)
+{
+    if (width <= 0) {
+        return 1;
+    }
+    return wrapLine(info.glyphs, width, nullptr) + (info.isPartial() ? 1 : 0);
+}
+
 namespace spurv {
-struct LayoutChunk
+// sorted, disjoint ranges of lines. the background layout claims lines from the
+// start on so there are only a few of them, one more for each place it skipped to
+class LineRanges
 {
-    std::u16string data;
-    Font font;
+public:
+    // the first line at or after from that isn't in a range, up to to
+    std::size_t firstMissing(std::size_t from, std::size_t to) const;
+    // the first line after line that is in a range
+    std::size_t nextPresent(std::size_t line) const;
+
+    void add(std::size_t first, std::size_t last);
+    void remove(std::size_t first, std::size_t last);
+    // lines [first, first + removed) were replaced by inserted lines that aren't in a range
+    void edit(std::size_t first, std::size_t removed, std::size_t inserted);
+
+private:
+    struct Range
+    {
+        std::size_t first, last;
+    };
+    // the first range that ends after line
+    std::vector<Range>::const_iterator after(std::size_t line) const;
+
+    std::vector<Range> mRanges;
 };
 
+std::vector<LineRanges::Range>::const_iterator LineRanges::after(std::size_t line) const
+{
+    return std::upper_bound(mRanges.begin(), mRanges.end(), line, [](std::size_t l, const Range& range) {
+        return l < range.last;
+    });
+}
+
+std::size_t LineRanges::firstMissing(std::size_t from, std::size_t to) const
+{
+    // ranges are merged when they touch, there's a gap after each of them
+    auto it = after(from);
+    if (it != mRanges.end() && it->first <= from) {
+        from = it->last;
+    }
+    return std::min(from, to);
+}
+
+std::size_t LineRanges::nextPresent(std::size_t line) const
+{
+    auto it = after(line);
+    if (it == mRanges.end()) {
+        return std::numeric_limits<std::size_t>::max();
+    }
+    return std::max(it->first, line);
+}
+
+void LineRanges::add(std::size_t first, std::size_t last)
+{
+    if (first >= last) {
+        return;
+    }
+    // merges with every range it overlaps or touches
+    auto begin = std::lower_bound(mRanges.begin(), mRanges.end(), first, [](const Range& range, std::size_t l) {
+        return range.last < l;
+    });
+    auto end = begin;
+    while (end != mRanges.end() && end->first <= last) {
+        first = std::min(first, end->first);
+        last = std::max(last, end->last);
+        ++end;
+    }
+    mRanges.insert(mRanges.erase(begin, end), { first, last });
+}
+
+void LineRanges::remove(std::size_t first, std::size_t last)
+{
+    if (first >= last) {
+        return;
+    }
+    auto begin = std::upper_bound(mRanges.begin(), mRanges.end(), first, [](std::size_t l, const Range& range) {
+        return l < range.last;
+    });
+    auto end = begin;
+    std::vector<Range> kept;
+    while (end != mRanges.end() && end->first < last) {
+        if (end->first < first) {
+            kept.push_back({ end->first, first });
+        }
+        if (end->last > last) {
+            kept.push_back({ last, end->last });
+        }
+        ++end;
+    }
+    mRanges.insert(mRanges.erase(begin, end), kept.begin(), kept.end());
+}
+
+void LineRanges::edit(std::size_t first, std::size_t removed, std::size_t inserted)
+{
+    remove(first, first + removed);
+    // the inserted lines aren't in a range, one that spans them is split
+    auto it = std::upper_bound(mRanges.begin(), mRanges.end(), first, [](std::size_t l, const Range& range) {
+        return l < range.last;
+    });
+    if (it != mRanges.end() && it->first < first) {
+        const Range tail = { first, it->last };
+        it->last = first;
+        it = mRanges.insert(it + 1, tail);
+    }
+    // the ranges after the edit move
+    const std::size_t idx = it - mRanges.begin();
+    for (; it != mRanges.end(); ++it) {
+        it->first = it->first - removed + inserted;
+        it->last = it->last - removed + inserted;
+    }
+    // the ranges on either side of the edit touch if nothing was inserted
+    if (idx > 0 && idx < mRanges.size() && mRanges[idx - 1].last == mRanges[idx].first) {
+        mRanges[idx - 1].last = mRanges[idx].last;
+        mRanges.erase(mRanges.begin() + idx);
+    }
+}
+
 class LayoutJob
 {
 public:
     std::mutex mutex;
-    std::vector<LayoutChunk> chunks;
-    std::vector<Linebreak> linebreaks;
-    std::size_t length = 0, posted = 0;
-    bool running = false;
+    // the latest snapshot of the text
+    Rope text;
+    Font font;
+    bool complete = false;
+    // number of pool tasks working on the job
+    std::size_t workers = 0;
+    // set when the job is replaced by another one or the layout is destroyed. it's
+    // checked without the lock between lines so workers drop a batch that's no
+    // longer wanted, and before a batch is installed
+    std::atomic<bool> cancelled = false;
     Layout* layout = nullptr;
 
-    static void runJob(std::shared_ptr<LayoutJob> job, std::size_t prevProcessed, std::size_t startCluster);
+    // visible lines go first, then the margin around them and then the rest
+    enum class Priority { Visible, NearVisible, Background };
+    std::size_t visibleFirst = 0, visibleLast = 0;
+    std::size_t nearFirst = 0, nearLast = 0;
+    // lines that have been claimed by a batch, an edit moves them along with
+    // the lines so that a new job doesn't have to look at every line
+    LineRanges claimed;
+    // batches that are being shaped or waiting to be installed, they're
+    // lost if the job is replaced
+    std::vector<std::pair<std::size_t, std::size_t>> pending;
+    // everything before this has been claimed
+    std::size_t nextBackground = 0;
+
+    // returns false if there's nothing left to shape
+    bool claimBatch(std::size_t numLines, std::size_t& first, std::size_t& last, Priority& priority);
+
+    // starts workers until there's one for each thread in the pool
+    static void runJob(std::shared_ptr<LayoutJob> job);
+    static void process(std::shared_ptr<LayoutJob> job, EventLoop* loop);
 };
 
-void LayoutJob::runJob(std::shared_ptr<LayoutJob> job, std::size_t prevProcessed, std::size_t startCluster)
+bool LayoutJob::claimBatch(std::size_t numLines, std::size_t& first, std::size_t& last, Priority& priority)
+{
+    if (cancelled.load(std::memory_order_relaxed)) {
+        return false;
+    }
+    auto claim = [&](std::size_t from, std::size_t to, std::size_t batchLines) -> bool {
+        first = claimed.firstMissing(from, to);
+        if (first == to) {
+            return false;
+        }
+        last = std::min({ to, first + batchLines, claimed.nextPresent(first) });
+        claimed.add(first, last);
+        pending.emplace_back(first, last);
+        return true;
+    };
+    priority = Priority::Visible;
+    if (claim(std::min(visibleFirst, numLines), std::min(visibleLast, numLines), ViewportBatchLines)) {
+        return true;
+    }
+    priority = Priority::NearVisible;
+    if (claim(std::min(nearFirst, numLines), std::min(nearLast, numLines), ViewportBatchLines)) {
+        return true;
+    }
+    priority = Priority::Background;
+    nextBackground = claimed.firstMissing(nextBackground, numLines);
+    return claim(nextBackground, numLines, LayoutBatchLines);
+}
+
+void LayoutJob::runJob(std::shared_ptr<LayoutJob> job)
 {
-    job->running = true;
+    auto pool = ThreadPool::mainThreadPool();
     auto loop = EventLoop::eventLoop();
-    ThreadPool::mainThreadPool()->post([job = std::move(job), loop, prevProcessed, startCluster]() -> void {
-        std::size_t processed = 0, processedStart = 0, total = 0;
-        std::size_t currentChunk = 0;
-        std::size_t currentLinebreak = 0;
-        std::size_t prevEndCluster = startCluster;
-        LayoutChunk chunk;
-        std::vector<Linebreak> linebreaks;
-        std::vector<Layout::LineInfo> buffers;
-
-        for (;; ++currentChunk) {
-            {
-                std::lock_guard lock(job->mutex);
-                if (!buffers.empty()) {
-                    ++job->posted;
-                    loop->post([buffers = std::move(buffers), layout = job->layout, total]() -> void {
-                        const auto endCluster = buffers.empty() ? 0 : buffers.back().endCluster + 1;
-                        layout->mLines.reserve(layout->mLines.size() + buffers.size());
-                        layout->mLines.insert(layout->mLines.end(), buffers.begin(), buffers.end());
-                        layout->notifyLines(total, endCluster);
-                    });
-                }
-                if (currentChunk == job->chunks.size()) {
-                    job->running = false;
-                    return;
-                }
-                // take this chunk
-                if (chunk.font.isValid() && chunk.font == job->chunks[currentChunk].font) {
-                    // this is bad, we have left over data but this new chunk
-                    // has a different font. so discard the previous data
-                    chunk.font.clear();
-                    chunk.data.clear();
-                }
-                chunk.font = job->chunks[currentChunk].font;
-                if (chunk.data.empty()) {
-                    chunk.data = std::move(job->chunks[currentChunk].data);
-                    processed += chunk.data.size();
-                } else {
-                    chunk.data += job->chunks[currentChunk].data;
-                    processed += job->chunks[currentChunk].data.size();
-                }
-                processedStart = processed - chunk.data.size();
-                // copy the linebreaks for this chunk
-                auto nextLinebreak = currentLinebreak;
-                while (nextLinebreak < job->linebreaks.size()) {
-                    if (job->linebreaks[nextLinebreak++].first >= processed) {
-                        --nextLinebreak;
-                        break;
-                    }
-                }
-                std::vector<Linebreak> newLinebreaks;
-                newLinebreaks.reserve(nextLinebreak - currentLinebreak);
-                std::copy(job->linebreaks.begin() + currentLinebreak,
-                          job->linebreaks.begin() + nextLinebreak,
-                          std::back_inserter(newLinebreaks));
-                linebreaks = std::move(newLinebreaks);
-                currentLinebreak = nextLinebreak;
-            }
+    // the batches are installed by line number so workers can finish in any order
+    const std::size_t maxWorkers = std::max<std::size_t>(pool->numThreads(), 1);
+    while (job->workers < maxWorkers) {
+        ++job->workers;
+        pool->post([job, loop]() mutable -> void {
+            process(std::move(job), loop);
+        });
+    }
+}
 
-            if (linebreaks.empty()) {
-                // nothing to do?
-                continue;
+void LayoutJob::process(std::shared_ptr<LayoutJob> job, EventLoop* loop)
+{
+    for (;;) {
+        Rope text;
+        Font font;
+        std::size_t first, last;
+        Priority priority;
+        {
+            std::lock_guard lock(job->mutex);
+            if (!job->claimBatch(linesIn(job->text, job->complete), first, last, priority)) {
+                --job->workers;
+                return;
             }
+            // the snapshot is immutable so it can be read without holding the lock
+            text = job->text;
+            font = job->font;
+        }
 
-            // for each linebreak
-            std::size_t prev = 0, accum = 0;
-            for (const auto& lb : linebreaks) {
-                const auto line = std::u16string_view(chunk.data.begin() + prev, chunk.data.begin() + (lb.first - processedStart));
-
-                std::vector<std::size_t> words;
-                auto u16words = una::views::word::utf16(line);
-                auto u16wordit = u16words.begin();
-                if (u16wordit != u16words.end()) {
-                    words.push_back(u16wordit.begin() - line.begin());
-                    while (u16wordit != u16words.end()) {
-                        words.push_back(u16wordit.end() - line.begin());
-                        ++u16wordit;
-                    }
-                }
+        // hb_font_t caches things internally, give each worker its own
+        hb_font_t* shapeFont = hb_font_create_sub_font(font.font());
 
-                hb_buffer_t* buf = hb_buffer_create();
-                // hb_buffer_set_cluster_level(buf, HB_BUFFER_CLUSTER_LEVEL_MONOTONE_CHARACTERS);
-                hb_buffer_add_utf16(buf, reinterpret_cast<const uint16_t*>(line.data()),
-                                    line.size(), 0, line.size());
-                hb_buffer_guess_segment_properties(buf);
-                hb_shape(chunk.font.font(), buf, nullptr, 0);
-                uint32_t glyphCount;
-                uint32_t highLineCluster = 0;
-                auto glyphInfo = hb_buffer_get_glyph_infos(buf, &glyphCount);
-                for (uint32_t gi = 0; gi < glyphCount; ++gi) {
-                    if (glyphInfo[gi].cluster > highLineCluster) {
-                        highLineCluster = glyphInfo[gi].cluster;
-                    }
-                }
+        std::vector<Layout::LineInfo> lines;
+        lines.reserve(last - first);
+        const bool shaped = shapeLines(text, first, last, shapeFont, font, lines, &job->cancelled);
+        hb_font_destroy(shapeFont);
+        if (!shaped) {
+            // the layout has moved on, nobody is waiting for the rest of the batch
+            std::lock_guard lock(job->mutex);
+            --job->workers;
+            return;
+        }
 
-                buffers.push_back({
-                        buf,
-                        processedStart + prevProcessed + accum,
-                        processedStart + line.size() + prevProcessed + accum,
-                        prevEndCluster,
-                        prevEndCluster + static_cast<std::size_t>(highLineCluster + 1),
-                        std::move(words),
-                        chunk.font
-                    });
-                prevEndCluster += highLineCluster + 1;
-                prev = lb.first - processedStart + 1;
-                accum = lb.first - processedStart;
+        loop->post([job, first, lines = std::move(lines)]() mutable -> void {
+            // the layout cancels its job before it's destroyed, after that job->layout dangles
+            if (!job->cancelled.load(std::memory_order_relaxed)) {
+                job->layout->installLines(job, first, std::move(lines));
             }
-            total = accum;
+        });
 
-            // memmove the remaining chunk data if any
-            const auto lbidx = linebreaks.back().first - processedStart;
-            if (lbidx + 1 < chunk.data.size()) {
-                ::memmove(chunk.data.data(), chunk.data.data() + lbidx + 1, chunk.data.size() - (lbidx + 1));
-                chunk.data.resize(chunk.data.size() - (lbidx + 1));
-            } else {
-                chunk.data.clear();
-                chunk.font.clear();
-            }
+        if (priority == Priority::Background) {
+            // let other tasks in the pool run between background batches
+            ThreadPool::mainThreadPool()->post([job = std::move(job), loop]() mutable -> void {
+                process(std::move(job), loop);
+            });
+            return;
         }
-    });
+    }
 }
 } // namespace spurv
 
@@ -162,129 +632,614 @@ Layout::Layout()
 
 Layout::~Layout()
 {
+    cancelJob();
     clearLines();
 }
 
 void Layout::setFont(const Font& font)
 {
+    // fonts are loaded again for every Font, compare what they're loaded from
+    if (font.file() == mFont.file() && font.size() == mFont.size() && font.isValid() == mFont.isValid()) {
+        return;
+    }
     mFont = font;
+    if (mNumShaped == 0 && !mJob) {
+        return;
+    }
+    // everything that's been shaped or is being shaped is for the old font
+    cancelJob();
+    unshapeLines();
+    mViewportReady = false;
+    mDone = false;
+    if (mNumLines > 0 && mFont.isValid()) {
+        updateJob();
+    }
 }
 
 void Layout::reset(Mode mode)
 {
+    cancelJob();
     clearLines();
     mMode = mode;
     mFinalized = false;
-    mReceived = 0;
-    mProcessed = 0;
+    mViewportReady = false;
+    mDone = false;
+    mText = Rope();
+    mNumLines = 0;
     mOnReady.disconnectAll();
 }
 
-void Layout::calculate(std::u16string&& data, std::vector<Linebreak>&& linebreaks)
+bool Layout::isComplete() const
+{
+    return mMode == Mode::Single || mFinalized;
+}
+
+void Layout::calculate(const Rope& text)
+{
+    mText = text;
+    const std::size_t numLines = linesIn(mText, isComplete());
+    assert(numLines >= mNumLines);
+    appendLines(numLines - mNumLines);
+    mNumLines = numLines;
+    updateJob();
+}
+
+void Layout::finalize()
+{
+    mFinalized = true;
+    const std::size_t numLines = linesIn(mText, true);
+    appendLines(numLines - mNumLines);
+    mNumLines = numLines;
+    updateJob();
+    checkReady();
+}
+
+void Layout::edit(const Rope& text, std::size_t offset, std::size_t removed, std::size_t inserted)
+{
+    // a CR right before the edit might have become or stopped being part of a CR+LF
+    const std::size_t firstLine = mText.lineForOffset(offset > 0 ? offset - 1 : 0);
+    const std::size_t oldLastLine = mText.lineForOffset(offset + removed);
+    const std::size_t oldNumLines = mNumLines;
+
+    mText = text;
+    mWrapsLine = std::numeric_limits<std::size_t>::max();
+    mNumLines = linesIn(mText, isComplete());
+
+    // the unfinished last line of a document that's still loading isn't in the pages
+    const std::size_t first = std::min(firstLine, oldNumLines);
+    const std::size_t removedLines = std::min(oldLastLine + 1, oldNumLines) - first;
+    assert(mNumLines + removedLines >= oldNumLines);
+    const std::size_t insertedLines = mNumLines + removedLines - oldNumLines;
+
+    if (first + removedLines < oldNumLines) {
+        shiftLines(first + removedLines, static_cast<std::ptrdiff_t>(inserted) - static_cast<std::ptrdiff_t>(removed));
+    }
+    removeLines(first, removedLines);
+    insertLines(first, insertedLines);
+
+    // lines that were in flight are from the old text
+    replaceJob(first, removedLines, insertedLines);
+
+    if (mFont.isValid()) {
+        // typically a single line, big pastes are left for the job
+        std::vector<LineInfo> lines;
+        hb_font_t* shapeFont = hb_font_create_sub_font(mFont.font());
+        shapeLines(mText, first, first + std::min(insertedLines, LayoutBatchLines), shapeFont, mFont, lines);
+        hb_font_destroy(shapeFont);
+        for (std::size_t idx = 0; idx < lines.size(); ++idx) {
+            installLine(first + idx, std::move(lines[idx]));
+        }
+        // the job hasn't been started so nothing else looks at it yet
+        mJob->claimed.add(first, first + lines.size());
+    }
+
+    if (mNumShaped < mNumLines) {
+        updateJob();
+    }
+}
+
+void Layout::setViewport(std::size_t firstLine, std::size_t numLines)
+{
+    mViewportFirst = firstLine;
+    mViewportLines = numLines;
+    if (mJob) {
+        updateJob();
+    }
+}
+
+void Layout::setWrapWidth(int32_t width)
+{
+    if (width == mWrapWidth) {
+        return;
+    }
+    // lines that fit in a row still do when it gets wider
+    const bool wider = mWrapWidth > 0 && (width == 0 || width > mWrapWidth);
+    mWrapWidth = width;
+    mWrapsLine = std::numeric_limits<std::size_t>::max();
+    for (auto& page : mPages) {
+        for (auto& info : page.lines) {
+            if (!info.glyphs.isValid() || (wider && info.rows == 1)) {
+                continue;
+            }
+            const uint32_t rows = rowsFor(info, mWrapWidth);
+            page.numRows += static_cast<std::size_t>(rows) - info.rows;
+            info.rows = rows;
+        }
+    }
+    rebuildRowIndex();
+}
+
+// hands the current text and viewport to the job and makes sure it's running
+void Layout::updateJob()
 {
     if (!mFont.isValid()) {
         spdlog::error("Layout font is not valid");
         return;
     }
-    bool createdJob = false;
     if (!mJob) {
-        createdJob = true;
+        // nothing is shaped, only replaceJob starts a job that carries on after another one
         mJob = std::make_shared<LayoutJob>();
+        mJob->layout = this;
     }
     std::lock_guard lock(mJob->mutex);
-    if (!mJob->running) {
-        if (!createdJob) {
-            mJob = std::make_shared<LayoutJob>();
+    mJob->text = mText;
+    mJob->font = mFont;
+    mJob->complete = isComplete();
+    mJob->visibleFirst = mViewportFirst;
+    mJob->visibleLast = mViewportFirst + mViewportLines;
+    mJob->nearFirst = mViewportFirst > ViewportMargin ? mViewportFirst - ViewportMargin : 0;
+    mJob->nearLast = mViewportFirst + mViewportLines + ViewportMargin;
+    if (mNumShaped < mNumLines) {
+        LayoutJob::runJob(mJob);
+    }
+}
+
+void Layout::cancelJob()
+{
+    if (mJob) {
+        // workers notice this between lines, installLines drops what they already posted
+        mJob->cancelled.store(true, std::memory_order_relaxed);
+    }
+    mJob.reset();
+}
+
+// starts a job that knows what the current one shaped, after lines [first, first + removedLines)
+// were replaced by insertedLines lines. the current one is cancelled
+void Layout::replaceJob(std::size_t first, std::size_t removedLines, std::size_t insertedLines)
+{
+    auto job = std::make_shared<LayoutJob>();
+    job->layout = this;
+    if (mJob) {
+        mJob->cancelled.store(true, std::memory_order_relaxed);
+        std::lock_guard lock(mJob->mutex);
+        job->claimed = std::move(mJob->claimed);
+        // what's being shaped for the old text won't be installed
+        for (const auto& [from, to] : mJob->pending) {
+            job->claimed.remove(from, to);
         }
-        mJob->layout = this;
-        LayoutJob::runJob(mJob, mProcessed, mEndCluster);
+        job->claimed.edit(first, removedLines, insertedLines);
     }
-    const auto dataSize = data.size();
-    mJob->chunks.push_back({ std::move(data), mFont });
-    if (linebreaks.empty()) {
+    mJob = std::move(job);
+}
+
+void Layout::installLines(const std::shared_ptr<LayoutJob>& job, std::size_t first, std::vector<LineInfo>&& lines)
+{
+    if (job != mJob) {
+        // from before a reset or an edit
         return;
     }
-    if (mJob->linebreaks.empty()) {
-        assert(mJob->length == 0);
-        mJob->linebreaks = std::move(linebreaks);
-    } else {
-        std::transform(linebreaks.cbegin(), linebreaks.cend(), linebreaks.begin(), [adjust = mJob->length](const auto& b) {
-            return std::make_pair(b.first + adjust, b.second);
-        });
-        auto& lbBack = mJob->linebreaks.back();
-        const auto& lbFront = linebreaks.front();
-        if (lbBack.first + 1 == lbFront.first && lbBack.second == 0x000D && lbFront.second == 0x000A) {
-            // replace old back with new front and take the rest
-            lbBack.first = lbFront.first;
-            lbBack.second = 0x000A;
-            if (linebreaks.size() > 1) {
-                mJob->linebreaks.insert(mJob->linebreaks.end(),
-                                        std::make_move_iterator(linebreaks.begin() + 1),
-                                        std::make_move_iterator(linebreaks.end()));
-            }
-        } else {
-            mJob->linebreaks.insert(mJob->linebreaks.end(),
-                                    std::make_move_iterator(linebreaks.begin()),
-                                    std::make_move_iterator(linebreaks.end()));
+    {
+        std::lock_guard lock(job->mutex);
+        std::erase(job->pending, std::make_pair(first, first + lines.size()));
+    }
+    for (std::size_t idx = 0; idx < lines.size(); ++idx) {
+        installLine(first + idx, std::move(lines[idx]));
+    }
+    checkReady();
+}
+
+void Layout::installLine(std::size_t line, LineInfo&& info)
+{
+    std::size_t idx;
+    const std::size_t p = pageForLine(line, idx);
+    // info has up to date offsets
+    applyShift(p);
+    auto& page = mPages[p];
+    if (page.lines.empty()) {
+        page.lines.resize(page.numLines);
+    }
+    auto& slot = page.lines[idx];
+    if (!slot.glyphs.isValid()) {
+        ++page.numShaped;
+        ++mNumShaped;
+    }
+    info.rows = rowsFor(info, mWrapWidth);
+    if (info.rows != slot.rows) {
+        const std::size_t delta = static_cast<std::size_t>(info.rows) - slot.rows;
+        page.numRows += delta;
+        mPageRows.add(p, delta);
+    }
+    if (line == mWrapsLine) {
+        mWrapsLine = std::numeric_limits<std::size_t>::max();
+    }
+    slot = std::move(info);
+}
+
+bool Layout::isViewportShaped() const
+{
+    const std::size_t last = mViewportFirst + mViewportLines;
+    if (last > mNumLines && !isComplete()) {
+        // more lines might still show up in the viewport
+        return false;
+    }
+    for (std::size_t line = mViewportFirst; line < std::min(last, mNumLines); ++line) {
+        if (!isShaped(line)) {
+            return false;
         }
     }
-    mJob->length += dataSize;
+    return true;
 }
 
-void Layout::notifyLines(std::size_t processed, std::size_t endCluster)
+void Layout::checkReady()
 {
-    ++mReceived;
-    mProcessed += processed;
-    mEndCluster = endCluster;
-    if (mMode == Mode::Single) {
+    if (!mViewportReady && isViewportShaped()) {
+        mViewportReady = true;
+        mOnReady.emit();
+    }
+    if (!mDone && isComplete() && mNumShaped == mNumLines) {
+        mDone = true;
+        const auto stats = ShapeCache::instance()->stats();
+        spdlog::info("layout done, shape cache {} hits {} misses ({} entries, {} bytes)",
+                     stats.hits, stats.misses, stats.entries, stats.bytes);
+        const auto memory = GlyphRun::memoryStats();
+        spdlog::info("- glyph runs in {} blocks, {} bytes", memory.blocks, memory.bytes);
         mOnReady.emit();
-    } else if (mFinalized) {
-        // refinalize
-        finalize();
     }
 }
 
-void Layout::finalize()
+std::size_t Layout::pageForLine(std::size_t line, std::size_t& idx) const
 {
-    mFinalized = true;
-    bool shouldEmit = false;
-    if (mJob) {
-        std::lock_guard lock(mJob->mutex);
-        if (!mJob->running && mJob->posted == mReceived) {
-            shouldEmit = true;
+    assert(line < mPageLines.total());
+    const std::size_t page = mPageLines.find(line);
+    idx = line - mPageLines.prefix(page);
+    return page;
+}
+
+// offsets are shifted a page at a time, when the page is looked at
+void Layout::applyShift(std::size_t p) const
+{
+    auto& page = mPages[p];
+    const std::ptrdiff_t pending = mPageShifts.prefix(p + 1) - page.shift;
+    if (pending == 0) {
+        return;
+    }
+    for (auto& info : page.lines) {
+        if (info.glyphs.isValid()) {
+            info.startOffset += pending;
+            info.endOffset += pending;
         }
-    } else {
-        shouldEmit = true;
     }
-    if (shouldEmit) {
-        mOnReady.emit();
+    page.shift += pending;
+}
+
+// shifts the offsets of first and all the lines after it
+void Layout::shiftLines(std::size_t first, std::ptrdiff_t delta)
+{
+    if (delta == 0) {
+        return;
+    }
+    std::size_t idx;
+    const std::size_t p = pageForLine(first, idx);
+    applyShift(p);
+    auto& page = mPages[p];
+    for (; idx < page.lines.size(); ++idx) {
+        auto& info = page.lines[idx];
+        if (info.glyphs.isValid()) {
+            info.startOffset += delta;
+            info.endOffset += delta;
+        }
+    }
+    if (p + 1 < mPages.size()) {
+        mPageShifts.add(p + 1, delta);
     }
 }
 
-void Layout::clearLines()
+void Layout::appendLines(std::size_t count)
+{
+    if (count == 0) {
+        return;
+    }
+    if (!mPages.empty() && mPages.back().numLines < LinesPerPage) {
+        auto& page = mPages.back();
+        const std::size_t num = std::min(count, LinesPerPage - page.numLines);
+        page.numLines += num;
+        page.numRows += num;
+        if (!page.lines.empty()) {
+            page.lines.resize(page.numLines);
+        }
+        mPageLines.add(mPages.size() - 1, num);
+        mPageRows.add(mPages.size() - 1, num);
+        count -= num;
+    }
+    if (count > 0) {
+        detachShifts();
+        while (count > 0) {
+            LinePage page;
+            page.numLines = page.numRows = std::min(count, LinesPerPage);
+            count -= page.numLines;
+            mPages.push_back(std::move(page));
+        }
+        rebuildIndex();
+    }
+}
+
+void Layout::removeLines(std::size_t first, std::size_t count)
+{
+    bool emptied = false;
+    while (count > 0) {
+        std::size_t idx;
+        const std::size_t p = pageForLine(first, idx);
+        auto& page = mPages[p];
+        const std::size_t num = std::min(count, page.numLines - idx);
+        std::size_t rows = num;
+        if (!page.lines.empty()) {
+            const auto begin = page.lines.begin() + idx;
+            for (auto it = begin; it != begin + num; ++it) {
+                if (it->glyphs.isValid()) {
+                    --page.numShaped;
+                    --mNumShaped;
+                }
+                rows += it->rows - 1;
+            }
+            page.lines.erase(begin, begin + num);
+        }
+        page.numLines -= num;
+        page.numRows -= rows;
+        // wraps around, the sums still come out right
+        mPageLines.add(p, -num);
+        mPageRows.add(p, -rows);
+        emptied = emptied || page.numLines == 0;
+        count -= num;
+    }
+    if (emptied) {
+        detachShifts();
+        std::erase_if(mPages, [](const LinePage& page) {
+            return page.numLines == 0;
+        });
+        rebuildIndex();
+    }
+}
+
+void Layout::insertLines(std::size_t first, std::size_t count)
 {
-    for (auto& l : mLines) {
-        if (l.buffer != nullptr) {
-            hb_buffer_destroy(l.buffer);
+    if (count == 0) {
+        return;
+    }
+    if (first == mPageLines.total()) {
+        appendLines(count);
+        return;
+    }
+    std::size_t idx;
+    const std::size_t p = pageForLine(first, idx);
+    auto& page = mPages[p];
+    page.numLines += count;
+    page.numRows += count;
+    if (!page.lines.empty()) {
+        page.lines.insert(page.lines.begin() + idx, count, LineInfo {});
+    }
+    mPageLines.add(p, count);
+    mPageRows.add(p, count);
+    if (page.numLines <= LinesPerPage * 2) {
+        return;
+    }
+
+    // split it up
+    detachShifts();
+    LinePage full = std::move(page);
+    std::vector<LinePage> pages;
+    for (std::size_t off = 0; off < full.numLines; off += LinesPerPage) {
+        LinePage split;
+        split.numLines = split.numRows = std::min(full.numLines - off, LinesPerPage);
+        split.shift = full.shift;
+        if (!full.lines.empty()) {
+            const auto begin = std::make_move_iterator(full.lines.begin() + off);
+            split.lines.assign(begin, begin + split.numLines);
+            split.numShaped = std::count_if(split.lines.begin(), split.lines.end(), [](const LineInfo& info) {
+                return info.glyphs.isValid();
+            });
+            for (const auto& info : split.lines) {
+                split.numRows += info.rows - 1;
+            }
+            if (split.numShaped == 0) {
+                split.lines.clear();
+            }
         }
+        pages.push_back(std::move(split));
+    }
+    mPages.erase(mPages.begin() + p);
+    mPages.insert(mPages.begin() + p, std::make_move_iterator(pages.begin()), std::make_move_iterator(pages.end()));
+    rebuildIndex();
+}
+
+// makes the shift of each page independent of the index so pages can be added and removed
+void Layout::detachShifts()
+{
+    for (std::size_t p = 0; p < mPages.size(); ++p) {
+        mPages[p].shift -= mPageShifts.prefix(p + 1);
+    }
+}
+
+void Layout::rebuildIndex()
+{
+    std::vector<std::size_t> counts;
+    counts.reserve(mPages.size());
+    for (const auto& page : mPages) {
+        counts.push_back(page.numLines);
+    }
+    mPageLines.assign(counts);
+    mPageShifts.assign(std::vector<std::ptrdiff_t>(mPages.size()));
+    rebuildRowIndex();
+}
+
+void Layout::rebuildRowIndex()
+{
+    std::vector<std::size_t> rows;
+    rows.reserve(mPages.size());
+    for (const auto& page : mPages) {
+        rows.push_back(page.numRows);
+    }
+    mPageRows.assign(rows);
+}
+
+void Layout::clearLines()
+{
+    mPages.clear();
+    mPageLines.clear();
+    mPageShifts.clear();
+    mPageRows.clear();
+    mWrapsLine = std::numeric_limits<std::size_t>::max();
+    mNumShaped = 0;
+}
+
+// drops the glyphs of every line but keeps the lines and their offsets
+void Layout::unshapeLines()
+{
+    for (auto& page : mPages) {
+        page.lines.clear();
+        page.lines.shrink_to_fit();
+        page.numShaped = 0;
+        page.numRows = page.numLines;
+    }
+    rebuildRowIndex();
+    mWrapsLine = std::numeric_limits<std::size_t>::max();
+    mNumShaped = 0;
+}
+
+const Layout::LineInfo& Layout::lineAt(std::size_t idx) const
+{
+    static const LineInfo unshaped = {};
+    if (idx >= mPageLines.total()) {
+        return unshaped;
+    }
+    std::size_t pageIdx;
+    const std::size_t p = pageForLine(idx, pageIdx);
+    if (mPages[p].lines.empty()) {
+        return unshaped;
+    }
+    applyShift(p);
+    return mPages[p].lines[pageIdx];
+}
+
+std::size_t Layout::lineEndOffset(std::size_t idx) const
+{
+    return lineEnd(mText, idx, mText.numLinebreaks());
+}
+
+std::size_t Layout::lineForOffset(std::size_t offset) const
+{
+    if (mNumLines == 0) {
+        return 0;
     }
-    mLines.clear();
+    return std::min(mText.lineForOffset(offset), mNumLines - 1);
 }
 
 std::pair<std::size_t, const Layout::LineInfo*> Layout::lineForCluster(std::size_t cluster) const
 {
-    const LineInfo findLine = {
-        nullptr, 0, 0, cluster
-    };
-    auto it = std::upper_bound(mLines.begin(), mLines.end(), findLine, [](const LineInfo& i1, const LineInfo& i2) -> bool {
-        return i1.startCluster < i2.startCluster;
-    });
-    if (it != mLines.begin()) {
-        return std::make_pair(static_cast<std::size_t>(it - mLines.begin() - 1), &*(it - 1));
+    if (mNumLines == 0) {
+        return std::make_pair(static_cast<std::size_t>(0), nullptr);
+    }
+    // clusters are offsets in the text
+    const std::size_t line = lineForOffset(cluster);
+    return std::make_pair(line, &lineAt(line));
+}
+
+std::size_t Layout::rowForLine(std::size_t line) const
+{
+    if (line >= mPageLines.total()) {
+        return numRows();
+    }
+    std::size_t idx;
+    const std::size_t p = pageForLine(line, idx);
+    std::size_t row = mPageRows.prefix(p) + idx;
+    for (std::size_t l = 0; l < idx && l < mPages[p].lines.size(); ++l) {
+        row += mPages[p].lines[l].rows - 1;
     }
-    if (!mLines.empty()) {
-        assert(cluster < mLines.front().startCluster);
-        return std::make_pair(static_cast<std::size_t>(0), &mLines.front());
+    return row;
+}
+
+std::pair<std::size_t, std::size_t> Layout::lineForRow(std::size_t row) const
+{
+    if (row >= numRows()) {
+        return std::make_pair(mNumLines, static_cast<std::size_t>(0));
+    }
+    const std::size_t p = mPageRows.find(row);
+    const std::size_t line = mPageLines.prefix(p);
+    std::size_t rem = row - mPageRows.prefix(p);
+    const auto& page = mPages[p];
+    if (page.lines.empty()) {
+        return std::make_pair(line + rem, static_cast<std::size_t>(0));
+    }
+    for (std::size_t idx = 0; idx < page.numLines; ++idx) {
+        if (rem < page.lines[idx].rows) {
+            return std::make_pair(line + idx, rem);
+        }
+        rem -= page.lines[idx].rows;
+    }
+    assert(false);
+    return std::make_pair(mNumLines, static_cast<std::size_t>(0));
+}
+
+const std::vector<uint32_t>& Layout::wrapsForLine(std::size_t line) const
+{
+    if (line != mWrapsLine) {
+        const auto& info = lineAt(line);
+        if (mWrapWidth > 0 && info.rows > 1) {
+            // without the row for the part of a line that isn't shaped
+            wrapLine(info.glyphs, mWrapWidth, &mWraps);
+        } else {
+            mWraps.assign(1, 0);
+        }
+        mWrapsLine = line;
+    }
+    return mWraps;
+}
+
+void Layout::extendLine(std::size_t line)
+{
+    if (line >= mPageLines.total() || !mFont.isValid()) {
+        return;
     }
-    return std::make_pair(static_cast<std::size_t>(0), nullptr);
+    std::size_t idx;
+    const std::size_t p = pageForLine(line, idx);
+    applyShift(p);
+    if (mPages[p].lines.empty() || !mPages[p].lines[idx].isPartial()) {
+        return;
+    }
+    const auto& info = mPages[p].lines[idx];
+    const std::size_t length = info.endOffset - info.startOffset;
+    // doubling keeps walking through a huge line linear
+    const std::size_t until = std::min<std::size_t>(length, info.shapedLength * 2);
+    std::u16string text;
+    Rope::ChunkIterator chunks(mText, info.startOffset);
+    copyText(chunks, info.startOffset, info.startOffset + std::min(length, until + SegmentLength + 1), text);
+
+    ShapedGlyphs shaped;
+    shaped.glyphs.assign(info.glyphs.glyphs().begin(), info.glyphs.glyphs().end());
+    shaped.clusters.assign(info.glyphs.clusters().begin(), info.glyphs.clusters().end());
+    shaped.advances.assign(info.glyphs.advances().begin(), info.glyphs.advances().end());
+    hb_font_t* shapeFont = hb_font_create_sub_font(mFont.font());
+    hb_buffer_t* buf = hb_buffer_create();
+    const std::size_t shapedLength = shapeSegments(text, length, info.shapedLength, until, shapeFont, buf, shaped);
+    hb_buffer_destroy(buf);
+    hb_font_destroy(shapeFont);
+
+    std::vector<uint32_t> words;
+    findWordBreaks(std::u16string_view(text).substr(0, shapedLength), words);
+    installLine(line, {
+            runFromGlyphs(shaped, words, internFont(mFont)),
+            info.startOffset,
+            info.endOffset,
+            1,
+            static_cast<uint32_t>(shapedLength)
+        });
 }
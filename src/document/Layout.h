@@ -1,12 +1,14 @@
 #pragma once
 
+#include "Rope.h"
 #include <EventEmitter.h>
+#include <FenwickTree.h>
 #include <Font.h>
-#include <Unicode.h>
+#include <GlyphRun.h>
+#include <limits>
 #include <memory>
 #include <string>
 #include <vector>
-#include <hb.h>
 
 namespace spurv {
 
@@ -18,31 +20,111 @@ public:
     Layout();
     ~Layout();
 
+    // shapes every line again if the font changes
     void setFont(const Font& font);
 
     enum class Mode { Single, Chunked };
     void reset(Mode mode);
 
-    void calculate(std::u16string&& data, std::vector<Linebreak>&& linebreaks);
+    // lays out the complete lines of a snapshot of the text, text is expected
+    // to be a newer version of the one passed in the previous call
+    void calculate(const Rope& text);
+    // no more text is coming, in chunked mode the last line is only laid out after this
     void finalize();
 
+    // text is the result of replacing removed code units at offset with inserted
+    // ones. only the lines touched by the edit are shaped again, the offsets of
+    // the lines after it are shifted lazily
+    void edit(const Rope& text, std::size_t offset, std::size_t removed, std::size_t inserted);
+
+    // lines in the viewport (and a margin around it) are shaped before any other
+    // lines. onReady is emitted as soon as the viewport is shaped and again
+    // once every line is
+    void setViewport(std::size_t firstLine, std::size_t numLines);
+
+    // soft wrapping breaks lines into rows no wider than width, at word breaks
+    // where possible. width is in font units (64 per pixel), 0 turns it off.
+    // changing it only wraps the lines again, nothing is shaped again
+    void setWrapWidth(int32_t width);
+    int32_t wrapWidth() const;
+
+    // a line goes from its first code unit up to, but not including, its line
+    // break. the clusters and word breaks of the glyphs are relative to startOffset
     struct LineInfo
     {
-        hb_buffer_t* buffer = nullptr;
+        GlyphRun glyphs = {};
         std::size_t startOffset = 0, endOffset = 0;
-        std::size_t startCluster = 0, endCluster = 0;
-        std::vector<std::size_t> wordBreaks = {};
-        Font font = {};
+        // the number of rows the line is wrapped into
+        uint32_t rows = 1;
+        // a very long line is only shaped up to here to start with
+        uint32_t shapedLength = 0;
+
+        bool isPartial() const { return startOffset + shapedLength < endOffset; }
     };
+    // lines that haven't been shaped yet have no glyph run
     const LineInfo& lineAt(std::size_t idx) const;
+    bool isShaped(std::size_t idx) const;
+
+    // line <-> offset lookups are O(log n) and don't need the line to be shaped.
+    // the rope indexes its line breaks, the line pages index the rows
+    std::size_t lineOffset(std::size_t idx) const;
+    // the offset of the line break that ends the line, the CR of a CR+LF, or the end of the text
+    std::size_t lineEndOffset(std::size_t idx) const;
+    std::size_t lineForOffset(std::size_t offset) const;
     std::pair<std::size_t, const LineInfo*> lineForCluster(std::size_t cluster) const;
     std::size_t numLines() const;
 
+    // rows are the visual lines, a line that isn't wrapped or isn't shaped yet is a single row
+    std::size_t numRows() const;
+    std::size_t rowForLine(std::size_t line) const;
+    // the line that row is part of and the index of the row in it
+    std::pair<std::size_t, std::size_t> lineForRow(std::size_t row) const;
+    // the glyphs that start the rows of a line, starting with 0
+    const std::vector<uint32_t>& wrapsForLine(std::size_t line) const;
+    // shapes more of a line that's only partly shaped, twice as much as before
+    void extendLine(std::size_t line);
+
     EventEmitter<void()>& onReady();
 
+    static constexpr std::size_t DefaultViewportLines = 500;
+
 private:
     void clearLines();
-    void notifyLines(std::size_t processed, std::size_t endCluster);
+    void unshapeLines();
+    void installLines(const std::shared_ptr<LayoutJob>& job, std::size_t first, std::vector<LineInfo>&& lines);
+    void installLine(std::size_t line, LineInfo&& info);
+    void updateJob();
+    void replaceJob(std::size_t first, std::size_t removedLines, std::size_t insertedLines);
+    void cancelJob();
+    bool isComplete() const;
+    bool isViewportShaped() const;
+    void checkReady();
+
+    // lines are kept in pages of varying size so that lines can be inserted and
+    // removed without moving all the lines after them. the pages are indexed by
+    // line number and by the offset shift that hasn't been applied to them yet.
+    // the lines after an edit in its own page are shifted right away so pages are small
+    static constexpr std::size_t LinesPerPage = 64;
+    struct LinePage
+    {
+        std::size_t numLines = 0;
+        std::size_t numShaped = 0;
+        std::size_t numRows = 0;
+        // the part of the shift in mPageShifts that's been applied to the lines
+        std::ptrdiff_t shift = 0;
+        // empty until a line in the page gets shaped
+        std::vector<LineInfo> lines;
+    };
+
+    std::size_t pageForLine(std::size_t line, std::size_t& idx) const;
+    void applyShift(std::size_t page) const;
+    void shiftLines(std::size_t first, std::ptrdiff_t delta);
+    void appendLines(std::size_t count);
+    void removeLines(std::size_t first, std::size_t count);
+    void insertLines(std::size_t first, std::size_t count);
+    void detachShifts();
+    void rebuildIndex();
+    void rebuildRowIndex();
 
 private:
     Layout(const Layout&) = delete;
@@ -55,10 +137,24 @@ private:
 
     Mode mMode = Mode::Single;
     Font mFont = {};
-    std::size_t mReceived = 0, mProcessed = 0, mEndCluster = 0;
-    bool mFinalized = false;
+    bool mFinalized = false, mViewportReady = false, mDone = false;
+
+    // the latest snapshot, lines that are laid out come from it
+    Rope mText;
+    std::size_t mNumLines = 0, mNumShaped = 0;
+    std::size_t mViewportFirst = 0, mViewportLines = DefaultViewportLines;
 
-    std::vector<LineInfo> mLines;
+    // the lines of a page are allocated when one of them gets shaped, so a huge
+    // document doesn't allocate anything for lines far away from the viewport
+    mutable std::vector<LinePage> mPages;
+    FenwickTree<std::size_t> mPageLines;
+    FenwickTree<std::ptrdiff_t> mPageShifts;
+    FenwickTree<std::size_t> mPageRows;
+
+    int32_t mWrapWidth = 0;
+    // the wraps of the last line that was asked for, a long line is usually asked for a row at a time
+    mutable std::size_t mWrapsLine = std::numeric_limits<std::size_t>::max();
+    mutable std::vector<uint32_t> mWraps;
 
     std::shared_ptr<LayoutJob> mJob;
 
@@ -71,14 +167,29 @@ inline EventEmitter<void()>& Layout::onReady()
     return mOnReady;
 }
 
-inline const Layout::LineInfo& Layout::lineAt(std::size_t idx) const
+inline bool Layout::isShaped(std::size_t idx) const
 {
-    return mLines[idx];
+    return lineAt(idx).glyphs.isValid();
+}
+
+inline std::size_t Layout::lineOffset(std::size_t idx) const
+{
+    return mText.offsetForLine(idx);
 }
 
 inline std::size_t Layout::numLines() const
 {
-    return mLines.size();
+    return mNumLines;
+}
+
+inline int32_t Layout::wrapWidth() const
+{
+    return mWrapWidth;
+}
+
+inline std::size_t Layout::numRows() const
+{
+    return mPageRows.total();
 }
 
 } // namespace spurv
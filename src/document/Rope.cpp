@@ -0,0 +1,1221 @@
+#include "Rope.h"
+#include <SlabAllocator.h>
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstring>
+#include <utility>
+
+namespace spurv {
+struct RopeNode
+{
+    // leaves are at height 0
+    uint32_t height = 0;
+    // number of ropes and branches referencing this node, shared nodes are immutable
+    std::atomic<uint32_t> refs { 1 };
+};
+
+struct RopeLeaf : public RopeNode
+{
+    static constexpr std::size_t LinebreakBlock = 64;
+    static constexpr std::size_t LinebreakBlocks = Rope::MaxLeafLength / LinebreakBlock;
+
+    uint16_t length = 0;
+    uint16_t numLinebreaks = 0;
+    // the number of line breaks in each block of the text. where they are is found
+    // by looking at the text of a block, which keeps the overhead of a leaf small
+    uint8_t linebreaks[LinebreakBlocks];
+    char16_t text[Rope::MaxLeafLength];
+};
+
+struct RopeBranch : public RopeNode
+{
+    enum Flag : uint8_t {
+        FirstLf = 0x1,
+        LastCr = 0x2
+    };
+
+    uint32_t count = 0;
+    std::size_t lengths[Rope::MaxChildren];
+    std::size_t linebreaks[Rope::MaxChildren];
+    uint8_t flags[Rope::MaxChildren];
+    RopeNode* children[Rope::MaxChildren];
+};
+} // namespace spurv
+
+using namespace spurv;
+
+static_assert(Rope::MaxLeafLength < 65536 && Rope::MaxLeafLength % RopeLeaf::LinebreakBlock == 0, "leaf lengths are 16 bit and line breaks are counted in blocks");
+
+// nodes are allocated in slabs, leaves are big and need no further allocations
+static SlabAllocator<RopeLeaf>& leafAllocator()
+{
+    static SlabAllocator<RopeLeaf> allocator;
+    return allocator;
+}
+
+static SlabAllocator<RopeBranch>& branchAllocator()
+{
+    static SlabAllocator<RopeBranch> allocator;
+    return allocator;
+}
+
+static inline RopeLeaf* asLeaf(RopeNode* node)
+{
+    assert(node->height == 0);
+    return static_cast<RopeLeaf*>(node);
+}
+
+static inline const RopeLeaf* asLeaf(const RopeNode* node)
+{
+    assert(node->height == 0);
+    return static_cast<const RopeLeaf*>(node);
+}
+
+static inline RopeBranch* asBranch(RopeNode* node)
+{
+    assert(node->height > 0);
+    return static_cast<RopeBranch*>(node);
+}
+
+static inline const RopeBranch* asBranch(const RopeNode* node)
+{
+    assert(node->height > 0);
+    return static_cast<const RopeBranch*>(node);
+}
+
+static inline RopeNode* retainNode(RopeNode* node)
+{
+    node->refs.fetch_add(1, std::memory_order_relaxed);
+    return node;
+}
+
+static void releaseNode(RopeNode* node)
+{
+    if (node->refs.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+        return;
+    }
+    if (node->height == 0) {
+        leafAllocator().destroy(asLeaf(node));
+        return;
+    }
+    auto branch = asBranch(node);
+    for (uint32_t idx = 0; idx < branch->count; ++idx) {
+        releaseNode(branch->children[idx]);
+    }
+    branchAllocator().destroy(branch);
+}
+
+static inline bool isUnderfull(const RopeNode* node)
+{
+    if (node->height == 0) {
+        return asLeaf(node)->length < Rope::MinLeafLength;
+    }
+    return asBranch(node)->count < Rope::MinChildren;
+}
+
+static inline bool isHighSurrogate(char16_t ch)
+{
+    return ch >= 0xD800 && ch <= 0xDBFF;
+}
+
+static inline bool isLowSurrogate(char16_t ch)
+{
+    return ch >= 0xDC00 && ch <= 0xDFFF;
+}
+
+// moves a split point backwards so that surrogate pairs and CR+LF stay in the same leaf
+static inline std::size_t splitPoint(std::u16string_view text, std::size_t start, std::size_t pos)
+{
+    if (pos > start + 1 && pos < text.size()) {
+        const char16_t prev = text[pos - 1];
+        if (isHighSurrogate(prev) || (prev == 0x000D && text[pos] == 0x000A)) {
+            return pos - 1;
+        }
+    }
+    return pos;
+}
+
+static inline std::u16string_view leafText(const RopeLeaf* leaf)
+{
+    return std::u16string_view(leaf->text, leaf->length);
+}
+
+// isLineBreak without branches, so that counting them vectorizes
+static inline unsigned isLinebreakUnit(char16_t ch)
+{
+    return (static_cast<uint16_t>(ch - 0x000A) < 4) | (ch == 0x0085) | (static_cast<uint16_t>(ch - 0x2028) < 2);
+}
+
+// whether the code unit at idx is the last code unit of a line break
+static inline bool isLinebreakAt(const RopeLeaf* leaf, std::size_t idx)
+{
+    const char16_t ch = leaf->text[idx];
+    // the LF of a CR+LF is the line break
+    return isLinebreakUnit(ch) && (ch != 0x000D || idx + 1 == leaf->length || leaf->text[idx + 1] != 0x000A);
+}
+
+// the number of line breaks in [start, end) of the leaf text. edits count all
+// of the text after them again so this has to be quick
+static inline std::size_t countLinebreaks(const RopeLeaf* leaf, std::size_t start, std::size_t end)
+{
+    const char16_t* text = leaf->text;
+    // the last code unit of the leaf has nothing after it to pair up with
+    const std::size_t pairsEnd = std::max(start, std::min<std::size_t>(end, leaf->length > 0 ? leaf->length - 1 : 0));
+    unsigned num = 0;
+    for (std::size_t idx = start; idx < pairsEnd; ++idx) {
+        num += isLinebreakUnit(text[idx]) & !((text[idx] == 0x000D) & (text[idx + 1] == 0x000A));
+    }
+    for (std::size_t idx = pairsEnd; idx < end; ++idx) {
+        num += isLinebreakUnit(text[idx]);
+    }
+    return num;
+}
+
+// counts the line breaks of the blocks from block on
+static void scanLinebreaks(RopeLeaf* leaf, std::size_t block)
+{
+    const std::size_t size = leaf->length;
+    for (; block < RopeLeaf::LinebreakBlocks; ++block) {
+        const std::size_t start = std::min(size, block * RopeLeaf::LinebreakBlock);
+        const std::size_t end = std::min(size, start + RopeLeaf::LinebreakBlock);
+        leaf->linebreaks[block] = static_cast<uint8_t>(countLinebreaks(leaf, start, end));
+    }
+    std::size_t num = 0;
+    for (auto blockLinebreaks : leaf->linebreaks) {
+        num += blockLinebreaks;
+    }
+    leaf->numLinebreaks = static_cast<uint16_t>(num);
+}
+
+static inline void scanLinebreaks(RopeLeaf* leaf)
+{
+    scanLinebreaks(leaf, 0);
+}
+
+// calls func with the position of every line break in the leaf, in order
+template<typename Func>
+static inline void forEachLinebreak(const RopeLeaf* leaf, Func&& func)
+{
+    for (std::size_t block = 0; block < RopeLeaf::LinebreakBlocks; ++block) {
+        if (leaf->linebreaks[block] == 0) {
+            continue;
+        }
+        const std::size_t start = block * RopeLeaf::LinebreakBlock;
+        const std::size_t end = std::min<std::size_t>(leaf->length, start + RopeLeaf::LinebreakBlock);
+        for (std::size_t idx = start; idx < end; ++idx) {
+            if (isLinebreakAt(leaf, idx)) {
+                func(idx);
+            }
+        }
+    }
+}
+
+// the number of line breaks before offset
+static inline std::size_t linebreaksBefore(const RopeLeaf* leaf, std::size_t offset)
+{
+    std::size_t num = 0;
+    const std::size_t blocks = offset / RopeLeaf::LinebreakBlock;
+    for (std::size_t block = 0; block < blocks; ++block) {
+        num += leaf->linebreaks[block];
+    }
+    return num + countLinebreaks(leaf, blocks * RopeLeaf::LinebreakBlock, offset);
+}
+
+// the position of line break number n
+static inline std::size_t nthLinebreak(const RopeLeaf* leaf, std::size_t n)
+{
+    assert(n < leaf->numLinebreaks);
+    std::size_t block = 0;
+    while (n >= leaf->linebreaks[block]) {
+        n -= leaf->linebreaks[block++];
+    }
+    for (std::size_t idx = block * RopeLeaf::LinebreakBlock;; ++idx) {
+        if (isLinebreakAt(leaf, idx) && n-- == 0) {
+            return idx;
+        }
+    }
+}
+
+// updates the line breaks of leaf after its text changed at offset
+static void updateLinebreaks(RopeLeaf* leaf, std::size_t offset)
+{
+    // a CR right before the edit is only a line break if it's not followed by a LF.
+    // the text after the edit moved so every block from there on is counted again
+    const std::size_t start = offset > 0 ? offset - 1 : 0;
+    scanLinebreaks(leaf, start / RopeLeaf::LinebreakBlock);
+}
+
+static inline RopeLeaf* createLeaf(std::u16string_view text)
+{
+    assert(text.size() <= Rope::MaxLeafLength);
+    auto leaf = leafAllocator().create();
+    leaf->length = static_cast<uint16_t>(text.size());
+    memcpy(leaf->text, text.data(), text.size() * sizeof(char16_t));
+    scanLinebreaks(leaf);
+    return leaf;
+}
+
+static inline Rope::Summary leafSummary(const RopeLeaf* leaf)
+{
+    Rope::Summary summary;
+    summary.length = leaf->length;
+    summary.linebreaks = leaf->numLinebreaks;
+    summary.firstLf = leaf->length > 0 && leaf->text[0] == 0x000A;
+    summary.lastCr = leaf->length > 0 && leaf->text[leaf->length - 1] == 0x000D;
+    return summary;
+}
+
+// whether a CR+LF is split between child idx and child idx + 1
+static inline bool splitsCrLf(const RopeBranch* branch, uint32_t idx)
+{
+    return idx + 1 < branch->count && (branch->flags[idx] & RopeBranch::LastCr) && (branch->flags[idx + 1] & RopeBranch::FirstLf);
+}
+
+static inline Rope::Summary branchSummary(const RopeBranch* branch)
+{
+    Rope::Summary summary;
+    for (uint32_t idx = 0; idx < branch->count; ++idx) {
+        summary.length += branch->lengths[idx];
+        summary.linebreaks += branch->linebreaks[idx];
+        if (splitsCrLf(branch, idx)) {
+            --summary.linebreaks;
+        }
+    }
+    if (branch->count > 0) {
+        summary.firstLf = branch->flags[0] & RopeBranch::FirstLf;
+        summary.lastCr = branch->flags[branch->count - 1] & RopeBranch::LastCr;
+    }
+    return summary;
+}
+
+static inline Rope::Summary nodeSummary(const RopeNode* node)
+{
+    if (node->height == 0) {
+        return leafSummary(asLeaf(node));
+    }
+    return branchSummary(asBranch(node));
+}
+
+static inline void setChild(RopeBranch* branch, uint32_t idx, RopeNode* child)
+{
+    const auto summary = nodeSummary(child);
+    branch->children[idx] = child;
+    branch->lengths[idx] = summary.length;
+    branch->linebreaks[idx] = summary.linebreaks;
+    branch->flags[idx] = (summary.firstLf ? RopeBranch::FirstLf : 0) | (summary.lastCr ? RopeBranch::LastCr : 0);
+}
+
+static inline void refreshChild(RopeBranch* branch, uint32_t idx)
+{
+    setChild(branch, idx, branch->children[idx]);
+}
+
+// copies num child slots, dst and src may be the same branch
+static inline void copyChildren(RopeBranch* dst, uint32_t dstIdx, const RopeBranch* src, uint32_t srcIdx, uint32_t num)
+{
+    if (num == 0) {
+        return;
+    }
+    memmove(dst->children + dstIdx, src->children + srcIdx, num * sizeof(RopeNode*));
+    memmove(dst->lengths + dstIdx, src->lengths + srcIdx, num * sizeof(std::size_t));
+    memmove(dst->linebreaks + dstIdx, src->linebreaks + srcIdx, num * sizeof(std::size_t));
+    memmove(dst->flags + dstIdx, src->flags + srcIdx, num * sizeof(uint8_t));
+}
+
+static inline void insertChild(RopeBranch* branch, uint32_t idx, RopeNode* child)
+{
+    assert(branch->count < Rope::MaxChildren && idx <= branch->count);
+    copyChildren(branch, idx + 1, branch, idx, branch->count - idx);
+    ++branch->count;
+    setChild(branch, idx, child);
+}
+
+static inline void eraseChild(RopeBranch* branch, uint32_t idx)
+{
+    assert(idx < branch->count);
+    copyChildren(branch, idx, branch, idx + 1, branch->count - idx - 1);
+    --branch->count;
+}
+
+// returns node if it's only referenced once, otherwise a copy of it that
+// shares its children. the reference to node is handed over to the copy
+static RopeNode* uniqueNode(RopeNode* node)
+{
+    if (node->refs.load(std::memory_order_acquire) == 1) {
+        return node;
+    }
+    RopeNode* copy;
+    if (node->height == 0) {
+        auto src = asLeaf(node);
+        auto leaf = leafAllocator().create();
+        leaf->length = src->length;
+        leaf->numLinebreaks = src->numLinebreaks;
+        memcpy(leaf->linebreaks, src->linebreaks, sizeof(leaf->linebreaks));
+        memcpy(leaf->text, src->text, src->length * sizeof(char16_t));
+        copy = leaf;
+    } else {
+        auto src = asBranch(node);
+        auto branch = branchAllocator().create();
+        branch->height = src->height;
+        branch->count = src->count;
+        copyChildren(branch, 0, src, 0, src->count);
+        for (uint32_t idx = 0; idx < branch->count; ++idx) {
+            retainNode(branch->children[idx]);
+        }
+        copy = branch;
+    }
+    releaseNode(node);
+    return copy;
+}
+
+// makes child idx of branch safe to modify
+static inline RopeNode* uniqueChild(RopeBranch* branch, uint32_t idx)
+{
+    branch->children[idx] = uniqueNode(branch->children[idx]);
+    return branch->children[idx];
+}
+
+static inline RopeBranch* createBranch(uint32_t height)
+{
+    auto branch = branchAllocator().create();
+    branch->height = height;
+    return branch;
+}
+
+// finds the child that contains offset and makes offset relative to it.
+// an offset between two children goes in the second one
+static inline uint32_t childForOffset(const RopeBranch* branch, std::size_t& offset)
+{
+    uint32_t idx = 0;
+    while (idx + 1 < branch->count && offset >= branch->lengths[idx]) {
+        offset -= branch->lengths[idx];
+        ++idx;
+    }
+    return idx;
+}
+
+// whether the code unit after child idx is a LF, nextLf is the same for the branch itself
+static inline bool childNextLf(const RopeBranch* branch, uint32_t idx, bool nextLf)
+{
+    return idx + 1 < branch->count ? (branch->flags[idx + 1] & RopeBranch::FirstLf) : nextLf;
+}
+
+// whether the code unit before child idx is a CR, prevCr is the same for the branch itself
+static inline bool childPrevCr(const RopeBranch* branch, uint32_t idx, bool prevCr)
+{
+    return idx > 0 ? (branch->flags[idx - 1] & RopeBranch::LastCr) : prevCr;
+}
+
+// the line breaks of child idx, not counting a CR that pairs up with a LF after it
+static inline std::size_t childLinebreaks(const RopeBranch* branch, uint32_t idx, bool nextLf)
+{
+    const bool paired = childNextLf(branch, idx, nextLf) && (branch->flags[idx] & RopeBranch::LastCr);
+    return branch->linebreaks[idx] - (paired ? 1 : 0);
+}
+
+static std::vector<RopeNode*> buildLeaves(std::u16string_view text)
+{
+    std::vector<RopeNode*> leaves;
+    if (text.empty()) {
+        return leaves;
+    }
+    // leaves have a fixed capacity, fill them up as much as possible
+    std::size_t num = (text.size() + Rope::MaxLeafLength - 1) / Rope::MaxLeafLength;
+    leaves.reserve(num);
+    std::size_t pos = 0;
+    for (std::size_t n = 0; n < num; ++n) {
+        std::size_t end = text.size();
+        if (n + 1 < num) {
+            end = splitPoint(text, pos, pos + (text.size() - pos) / (num - n));
+            if (text.size() - end > (num - n - 1) * Rope::MaxLeafLength) {
+                // moving the split point back left too much for the remaining leaves
+                ++num;
+            }
+        }
+        leaves.push_back(createLeaf(text.substr(pos, end - pos)));
+        pos = end;
+    }
+    return leaves;
+}
+
+static RopeNode* buildTree(std::vector<RopeNode*>&& nodes)
+{
+    while (nodes.size() > 1) {
+        const std::size_t numParents = (nodes.size() + Rope::MaxChildren - 1) / Rope::MaxChildren;
+        std::vector<RopeNode*> parents;
+        parents.reserve(numParents);
+        std::size_t pos = 0;
+        for (std::size_t p = 0; p < numParents; ++p) {
+            // spread the children evenly so no parent ends up underfull
+            const std::size_t num = (nodes.size() - pos) / (numParents - p);
+            auto branch = createBranch(nodes[pos]->height + 1);
+            for (std::size_t n = 0; n < num; ++n) {
+                insertChild(branch, branch->count, nodes[pos++]);
+            }
+            parents.push_back(branch);
+        }
+        nodes = std::move(parents);
+    }
+    return nodes.empty() ? nullptr : nodes.front();
+}
+
+// adds a reference to all leaves under node to leaves
+static void collectLeaves(RopeNode* node, std::vector<RopeNode*>& leaves)
+{
+    if (node->height == 0) {
+        leaves.push_back(retainNode(node));
+        return;
+    }
+    auto branch = asBranch(node);
+    for (uint32_t idx = 0; idx < branch->count; ++idx) {
+        collectLeaves(branch->children[idx], leaves);
+    }
+}
+
+// inserts text, which must fit in a leaf, at offset. node must be unique.
+// returns a new sibling to go after node if node had to be split
+static RopeNode* insertText(RopeNode* node, std::size_t offset, std::u16string_view text)
+{
+    if (node->height == 0) {
+        auto leaf = asLeaf(node);
+        const std::size_t length = leaf->length + text.size();
+        if (length <= Rope::MaxLeafLength) {
+            memmove(leaf->text + offset + text.size(), leaf->text + offset, (leaf->length - offset) * sizeof(char16_t));
+            memcpy(leaf->text + offset, text.data(), text.size() * sizeof(char16_t));
+            leaf->length = static_cast<uint16_t>(length);
+            updateLinebreaks(leaf, offset);
+            return nullptr;
+        }
+        char16_t combined[Rope::MaxLeafLength * 2];
+        memcpy(combined, leaf->text, offset * sizeof(char16_t));
+        memcpy(combined + offset, text.data(), text.size() * sizeof(char16_t));
+        memcpy(combined + offset + text.size(), leaf->text + offset, (leaf->length - offset) * sizeof(char16_t));
+        const std::u16string_view all(combined, length);
+        const std::size_t mid = splitPoint(all, 0, length / 2);
+        auto sibling = createLeaf(all.substr(mid));
+        memcpy(leaf->text, combined, mid * sizeof(char16_t));
+        leaf->length = static_cast<uint16_t>(mid);
+        scanLinebreaks(leaf);
+        return sibling;
+    }
+
+    auto branch = asBranch(node);
+    const uint32_t idx = childForOffset(branch, offset);
+    auto split = insertText(uniqueChild(branch, idx), offset, text);
+    refreshChild(branch, idx);
+    if (split == nullptr) {
+        return nullptr;
+    }
+    if (branch->count < Rope::MaxChildren) {
+        insertChild(branch, idx + 1, split);
+        return nullptr;
+    }
+    // split this branch in two
+    constexpr uint32_t half = Rope::MaxChildren / 2;
+    auto sibling = createBranch(branch->height);
+    copyChildren(sibling, 0, branch, half, branch->count - half);
+    sibling->count = branch->count - half;
+    branch->count = half;
+    if (idx + 1 <= half) {
+        insertChild(branch, idx + 1, split);
+    } else {
+        insertChild(sibling, idx + 1 - half, split);
+    }
+    return sibling;
+}
+
+// appends leaf after the last leaf under node, node must be unique.
+// returns a new sibling to go after node if node was full
+static RopeNode* appendLeaf(RopeNode* node, RopeLeaf* leaf)
+{
+    auto branch = asBranch(node);
+    RopeNode* child = leaf;
+    if (branch->height > 1) {
+        child = appendLeaf(uniqueChild(branch, branch->count - 1), leaf);
+        refreshChild(branch, branch->count - 1);
+        if (child == nullptr) {
+            return nullptr;
+        }
+    }
+    if (branch->count < Rope::MaxChildren) {
+        insertChild(branch, branch->count, child);
+        return nullptr;
+    }
+    // keep this one full and start a new one, appends tend to come in batches
+    auto sibling = createBranch(branch->height);
+    insertChild(sibling, 0, child);
+    return sibling;
+}
+
+// merges child idx and idx + 1 if they fit in one node, otherwise spreads
+// their contents evenly between them. returns true if they were merged
+static bool mergeChildren(RopeBranch* branch, uint32_t idx)
+{
+    assert(idx + 1 < branch->count);
+    RopeNode* left = uniqueChild(branch, idx);
+    RopeNode* right = uniqueChild(branch, idx + 1);
+    assert(left->height == right->height);
+    if (left->height == 0) {
+        auto l = asLeaf(left);
+        auto r = asLeaf(right);
+        const std::size_t length = l->length + r->length;
+        if (length <= Rope::MaxLeafLength) {
+            memcpy(l->text + l->length, r->text, r->length * sizeof(char16_t));
+            l->length = static_cast<uint16_t>(length);
+            scanLinebreaks(l);
+            leafAllocator().destroy(r);
+            eraseChild(branch, idx + 1);
+            refreshChild(branch, idx);
+            return true;
+        }
+        char16_t combined[Rope::MaxLeafLength * 2];
+        memcpy(combined, l->text, l->length * sizeof(char16_t));
+        memcpy(combined + l->length, r->text, r->length * sizeof(char16_t));
+        const std::size_t mid = splitPoint(std::u16string_view(combined, length), 0, length / 2);
+        memcpy(l->text, combined, mid * sizeof(char16_t));
+        l->length = static_cast<uint16_t>(mid);
+        memcpy(r->text, combined + mid, (length - mid) * sizeof(char16_t));
+        r->length = static_cast<uint16_t>(length - mid);
+        scanLinebreaks(l);
+        scanLinebreaks(r);
+    } else {
+        auto l = asBranch(left);
+        auto r = asBranch(right);
+        if (l->count + r->count <= Rope::MaxChildren) {
+            copyChildren(l, l->count, r, 0, r->count);
+            l->count += r->count;
+            branchAllocator().destroy(r);
+            eraseChild(branch, idx + 1);
+            refreshChild(branch, idx);
+            return true;
+        }
+        const uint32_t target = (l->count + r->count) / 2;
+        if (l->count < target) {
+            const uint32_t num = target - l->count;
+            copyChildren(l, l->count, r, 0, num);
+            l->count += num;
+            copyChildren(r, 0, r, num, r->count - num);
+            r->count -= num;
+        } else {
+            const uint32_t num = l->count - target;
+            copyChildren(r, num, r, 0, r->count);
+            copyChildren(r, 0, l, target, num);
+            r->count += num;
+            l->count = target;
+        }
+    }
+    refreshChild(branch, idx);
+    refreshChild(branch, idx + 1);
+    return false;
+}
+
+static void rebalanceChildren(RopeBranch* branch)
+{
+    uint32_t idx = 0;
+    while (idx < branch->count && branch->count > 1) {
+        if (!isUnderfull(branch->children[idx])) {
+            ++idx;
+            continue;
+        }
+        const uint32_t left = idx + 1 < branch->count ? idx : idx - 1;
+        if (mergeChildren(branch, left)) {
+            // the merged node might still be underfull
+            idx = left;
+        } else {
+            idx = left + 2;
+        }
+    }
+}
+
+// removes [offset, offset + length) from node, which must be unique. children that end up empty are removed
+static void removeText(RopeNode* node, std::size_t offset, std::size_t length)
+{
+    if (node->height == 0) {
+        auto leaf = asLeaf(node);
+        memmove(leaf->text + offset, leaf->text + offset + length, (leaf->length - offset - length) * sizeof(char16_t));
+        leaf->length = static_cast<uint16_t>(leaf->length - length);
+        updateLinebreaks(leaf, offset);
+        return;
+    }
+
+    auto branch = asBranch(node);
+    uint32_t idx = childForOffset(branch, offset);
+    while (length > 0) {
+        assert(idx < branch->count);
+        const std::size_t childLength = branch->lengths[idx];
+        const std::size_t num = std::min(length, childLength - offset);
+        if (offset == 0 && num == childLength) {
+            releaseNode(branch->children[idx]);
+            eraseChild(branch, idx);
+        } else {
+            removeText(uniqueChild(branch, idx), offset, num);
+            refreshChild(branch, idx);
+            if (branch->lengths[idx] == 0) {
+                releaseNode(branch->children[idx]);
+                eraseChild(branch, idx);
+            } else {
+                ++idx;
+            }
+        }
+        length -= num;
+        offset = 0;
+    }
+    rebalanceChildren(branch);
+}
+
+static void appendLinebreaks(const RopeNode* node, std::size_t base, bool prevCr, bool nextLf, std::vector<Linebreak>& out)
+{
+    if (node->height == 0) {
+        auto leaf = asLeaf(node);
+        const char16_t* text = leaf->text;
+        forEachLinebreak(leaf, [&](std::size_t pos) {
+            const char16_t ch = text[pos];
+            if (ch == 0x000D && pos + 1u == leaf->length && nextLf) {
+                // reported with the LF in the next leaf
+                return;
+            }
+            const bool crlf = ch == 0x000A && (pos > 0 ? text[pos - 1] == 0x000D : prevCr);
+            out.push_back(std::make_pair(base + pos, crlf ? static_cast<char32_t>(0x000D) : static_cast<char32_t>(ch)));
+        });
+        return;
+    }
+    auto branch = asBranch(node);
+    for (uint32_t idx = 0; idx < branch->count; ++idx) {
+        appendLinebreaks(branch->children[idx], base, childPrevCr(branch, idx, prevCr), childNextLf(branch, idx, nextLf), out);
+        base += branch->lengths[idx];
+    }
+}
+
+Rope::Rope()
+{
+}
+
+Rope::Rope(std::u16string_view text)
+    : mRoot(buildTree(buildLeaves(text)))
+{
+}
+
+Rope::Rope(const Rope& other)
+    : mRoot(other.mRoot ? retainNode(other.mRoot) : nullptr)
+{
+}
+
+Rope::Rope(Rope&& other)
+    : mRoot(std::exchange(other.mRoot, nullptr))
+{
+}
+
+Rope::~Rope()
+{
+    clear();
+}
+
+Rope& Rope::operator=(const Rope& other)
+{
+    if (this != &other) {
+        // retain first in case other shares our root
+        RopeNode* root = other.mRoot ? retainNode(other.mRoot) : nullptr;
+        clear();
+        mRoot = root;
+    }
+    return *this;
+}
+
+Rope& Rope::operator=(Rope&& other)
+{
+    if (this != &other) {
+        clear();
+        mRoot = std::exchange(other.mRoot, nullptr);
+    }
+    return *this;
+}
+
+void Rope::clear()
+{
+    if (mRoot) {
+        releaseNode(mRoot);
+        mRoot = nullptr;
+    }
+}
+
+Rope::Summary Rope::summary() const
+{
+    if (!mRoot) {
+        return {};
+    }
+    return nodeSummary(mRoot);
+}
+
+Rope::MemoryStats Rope::memoryStats()
+{
+    const auto leaves = leafAllocator().stats();
+    const auto branches = branchAllocator().stats();
+    return { leaves.objects, branches.objects, leaves.bytes + branches.bytes };
+}
+
+char16_t Rope::at(std::size_t offset) const
+{
+    assert(offset < length());
+    const RopeNode* node = mRoot;
+    while (node->height > 0) {
+        auto branch = asBranch(node);
+        node = branch->children[childForOffset(branch, offset)];
+    }
+    return asLeaf(node)->text[offset];
+}
+
+std::u16string Rope::toString() const
+{
+    return substring(0, length());
+}
+
+std::u16string Rope::substring(std::size_t start, std::size_t len) const
+{
+    const std::size_t size = length();
+    if (start >= size || len == 0) {
+        return {};
+    }
+    const std::size_t end = start + std::min(len, size - start);
+    std::u16string out;
+    out.reserve(end - start);
+    for (ChunkIterator it(*this, start); it.isValid() && it.offset() < end; it.next()) {
+        const auto chunk = it.chunk();
+        const std::size_t from = start > it.offset() ? start - it.offset() : 0;
+        out.append(chunk.substr(from, std::min(chunk.size(), end - it.offset()) - from));
+    }
+    return out;
+}
+
+std::size_t Rope::lineForOffset(std::size_t offset) const
+{
+    if (!mRoot) {
+        return 0;
+    }
+    if (offset >= length()) {
+        return numLinebreaks();
+    }
+    std::size_t line = 0;
+    bool nextLf = false;
+    const RopeNode* node = mRoot;
+    while (node->height > 0) {
+        auto branch = asBranch(node);
+        uint32_t idx = 0;
+        while (offset >= branch->lengths[idx]) {
+            line += childLinebreaks(branch, idx, nextLf);
+            offset -= branch->lengths[idx];
+            ++idx;
+        }
+        nextLf = childNextLf(branch, idx, nextLf);
+        node = branch->children[idx];
+    }
+    // offset is inside the leaf so a CR at the very end can't be before it
+    return line + linebreaksBefore(asLeaf(node), offset);
+}
+
+std::size_t Rope::offsetForLine(std::size_t line) const
+{
+    if (line == 0) {
+        return 0;
+    }
+    if (!mRoot || line > numLinebreaks()) {
+        return length();
+    }
+    // find line break number <line - 1>
+    std::size_t remaining = line - 1;
+    std::size_t offset = 0;
+    bool nextLf = false;
+    const RopeNode* node = mRoot;
+    while (node->height > 0) {
+        auto branch = asBranch(node);
+        uint32_t idx = 0;
+        for (;;) {
+            assert(idx < branch->count);
+            const std::size_t breaks = childLinebreaks(branch, idx, nextLf);
+            if (remaining < breaks) {
+                break;
+            }
+            remaining -= breaks;
+            offset += branch->lengths[idx];
+            ++idx;
+        }
+        nextLf = childNextLf(branch, idx, nextLf);
+        node = branch->children[idx];
+    }
+    return offset + nthLinebreak(asLeaf(node), remaining) + 1;
+}
+
+std::vector<Linebreak> Rope::linebreaks() const
+{
+    std::vector<Linebreak> out;
+    if (mRoot) {
+        out.reserve(numLinebreaks());
+        appendLinebreaks(mRoot, 0, false, false, out);
+    }
+    return out;
+}
+
+void Rope::insert(std::size_t offset, std::u16string_view text)
+{
+    assert(offset <= length());
+    if (text.empty()) {
+        return;
+    }
+    if (!mRoot) {
+        mRoot = buildTree(buildLeaves(text));
+        return;
+    }
+    // insert big texts in pieces so that a leaf never has to be split in more than two
+    constexpr std::size_t pieceSize = MaxLeafLength / 2;
+    std::size_t pos = 0;
+    while (pos < text.size()) {
+        const std::size_t end = splitPoint(text, pos, std::min(text.size(), pos + pieceSize));
+        mRoot = uniqueNode(mRoot);
+        auto split = insertText(mRoot, offset + pos, text.substr(pos, end - pos));
+        if (split) {
+            auto root = createBranch(mRoot->height + 1);
+            insertChild(root, 0, mRoot);
+            insertChild(root, 1, split);
+            mRoot = root;
+        }
+        pos = end;
+    }
+}
+
+void Rope::append(std::u16string_view text)
+{
+    insert(length(), text);
+}
+
+void Rope::append(Rope&& rope)
+{
+    if (!rope.mRoot) {
+        return;
+    }
+    if (!mRoot) {
+        mRoot = std::exchange(rope.mRoot, nullptr);
+        return;
+    }
+    // the leaves don't have to be unique, they're not modified
+    std::vector<RopeNode*> leaves;
+    collectLeaves(rope.mRoot, leaves);
+    rope.clear();
+
+    auto it = leaves.begin();
+    if (mRoot->height == 0) {
+        // make room for siblings
+        auto root = createBranch(1);
+        insertChild(root, 0, mRoot);
+        mRoot = root;
+    }
+    // don't leave a small leaf at the seam
+    auto first = asLeaf(*it);
+    if (first->length < MinLeafLength) {
+        insert(length(), leafText(first));
+        releaseNode(first);
+        ++it;
+    }
+    while (it != leaves.end()) {
+        mRoot = uniqueNode(mRoot);
+        auto split = appendLeaf(mRoot, asLeaf(*it));
+        if (split) {
+            auto root = createBranch(mRoot->height + 1);
+            insertChild(root, 0, mRoot);
+            insertChild(root, 1, split);
+            mRoot = root;
+        }
+        ++it;
+    }
+}
+
+void Rope::remove(std::size_t offset, std::size_t len)
+{
+    const std::size_t size = length();
+    assert(offset <= size);
+    len = std::min(len, size - offset);
+    if (len == 0) {
+        return;
+    }
+    if (offset == 0 && len == size) {
+        clear();
+        return;
+    }
+    mRoot = uniqueNode(mRoot);
+    removeText(mRoot, offset, len);
+    // get rid of branches with a single child at the top
+    while (mRoot->height > 0 && asBranch(mRoot)->count == 1) {
+        auto root = asBranch(mRoot);
+        mRoot = retainNode(root->children[0]);
+        releaseNode(root);
+    }
+}
+
+Rope::Builder::~Builder()
+{
+    for (auto leaf : mLeaves) {
+        releaseNode(leaf);
+    }
+    if (mLeaf) {
+        releaseNode(mLeaf);
+    }
+}
+
+// a leaf with less room than this left is closed, smaller writes aren't worth it
+static constexpr std::size_t BuilderMinRoom = Rope::MaxLeafLength / 16;
+
+char16_t* Rope::Builder::leaf()
+{
+    if (!mLeaf) {
+        mLeaf = leafAllocator().create();
+        asLeaf(mLeaf)->length = 0;
+    }
+    auto leaf = asLeaf(mLeaf);
+    return leaf->text + leaf->length;
+}
+
+std::size_t Rope::Builder::room() const
+{
+    return MaxLeafLength - (mLeaf ? asLeaf(mLeaf)->length : 0);
+}
+
+void Rope::Builder::commit(std::size_t length)
+{
+    assert(mLeaf && length <= room());
+    auto leaf = asLeaf(mLeaf);
+    leaf->length = static_cast<uint16_t>(leaf->length + length);
+    if (room() < BuilderMinRoom) {
+        closeLeaf();
+    }
+}
+
+void Rope::Builder::closeLeaf()
+{
+    auto leaf = asLeaf(mLeaf);
+    const std::size_t length = leaf->length;
+    if (length == 0) {
+        return;
+    }
+    if (!mLeaves.empty() && (length < MinLeafLength || asLeaf(mLeaves.back())->length < MinLeafLength)) {
+        // even out a small leaf with the one before it so that the tree is built from full leaves
+        auto prev = asLeaf(mLeaves.back());
+        const std::size_t total = prev->length + leaf->length;
+        if (total <= MaxLeafLength) {
+            memcpy(prev->text + prev->length, leaf->text, leaf->length * sizeof(char16_t));
+            prev->length = static_cast<uint16_t>(total);
+            scanLinebreaks(prev);
+            // the leaf can be written to again
+            leaf->length = 0;
+            return;
+        }
+        char16_t text[MaxLeafLength * 2];
+        memcpy(text, prev->text, prev->length * sizeof(char16_t));
+        memcpy(text + prev->length, leaf->text, leaf->length * sizeof(char16_t));
+        const std::size_t split = splitPoint(std::u16string_view(text, total), 0, total / 2);
+        prev->length = static_cast<uint16_t>(split);
+        leaf->length = static_cast<uint16_t>(total - split);
+        memcpy(prev->text, text, split * sizeof(char16_t));
+        memcpy(leaf->text, text + split, (total - split) * sizeof(char16_t));
+        scanLinebreaks(prev);
+    }
+    scanLinebreaks(leaf);
+    mLeaves.push_back(std::exchange(mLeaf, nullptr));
+}
+
+Rope Rope::Builder::build()
+{
+    if (mLeaf) {
+        closeLeaf();
+    }
+    Rope rope;
+    rope.mRoot = buildTree(std::move(mLeaves));
+    mLeaves.clear();
+    return rope;
+}
+
+Rope::ChunkIterator::ChunkIterator(const Rope& rope, std::size_t offset)
+    : mRope(rope)
+{
+    if (!mRope.mRoot) {
+        return;
+    }
+    const std::size_t size = mRope.length();
+    const bool atEnd = offset >= size;
+    std::size_t remaining = atEnd ? size - 1 : offset;
+    const RopeNode* node = mRope.mRoot;
+    while (node->height > 0) {
+        assert(mDepth < MaxHeight);
+        auto branch = asBranch(node);
+        const uint32_t idx = childForOffset(branch, remaining);
+        mPath[mDepth++] = { node, idx };
+        node = branch->children[idx];
+    }
+    mChunk = leafText(asLeaf(node));
+    if (atEnd) {
+        // the path stays at the last chunk so previous() can go back to it
+        mOffset = size;
+    } else {
+        mOffset = offset - remaining;
+        mValid = true;
+    }
+}
+
+// descends from the current child at level down to its first or last leaf
+void Rope::ChunkIterator::enter(uint32_t level, bool first)
+{
+    const RopeNode* node = asBranch(mPath[level].node)->children[mPath[level].idx];
+    while (node->height > 0) {
+        auto branch = asBranch(node);
+        const uint32_t idx = first ? 0 : branch->count - 1;
+        mPath[++level] = { node, idx };
+        node = branch->children[idx];
+    }
+    mChunk = leafText(asLeaf(node));
+}
+
+bool Rope::ChunkIterator::next()
+{
+    if (!mValid) {
+        // before the first chunk
+        if (mRope.mRoot && mOffset == 0) {
+            mValid = true;
+            return true;
+        }
+        return false;
+    }
+    mOffset += mChunk.size();
+    for (uint32_t level = mDepth; level > 0; --level) {
+        auto& current = mPath[level - 1];
+        if (current.idx + 1 < asBranch(current.node)->count) {
+            ++current.idx;
+            enter(level - 1, true);
+            return true;
+        }
+    }
+    // the path still points to the last chunk
+    mValid = false;
+    return false;
+}
+
+bool Rope::ChunkIterator::previous()
+{
+    if (!mValid) {
+        // after the last chunk
+        if (mRope.mRoot && mOffset > 0) {
+            mOffset -= mChunk.size();
+            mValid = true;
+            return true;
+        }
+        return false;
+    }
+    for (uint32_t level = mDepth; level > 0; --level) {
+        auto& current = mPath[level - 1];
+        if (current.idx > 0) {
+            --current.idx;
+            enter(level - 1, false);
+            mOffset -= mChunk.size();
+            return true;
+        }
+    }
+    mOffset = 0;
+    mValid = false;
+    return false;
+}
+
+Rope::CodePointIterator::CodePointIterator(const Rope& rope, std::size_t offset)
+    : mChunks(rope, offset)
+{
+    if (mChunks.isValid()) {
+        mPos = offset - mChunks.offset();
+        alignToCodePoint();
+        decode();
+    }
+}
+
+// moves back to the high surrogate if positioned on the low surrogate of a pair
+void Rope::CodePointIterator::alignToCodePoint()
+{
+    const auto chunk = mChunks.chunk();
+    if (!isLowSurrogate(chunk[mPos])) {
+        return;
+    }
+    if (mPos > 0) {
+        if (isHighSurrogate(chunk[mPos - 1])) {
+            --mPos;
+        }
+        return;
+    }
+    // the pair might be split between two chunks
+    ChunkIterator prev = mChunks;
+    if (prev.previous() && isHighSurrogate(prev.chunk().back())) {
+        mChunks = std::move(prev);
+        mPos = mChunks.chunk().size() - 1;
+    }
+}
+
+void Rope::CodePointIterator::decode()
+{
+    const auto chunk = mChunks.chunk();
+    const char16_t ch = chunk[mPos];
+    mCodePoint = ch;
+    mSize = 1;
+    if (!isHighSurrogate(ch)) {
+        return;
+    }
+    char16_t low = 0;
+    if (mPos + 1 < chunk.size()) {
+        low = chunk[mPos + 1];
+    } else {
+        ChunkIterator next = mChunks;
+        if (next.next()) {
+            low = next.chunk().front();
+        }
+    }
+    if (isLowSurrogate(low)) {
+        mCodePoint = 0x10000 + ((static_cast<char32_t>(ch) - 0xD800) << 10) + (static_cast<char32_t>(low) - 0xDC00);
+        mSize = 2;
+    }
+}
+
+bool Rope::CodePointIterator::next()
+{
+    if (!mChunks.isValid()) {
+        // before the first code point
+        if (!mChunks.next()) {
+            return false;
+        }
+        mPos = 0;
+        decode();
+        return true;
+    }
+    mPos += mSize;
+    while (mPos >= mChunks.chunk().size()) {
+        mPos -= mChunks.chunk().size();
+        if (!mChunks.next()) {
+            mPos = 0;
+            return false;
+        }
+    }
+    decode();
+    return true;
+}
+
+bool Rope::CodePointIterator::previous()
+{
+    if (!mChunks.isValid()) {
+        // after the last code point
+        if (!mChunks.previous()) {
+            return false;
+        }
+        mPos = mChunks.chunk().size();
+    }
+    while (mPos == 0) {
+        if (!mChunks.previous()) {
+            return false;
+        }
+        mPos = mChunks.chunk().size();
+    }
+    --mPos;
+    alignToCodePoint();
+    decode();
+    return true;
+}
@@ -0,0 +1,244 @@
+#pragma once
+
+#include <Unicode.h>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+namespace spurv {
+
+struct RopeNode;
+
+/*
+   Rope is a B-tree of utf-16 text. Leaves hold up to MaxLeafLength code units
+   and the number of line breaks in each block of 64 of them inline, internal
+   nodes hold up to MaxChildren children and keep the length and line break
+   count of each of them in flat arrays. This means that the length, the number of lines and offset <-> line
+   lookups never have to look at more than one path from the root to a leaf.
+   Both kinds of nodes have a fixed size and are allocated from slabs.
+
+   A CR+LF sequence is a single line break, positioned at the LF. Since the CR
+   and the LF might end up in different leaves every node also knows whether
+   it starts with a LF and whether it ends with a CR.
+
+   Nodes are reference counted and shared between copies, copying a rope is
+   O(1). A node is only modified in place while a single rope references it,
+   otherwise the path down to the edit is copied first. This makes a copy an
+   immutable snapshot that can be read on another thread while the original
+   keeps being edited, as long as each Rope object is only used by one thread.
+*/
+
+class Rope
+{
+public:
+    Rope();
+    Rope(std::u16string_view text);
+    Rope(const Rope& other);
+    Rope(Rope&& other);
+    ~Rope();
+
+    Rope& operator=(const Rope& other);
+    Rope& operator=(Rope&& other);
+
+    struct Summary
+    {
+        std::size_t length = 0;
+        std::size_t linebreaks = 0;
+        bool firstLf = false;
+        bool lastCr = false;
+    };
+    Summary summary() const;
+
+    bool empty() const;
+    std::size_t length() const;
+    std::size_t numLinebreaks() const;
+    std::size_t numLines() const;
+
+    char16_t at(std::size_t offset) const;
+    std::u16string toString() const;
+    std::u16string substring(std::size_t start, std::size_t length) const;
+
+    // the line that offset is on, a line break belongs to the line it ends
+    std::size_t lineForOffset(std::size_t offset) const;
+    // the offset where line starts, the length of the rope if there's no such line
+    std::size_t offsetForLine(std::size_t line) const;
+
+    // all line breaks, positioned at their last code unit. a CR+LF is reported as 0x0D.
+    // this is O(n), prefer the lookups above
+    std::vector<Linebreak> linebreaks() const;
+
+    void insert(std::size_t offset, std::u16string_view text);
+    void append(std::u16string_view text);
+    void append(Rope&& rope);
+    void remove(std::size_t offset, std::size_t length);
+    void clear();
+
+    // memory used by the nodes of all ropes
+    struct MemoryStats
+    {
+        std::size_t leaves = 0, branches = 0;
+        std::size_t bytes = 0;
+    };
+    static MemoryStats memoryStats();
+
+    static constexpr std::size_t MaxChildren = 16;
+    static constexpr std::size_t MinChildren = MaxChildren / 4;
+    static constexpr std::size_t MaxLeafLength = 2048;
+    static constexpr std::size_t MinLeafLength = MaxLeafLength / 4;
+    // way more than any rope that fits in memory needs
+    static constexpr std::size_t MaxHeight = 24;
+
+    class Builder;
+    class ChunkIterator;
+    class CodePointIterator;
+
+private:
+    RopeNode* mRoot = nullptr;
+};
+
+// builds a rope a leaf at a time, text is written straight into the
+// leaves so it doesn't have to be copied into them afterwards
+class Rope::Builder
+{
+public:
+    Builder() = default;
+    ~Builder();
+
+    // where the next code units go in the current leaf, there's room() for them.
+    // commit how many were written, a leaf is closed once it's nearly full
+    char16_t* leaf();
+    std::size_t room() const;
+    void commit(std::size_t length);
+
+    // the rope of the committed leaves, the builder is empty after this
+    Rope build();
+
+private:
+    Builder(const Builder&) = delete;
+    Builder& operator=(const Builder&) = delete;
+
+    void closeLeaf();
+
+    std::vector<RopeNode*> mLeaves;
+    RopeNode* mLeaf = nullptr;
+};
+
+// walks the leaves of a rope in order, each step is amortized O(1).
+// the iterator keeps a snapshot of the rope so the rope itself can
+// be modified or destroyed while iterating
+class Rope::ChunkIterator
+{
+public:
+    ChunkIterator() = default;
+    // positions the iterator at the chunk containing offset, an offset
+    // at or past the end positions it after the last chunk
+    explicit ChunkIterator(const Rope& rope, std::size_t offset = 0);
+
+    bool isValid() const;
+    std::u16string_view chunk() const;
+    // the offset of the first code unit of the chunk in the rope, or
+    // of where the iterator is when it's not valid
+    std::size_t offset() const;
+
+    // return false when moving after the last or before the first
+    // chunk, moving back from there makes the iterator valid again
+    bool next();
+    bool previous();
+
+private:
+    void enter(uint32_t level, bool first);
+
+    struct Level
+    {
+        const RopeNode* node;
+        uint32_t idx;
+    };
+
+    Rope mRope;
+    Level mPath[MaxHeight];
+    uint32_t mDepth = 0;
+    std::u16string_view mChunk;
+    std::size_t mOffset = 0;
+    bool mValid = false;
+};
+
+// walks the code points of a rope, a surrogate pair is only combined
+// if both halves are there. same snapshot semantics as ChunkIterator
+class Rope::CodePointIterator
+{
+public:
+    CodePointIterator() = default;
+    // positions the iterator at the code point containing offset
+    explicit CodePointIterator(const Rope& rope, std::size_t offset = 0);
+
+    bool isValid() const;
+    char32_t codePoint() const;
+    // the offset of the first code unit of the code point in the rope
+    std::size_t offset() const;
+
+    bool next();
+    bool previous();
+
+private:
+    void decode();
+    void alignToCodePoint();
+
+    ChunkIterator mChunks;
+    std::size_t mPos = 0;
+    char32_t mCodePoint = 0;
+    uint32_t mSize = 0;
+};
+
+inline bool Rope::empty() const
+{
+    return mRoot == nullptr;
+}
+
+inline std::size_t Rope::length() const
+{
+    return summary().length;
+}
+
+inline std::size_t Rope::numLinebreaks() const
+{
+    return summary().linebreaks;
+}
+
+inline std::size_t Rope::numLines() const
+{
+    return summary().linebreaks + 1;
+}
+
+inline bool Rope::ChunkIterator::isValid() const
+{
+    return mValid;
+}
+
+inline std::u16string_view Rope::ChunkIterator::chunk() const
+{
+    return mValid ? mChunk : std::u16string_view();
+}
+
+inline std::size_t Rope::ChunkIterator::offset() const
+{
+    return mOffset;
+}
+
+inline bool Rope::CodePointIterator::isValid() const
+{
+    return mChunks.isValid();
+}
+
+inline char32_t Rope::CodePointIterator::codePoint() const
+{
+    return mCodePoint;
+}
+
+inline std::size_t Rope::CodePointIterator::offset() const
+{
+    return mChunks.offset() + (mChunks.isValid() ? mPos : 0);
+}
+
+} // namespace spurv
@@ -0,0 +1,120 @@
+#include "ShapeCache.h"
+#include <cassert>
+#include <functional>
+
+using namespace spurv;
+
+std::unique_ptr<ShapeCache> ShapeCache::sInstance;
+
+ShapeCache* ShapeCache::instance()
+{
+    static std::once_flag once;
+    std::call_once(once, []() {
+        sInstance.reset(new ShapeCache);
+    });
+    return sInstance.get();
+}
+
+void ShapeCache::destroy()
+{
+    sInstance.reset();
+}
+
+ShapeCache::~ShapeCache()
+{
+    clear();
+}
+
+uint64_t ShapeCache::hashFor(std::u16string_view text, const Font& font)
+{
+    uint64_t hash = std::hash<std::u16string_view>()(text);
+    // boost::hash_combine
+    hash ^= std::hash<std::string>()(font.file().native()) + 0x9e3779b97f4a7c15ULL + (hash << 6) + (hash >> 2);
+    hash ^= static_cast<uint64_t>(font.size()) + 0x9e3779b97f4a7c15ULL + (hash << 6) + (hash >> 2);
+    return hash;
+}
+
+bool ShapeCache::matches(const Entry& entry, std::u16string_view text, const Font& font)
+{
+    return entry.fontSize == font.size() && entry.text == text && entry.fontFile == font.file();
+}
+
+void ShapeCache::evict(Shard& shard, std::list<Entry>::iterator entry)
+{
+    assert(shard.bytes >= entry->bytes);
+    shard.bytes -= entry->bytes;
+    shard.index.erase(entry->hash);
+    shard.entries.erase(entry);
+}
+
+bool ShapeCache::find(std::u16string_view text, const Font& font, GlyphRun& run)
+{
+    const uint64_t hash = hashFor(text, font);
+    auto& shard = mShards[hash % NumShards];
+    std::lock_guard lock(shard.mutex);
+    auto it = shard.index.find(hash);
+    if (it == shard.index.end() || !matches(*it->second, text, font)) {
+        ++mMisses;
+        return false;
+    }
+    // move it to the front
+    shard.entries.splice(shard.entries.begin(), shard.entries, it->second);
+    run = it->second->run;
+    ++mHits;
+    return true;
+}
+
+void ShapeCache::insert(std::u16string_view text, const Font& font, const GlyphRun& run)
+{
+    if (text.size() > MaxLineLength) {
+        return;
+    }
+    const uint64_t hash = hashFor(text, font);
+    // the block of the copy is all that the entry keeps alive
+    GlyphRun copy = run.detached();
+    const std::size_t bytes = sizeof(Entry) + text.size() * sizeof(char16_t) + copy.bytes();
+
+    auto& shard = mShards[hash % NumShards];
+    std::lock_guard lock(shard.mutex);
+    auto it = shard.index.find(hash);
+    if (it != shard.index.end()) {
+        // another worker got here first, or a hash collision
+        evict(shard, it->second);
+    }
+    shard.entries.push_front({
+            hash,
+            std::u16string(text),
+            font.file(),
+            font.size(),
+            std::move(copy),
+            bytes
+        });
+    shard.index[hash] = shard.entries.begin();
+    shard.bytes += bytes;
+    while (shard.bytes > MaxBytes / NumShards && shard.entries.size() > 1) {
+        evict(shard, std::prev(shard.entries.end()));
+    }
+}
+
+void ShapeCache::clear()
+{
+    for (auto& shard : mShards) {
+        std::lock_guard lock(shard.mutex);
+        shard.entries.clear();
+        shard.index.clear();
+        shard.bytes = 0;
+    }
+}
+
+ShapeCache::Stats ShapeCache::stats() const
+{
+    Stats stats;
+    stats.hits = mHits.load();
+    stats.misses = mMisses.load();
+    for (auto& shard : mShards) {
+        std::lock_guard lock(shard.mutex);
+        stats.entries += shard.entries.size();
+        stats.bytes += shard.bytes;
+    }
+    return stats;
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <Font.h>
+#include <GlyphRun.h>
+#include <UnorderedDense.h>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+
+namespace spurv {
+
+/*
+   ShapeCache keeps the shaped glyphs of lines around so that lines that repeat,
+   in a document or across documents, are only shaped once. Entries are keyed on
+   the text of the line and the font file and size. Direction and script are
+   guessed from the text so equal text always ends up with the same ones.
+
+   The glyph runs are immutable so a hit just hands out another reference to
+   the cached run. Runs are copied into blocks of their own when they're cached,
+   a run in a shared block would keep the whole block alive. Memory is bounded,
+   the least recently used entries are dropped first. Thread safe, the cache is
+   split in shards that are locked separately so that the layout workers don't
+   serialize on it.
+*/
+
+class ShapeCache
+{
+public:
+    static ShapeCache* instance();
+    static void destroy();
+    ~ShapeCache();
+
+    bool find(std::u16string_view text, const Font& font, GlyphRun& run);
+    void insert(std::u16string_view text, const Font& font, const GlyphRun& run);
+    void clear();
+
+    struct Stats
+    {
+        uint64_t hits = 0, misses = 0;
+        std::size_t entries = 0, bytes = 0;
+    };
+    Stats stats() const;
+
+    // lines longer than this are rarely repeated, they're not worth the memory
+    static constexpr std::size_t MaxLineLength = 512;
+    static constexpr std::size_t MaxBytes = 32 * 1024 * 1024;
+
+private:
+    struct Entry
+    {
+        uint64_t hash;
+        std::u16string text;
+        std::filesystem::path fontFile;
+        uint32_t fontSize;
+        GlyphRun run;
+        std::size_t bytes;
+    };
+
+    static constexpr std::size_t NumShards = 16;
+    struct Shard
+    {
+        mutable std::mutex mutex;
+        // most recently used first
+        std::list<Entry> entries;
+        unordered_dense::map<uint64_t, std::list<Entry>::iterator> index;
+        std::size_t bytes = 0;
+    };
+
+    static uint64_t hashFor(std::u16string_view text, const Font& font);
+    static bool matches(const Entry& entry, std::u16string_view text, const Font& font);
+    static void evict(Shard& shard, std::list<Entry>::iterator entry);
+
+private:
+    Shard mShards[NumShards];
+    std::atomic<uint64_t> mHits = 0, mMisses = 0;
+
+private:
+    static std::unique_ptr<ShapeCache> sInstance;
+
+private:
+    ShapeCache() = default;
+    ShapeCache(ShapeCache&&) = delete;
+    ShapeCache(const ShapeCache&) = delete;
+    ShapeCache& operator=(ShapeCache&&) = delete;
+    ShapeCache& operator=(const ShapeCache&) = delete;
+};
+
+} // namespace spurv
@@ -1,7 +1,9 @@
 #include "Styleable.h"
 #include "Logger.h"
 #include <UnorderedDense.h>
+#include <algorithm>
 #include <cassert>
+#include <numeric>
 
 using namespace spurv;
 
@@ -389,6 +391,204 @@ static inline std::variant<StyleFlexInitialInheritName, StyleNumber, std::nullop
     return std::nullopt;
 }
 
+static constexpr std::size_t NumStyleRuleNames = static_cast<std::size_t>(StyleRuleName::ShadowColor) + 1;
+static constexpr std::size_t NumStyleSelectorNames = static_cast<std::size_t>(StyleSelectorName::Document) + 1;
+
+// a value, or a space separated part of one, parsed every way that a rule might read it
+struct StylePart
+{
+    bool initial = false;
+    std::optional<StyleNumber> number;
+    std::optional<Color> color;
+    std::variant<StyleNumber, StyleFlexBasisName, std::nullopt_t> basis = std::nullopt;
+    StyleFlexDirectionName direction = StyleFlexDirectionName::Unknown;
+    StyleFlexWrapName wrap = StyleFlexWrapName::Unknown;
+    std::variant<StyleFlexInitialInheritName, StyleNumber, std::nullopt_t> initialInheritNumber = std::nullopt;
+};
+
+struct StyleDeclaration
+{
+    StyleRuleName name;
+    StylePart value;
+    std::vector<StylePart> parts;
+};
+
+struct StyleRule
+{
+    qss::Selector selector;
+    uint64_t specificity;
+    std::vector<StyleDeclaration> declarations;
+};
+
+namespace spurv {
+// a stylesheet with its selectors, property names and values parsed up front
+struct StyleRules
+{
+    std::vector<StyleRule> rules;
+
+    // the rules by the rightmost element of each comma separated part of their selector,
+    // filed under its id, else its first class, else its first tag, else the names of the
+    // styleables it can match. a styleable only needs to look at the buckets of what it has
+    unordered_dense::map<std::string, std::vector<uint32_t>> byId, byClass, byTag;
+    std::array<std::vector<uint32_t>, NumStyleSelectorNames> byName;
+    std::vector<uint32_t> universal;
+
+    // the rules by every class of their last element, for generalizing
+    unordered_dense::map<std::string, std::vector<uint32_t>> byLastClass;
+
+    // how many levels of ancestors and earlier siblings the selectors look at, at most
+    uint32_t reachDepth = 0, reachSiblings = 0;
+};
+} // namespace spurv
+
+static inline void indexRightmostElement(StyleRules& compiled, const qss::SelectorElement& element, uint32_t rule)
+{
+    auto file = [rule](std::vector<uint32_t>& bucket) -> void {
+        // a rule with several parts might be filed under the same bucket more than once
+        if (bucket.empty() || bucket.back() != rule) {
+            bucket.push_back(rule);
+        }
+    };
+    if (!element.id().empty()) {
+        file(compiled.byId[element.id()]);
+        return;
+    }
+    if (!element.classes().empty()) {
+        file(compiled.byClass[element.classes().front()]);
+        return;
+    }
+    if (!element.params().empty()) {
+        file(compiled.byTag[element.params().begin()->first]);
+        return;
+    }
+    // the styleables each name matches, see matchesSelector
+    auto byName = [&compiled, &file](StyleSelectorName name) -> void {
+        file(compiled.byName[static_cast<std::size_t>(name)]);
+    };
+    switch (nameToStyleSelectorName(element.name())) {
+    case StyleSelectorName::Editor:
+        byName(StyleSelectorName::Editor);
+        break;
+    case StyleSelectorName::Frame:
+        byName(StyleSelectorName::Frame);
+        byName(StyleSelectorName::Container);
+        byName(StyleSelectorName::View);
+        byName(StyleSelectorName::Editor);
+        break;
+    case StyleSelectorName::Container:
+        byName(StyleSelectorName::Container);
+        byName(StyleSelectorName::Editor);
+        break;
+    case StyleSelectorName::View:
+        byName(StyleSelectorName::View);
+        break;
+    case StyleSelectorName::Document:
+        byName(StyleSelectorName::Document);
+        break;
+    case StyleSelectorName::Empty:
+    case StyleSelectorName::Star:
+        file(compiled.universal);
+        break;
+    case StyleSelectorName::Unknown:
+        // never matches anything
+        break;
+    }
+}
+
+static inline void indexRule(StyleRules& compiled, const qss::Selector& selector, uint32_t rule)
+{
+    const auto count = selector.fragmentCount();
+    if (count == 0) {
+        return;
+    }
+    // every comma separated part ends right before an adjacent element
+    for (std::size_t idx = 0; idx < count; ++idx) {
+        if (idx + 1 == count || selector[idx + 1].position() == qss::SelectorElement::ADJACENT) {
+            indexRightmostElement(compiled, selector[idx], rule);
+        }
+    }
+    const auto& last = selector[count - 1];
+    for (const auto& clazz : last.classes()) {
+        auto& bucket = compiled.byLastClass[clazz];
+        if (bucket.empty() || bucket.back() != rule) {
+            bucket.push_back(rule);
+        }
+    }
+
+    // each comma separated part on its own, the combinators that add up
+    auto add = [](uint32_t& reach, bool unbounded) -> void {
+        if (unbounded) {
+            reach = std::numeric_limits<uint32_t>::max();
+        } else if (reach != std::numeric_limits<uint32_t>::max()) {
+            ++reach;
+        }
+    };
+    uint32_t depth = 0, siblings = 0;
+    for (std::size_t idx = 0; idx < count; ++idx) {
+        switch (selector[idx].position()) {
+        case qss::SelectorElement::PARENT:
+        case qss::SelectorElement::ADJACENT:
+            depth = siblings = 0;
+            break;
+        case qss::SelectorElement::CHILD:
+            add(depth, false);
+            break;
+        case qss::SelectorElement::DESCENDANT:
+            add(depth, true);
+            break;
+        case qss::SelectorElement::SIBLING:
+            add(siblings, false);
+            break;
+        case qss::SelectorElement::GENERAL_SIBLING:
+            add(siblings, true);
+            break;
+        }
+        compiled.reachDepth = std::max(compiled.reachDepth, depth);
+        compiled.reachSiblings = std::max(compiled.reachSiblings, siblings);
+    }
+}
+
+static inline StylePart parseStylePart(const std::string& value)
+{
+    StylePart part;
+    part.initial = value.size() == 7 && strncasecmp(value.c_str(), "initial", 7) == 0;
+    part.number = nameToStyleNumber(value.c_str());
+    part.color = parseColor(value);
+    part.basis = nameToStyleFlexBasisName(value.c_str(), value.size());
+    part.direction = nameToStyleFlexDirectionName(value.c_str(), value.size());
+    part.wrap = nameToStyleFlexWrapName(value.c_str(), value.size());
+    part.initialInheritNumber = nameToStyleFlexInitialInheritNumberName(value.c_str(), value.size());
+    return part;
+}
+
+static std::shared_ptr<const StyleRules> compileStylesheet(const qss::Document& qss)
+{
+    auto compiled = std::make_shared<StyleRules>();
+    const auto dend = qss.cend();
+    for (auto dit = qss.cbegin(); dit != dend; ++dit) {
+        const auto& fragment = dit->first;
+        StyleRule rule = { fragment.selector(), Styleable::selectorSpecificity(fragment.selector()), {} };
+        const auto& block = fragment.block();
+        for (auto bit = block.cbegin(); bit != block.cend(); ++bit) {
+            const auto name = nameToStyleRuleName(bit->first);
+            if (name == StyleRuleName::Unknown) {
+                continue;
+            }
+            const auto& value = bit->second.first;
+            StyleDeclaration declaration = { name, parseStylePart(value), {} };
+            StringSpaceSkipper skipper(value);
+            while (skipper.cur != skipper.end) {
+                declaration.parts.push_back(parseStylePart(std::string(skipper.cur, skipper.next - skipper.cur)));
+                skipper.advance();
+            }
+            rule.declarations.push_back(std::move(declaration));
+        }
+        indexRule(*compiled, rule.selector, static_cast<uint32_t>(compiled->rules.size()));
+        compiled->rules.push_back(std::move(rule));
+    }
+    return compiled;
+}
+
 Styleable::Styleable()
     : mYogaNode(YGNodeNew())
 {
@@ -434,10 +634,13 @@ void Styleable::setStylesheet(const qss::Document& qss, StylesheetMode mode)
         mQss += qss;
     }
     mMergedQss = mQss;
+    mRules = compileStylesheet(mMergedQss);
+    mStyleState = StyleState::StylesheetChanged;
     applyStylesheet();
     for (auto child : mChildren) {
         child->mergeParentStylesheet(mMergedQss);
     }
+    updateSubtreeReach();
 }
 
 void Styleable::setStylesheet(const std::string& qss, StylesheetMode mode)
@@ -448,19 +651,25 @@ void Styleable::setStylesheet(const std::string& qss, StylesheetMode mode)
 void Styleable::mergeParentStylesheet(const qss::Document& qss)
 {
     mMergedQss = qss + mQss;
+    mRules = compileStylesheet(mMergedQss);
+    mStyleState = StyleState::StylesheetChanged;
     applyStylesheet();
     for (auto child : mChildren) {
         child->mergeParentStylesheet(mMergedQss);
     }
+    updateSubtreeReach();
 }
 
 void Styleable::unmergeParentStylesheet()
 {
     mMergedQss = mQss;
+    mRules = compileStylesheet(mMergedQss);
+    mStyleState = StyleState::StylesheetChanged;
     applyStylesheet();
     for (auto child : mChildren) {
         child->mergeParentStylesheet(mMergedQss);
     }
+    updateSubtreeReach();
 }
 
 void Styleable::addStyleableChild(Styleable* child)
@@ -481,6 +690,7 @@ void Styleable::removeStyleableChild(Styleable* child)
         mChildren.erase(it);
         child->unmergeParentStylesheet();
         child->mParent = nullptr;
+        updateSubtreeReach();
         YGNodeRemoveChild(mYogaNode, child->mYogaNode);
     }
 }
@@ -715,9 +925,8 @@ bool Styleable::isGeneralizedFrom(const qss::Selector& from, const qss::Selector
 uint64_t Styleable::selectorSpecificity(const qss::Selector& selector)
 {
     uint16_t ids = 0, attrs = 0, elems = 0;
-    auto it = selector.cbegin();
     const auto end = selector.cend();
-    while (it != end) {
+    for (auto it = selector.cbegin(); it != end; ++it) {
         if (it->name() == "*") {
             continue;
         }
@@ -729,28 +938,23 @@ uint64_t Styleable::selectorSpecificity(const qss::Selector& selector)
         }
         attrs += it->classes().size() + it->params().size();
         elems += it->pseudoStates().size() + 1; // + 1 for the element itself
-
-        ++it;
     }
     return (static_cast<uint64_t>(ids) << 32) | (static_cast<uint64_t>(attrs) << 16) | static_cast<uint64_t>(elems);
 }
 
 template<std::size_t Size>
-static inline std::size_t spacedNumbers(std::array<StyleNumber, Size>& array, const std::string& value)
+static inline std::size_t spacedNumbers(std::array<StyleNumber, Size>& array, const std::vector<StylePart>& parts)
 {
     std::size_t numNumbers = 0;
-    StringSpaceSkipper skipper(value);
-    while (skipper.cur != skipper.end) {
+    for (const auto& part : parts) {
         if (numNumbers == Size) {
             break;
         }
-        auto num = nameToStyleNumber(skipper.cur);
-        if (num.has_value()) {
-            array[numNumbers++] = num.value();
+        if (part.number.has_value()) {
+            array[numNumbers++] = part.number.value();
         } else {
             return 0;
         }
-        skipper.advance();
     }
     return numNumbers;
 }
@@ -763,76 +967,293 @@ void Styleable::clearStyleData()
     mBoxShadow = {};
 }
 
+void Styleable::invalidateStyle()
+{
+    markStyleDirty(StyleState::SelectorChanged);
+    // selectors with combinators might match descendants and later siblings through this one,
+    // only as far as they reach
+    for (auto child : mChildren) {
+        if (child->mSubtreeReach.depth > 0) {
+            child->markRelativesDirty(1, 0);
+        }
+    }
+    // a later sibling can match through this one with a rule this one isn't a candidate for,
+    // so each of them decides from its own rules
+    if (mParent != nullptr && mParent->mSubtreeReach.siblings > 0) {
+        auto it = std::find(mParent->mChildren.begin(), mParent->mChildren.end(), this);
+        if (it != mParent->mChildren.end()) {
+            uint32_t siblings = 1;
+            for (++it; it != mParent->mChildren.end() && siblings <= mParent->mSubtreeReach.siblings; ++it, ++siblings) {
+                if ((*it)->mSubtreeReach.siblings >= siblings) {
+                    (*it)->markRelativesDirty(0, siblings);
+                }
+            }
+        }
+    }
+
+    Styleable* root = this;
+    while (root->mParent != nullptr) {
+        root = root->mParent;
+    }
+    root->updateStyles();
+}
+
+void Styleable::markStyleDirty(StyleState state)
+{
+    if (state > mStyleState) {
+        mStyleState = state;
+    }
+    for (auto parent = mParent; parent != nullptr && !parent->mDescendantStyleDirty; parent = parent->mParent) {
+        parent->mDescendantStyleDirty = true;
+    }
+}
+
+// the styleable is depth levels below the one that changed, or below a sibling that
+// many siblings after it. only goes down as far as the selectors of the subtree reach
+void Styleable::markRelativesDirty(uint32_t depth, uint32_t siblings)
+{
+    if (mHasCompoundSelectors && mRules->reachDepth >= depth && mRules->reachSiblings >= siblings) {
+        markStyleDirty(StyleState::RelativesChanged);
+    }
+    for (auto child : mChildren) {
+        if (child->mSubtreeReach.depth > depth && child->mSubtreeReach.siblings >= siblings) {
+            child->markRelativesDirty(depth + 1, siblings);
+        }
+    }
+}
+
+// the reach of the styleable's rules and its children's subtrees, the ancestors
+// are brought up to date as well
+void Styleable::updateSubtreeReach()
+{
+    for (Styleable* styleable = this; styleable != nullptr; styleable = styleable->mParent) {
+        StyleReach reach;
+        if (styleable->mRules) {
+            reach = { styleable->mRules->reachDepth, styleable->mRules->reachSiblings };
+        }
+        for (auto child : styleable->mChildren) {
+            reach.depth = std::max(reach.depth, child->mSubtreeReach.depth);
+            reach.siblings = std::max(reach.siblings, child->mSubtreeReach.siblings);
+        }
+        if (reach == styleable->mSubtreeReach) {
+            break;
+        }
+        styleable->mSubtreeReach = reach;
+    }
+}
+
+// restyles the styleables that are out of date, only going down the parts of the tree that have them
+void Styleable::updateStyles()
+{
+    if (mStyleState != StyleState::Clean) {
+        applyStylesheet();
+    }
+    if (mDescendantStyleDirty) {
+        mDescendantStyleDirty = false;
+        for (auto child : mChildren) {
+            child->updateStyles();
+        }
+    }
+}
+
+// the rules that this styleable could match going by its own selector alone, in order
+void Styleable::updateCandidateRules()
+{
+    mCandidateRules.clear();
+    if (!mRules) {
+        return;
+    }
+    const auto& element = mSelector[0];
+    const auto name = nameToStyleSelectorName(element.name());
+    if (name == StyleSelectorName::Unknown || name == StyleSelectorName::Star) {
+        // matchesSelector never matches these
+        return;
+    }
+    auto add = [this](const std::vector<uint32_t>& bucket) -> void {
+        mCandidateRules.insert(mCandidateRules.end(), bucket.begin(), bucket.end());
+    };
+    auto addFrom = [&add](const unordered_dense::map<std::string, std::vector<uint32_t>>& buckets, const std::string& key) -> void {
+        auto it = buckets.find(key);
+        if (it != buckets.end()) {
+            add(it->second);
+        }
+    };
+    if (!element.id().empty()) {
+        addFrom(mRules->byId, element.id());
+    }
+    for (const auto& clazz : element.classes()) {
+        addFrom(mRules->byClass, clazz);
+    }
+    for (const auto& tag : element.params()) {
+        addFrom(mRules->byTag, tag.first);
+    }
+    add(mRules->byName[static_cast<std::size_t>(name)]);
+    add(mRules->universal);
+    std::sort(mCandidateRules.begin(), mCandidateRules.end());
+    mCandidateRules.erase(std::unique(mCandidateRules.begin(), mCandidateRules.end()), mCandidateRules.end());
+}
+
+// brings the cached selector matches up to date, returns true if any of them changed
+bool Styleable::updateSelectorMatches()
+{
+    if (mStyleState == StyleState::RelativesChanged) {
+        bool changed = false;
+        for (auto idx : mCandidateRules) {
+            const auto& selector = mRules->rules[idx].selector;
+            // a selector without combinators only looks at the styleable itself
+            if (selector.fragmentCount() == 1) {
+                continue;
+            }
+            const bool matches = matchesSelector(selector);
+            if (matches != mSelectorMatches[idx]) {
+                mSelectorMatches[idx] = matches;
+                changed = true;
+            }
+        }
+        return changed;
+    }
+
+    // the styleable's own selector or the stylesheet changed, the candidates might be different
+    updateCandidateRules();
+    std::vector<bool> matches(mRules ? mRules->rules.size() : 0, false);
+    mHasCompoundSelectors = false;
+    for (auto idx : mCandidateRules) {
+        const auto& selector = mRules->rules[idx].selector;
+        matches[idx] = matchesSelector(selector);
+        if (selector.fragmentCount() > 1) {
+            mHasCompoundSelectors = true;
+        }
+    }
+    const bool changed = mStyleState == StyleState::StylesheetChanged || matches != mSelectorMatches;
+    mSelectorMatches = std::move(matches);
+    return changed;
+}
+
+std::vector<uint32_t> Styleable::generalizableRules(const qss::SelectorElement& element) const
+{
+    if (!mRules) {
+        return {};
+    }
+    if (element.classes().empty()) {
+        std::vector<uint32_t> all(mRules->rules.size());
+        std::iota(all.begin(), all.end(), 0);
+        return all;
+    }
+    auto it = mRules->byLastClass.find(element.classes().front());
+    if (it == mRules->byLastClass.end()) {
+        return {};
+    }
+    return it->second;
+}
+
+const qss::Selector& Styleable::ruleSelector(uint32_t rule) const
+{
+    assert(mRules && rule < mRules->rules.size());
+    return mRules->rules[rule].selector;
+}
+
+std::optional<Color> Styleable::ruleColor(uint32_t rule, ColorType type) const
+{
+    assert(mRules && rule < mRules->rules.size());
+    StyleRuleName name = StyleRuleName::Unknown;
+    switch (type) {
+    case ColorType::Background:
+        name = StyleRuleName::BackgroundColor;
+        break;
+    case ColorType::Foreground:
+        name = StyleRuleName::Color;
+        break;
+    case ColorType::Border:
+        name = StyleRuleName::BorderColor;
+        break;
+    case ColorType::Shadow:
+        name = StyleRuleName::ShadowColor;
+        break;
+    }
+    // the last declaration in the block wins
+    std::optional<Color> color;
+    for (const auto& declaration : mRules->rules[rule].declarations) {
+        if (declaration.name == name && declaration.value.color.has_value()) {
+            color = declaration.value.color;
+        }
+    }
+    return color;
+}
+
 void Styleable::applyStylesheet()
 {
-    clearStyleData();
+    const bool stylesheetChanged = mStyleState == StyleState::StylesheetChanged;
+    const bool matchesChanged = updateSelectorMatches();
+    mStyleState = StyleState::Clean;
+    if (!stylesheetChanged && !matchesChanged) {
+        // the same rules apply as before
+        return;
+    }
 
-    unordered_dense::map<std::string, std::pair<uint64_t, std::string>> matching;
+    clearStyleData();
 
-    auto setColor = [this](ColorType type, std::optional<Color>&& color) -> void {
-        mColors[static_cast<std::underlying_type_t<ColorType>>(type)] = std::move(color);
+    auto setColor = [this](ColorType type, const std::optional<Color>& color) -> void {
+        mColors[static_cast<std::underlying_type_t<ColorType>>(type)] = color;
     };
 
-    const auto dend = mMergedQss.cend();
-    for (auto dit = mMergedQss.cbegin(); dit != dend; ++dit) {
-        const auto& fragment = dit->first;
-        const auto& selector = fragment.selector();
-        if (matchesSelector(selector)) {
-            const auto specificity = selectorSpecificity(selector);
-            const auto& block = fragment.block();
-            for (auto bit = block.cbegin(); bit != block.cend(); ++bit) {
-                const auto& name = bit->first;
-                auto mit = matching.find(name);
-                if (mit == matching.end() || specificity >= mit->second.first) {
-                    matching[name] = std::make_pair(specificity, bit->second.first);
-                }
+    // the declaration of each property with the highest specificity, the later one on a tie
+    std::array<const StyleDeclaration*, NumStyleRuleNames> matching = {};
+    std::array<uint64_t, NumStyleRuleNames> specificities = {};
+    for (std::size_t idx = 0; idx < mSelectorMatches.size(); ++idx) {
+        if (!mSelectorMatches[idx]) {
+            continue;
+        }
+        const auto& rule = mRules->rules[idx];
+        for (const auto& declaration : rule.declarations) {
+            const auto slot = static_cast<std::size_t>(declaration.name);
+            if (matching[slot] == nullptr || rule.specificity >= specificities[slot]) {
+                matching[slot] = &declaration;
+                specificities[slot] = rule.specificity;
             }
         }
     }
 
-    const auto mend = matching.cend();
-    for (auto mit = matching.cbegin(); mit != mend; ++mit) {
-        spdlog::info("looking at rule '{}'", mit->first);
-        const auto ruleName = nameToStyleRuleName(mit->first);
-        const auto& ruleValue = mit->second.second;
+    for (const auto* declaration : matching) {
+        if (declaration == nullptr) {
+            continue;
+        }
+        const auto ruleName = declaration->name;
+        const auto& ruleValue = declaration->value;
         switch (ruleName) {
         case StyleRuleName::BackgroundColor: {
-            if (ruleValue.size() == 7 && strncasecmp(ruleValue.c_str(), "initial", 7) == 0) {
+            if (ruleValue.initial) {
                 setColor(ColorType::Background, {});
             } else {
-                setColor(ColorType::Background, parseColor(ruleValue));
+                setColor(ColorType::Background, ruleValue.color);
             }
             break; }
         case StyleRuleName::Border: {
-            StringSpaceSkipper skipper(ruleValue);
-            while (skipper.cur != skipper.end) {
-                if (skipper.next - skipper.cur == 7 && strncasecmp(skipper.cur, "initial", 7) == 0) {
+            for (const auto& part : declaration->parts) {
+                if (part.initial) {
                     setColor(ColorType::Border, {});
                     mBorder = {};
                     YGNodeStyleSetBorder(mYogaNode, YGEdgeAll, 0.f);
                 } else {
-                    auto maybeNumber = nameToStyleNumber(skipper.cur);
+                    const auto& maybeNumber = part.number;
                     if (maybeNumber.has_value()) {
                         if (!maybeNumber->percentage) {
                             mBorder.fill(static_cast<uint32_t>(maybeNumber->number));
                             YGNodeStyleSetBorder(mYogaNode, YGEdgeAll, maybeNumber->number);
                         }
                     } else {
-                        setColor(ColorType::Border, parseColor(std::string(skipper.cur, skipper.next - skipper.cur)));
+                        setColor(ColorType::Border, part.color);
                     }
                 }
-                skipper.advance();
             }
             break; }
         case StyleRuleName::BorderWidth: {
             std::array<float, 4> borders;
             std::size_t numBorders = 0;
-            StringSpaceSkipper skipper(ruleValue);
-            while (skipper.cur != skipper.end) {
+            for (const auto& part : declaration->parts) {
                 if (numBorders == 4) {
                     break;
                 }
-                auto grow = nameToStyleFlexInitialInheritNumberName(skipper.cur, skipper.next - skipper.cur);
+                const auto& grow = part.initialInheritNumber;
                 if (std::holds_alternative<StyleNumber>(grow)) {
                     const auto& number = std::get<StyleNumber>(grow);
                     if (!number.percentage) {
@@ -848,7 +1269,6 @@ void Styleable::applyStylesheet()
                         // ### support inherit?
                     }
                 }
-                skipper.advance();
             }
             switch (numBorders) {
             case 1:
@@ -888,18 +1308,18 @@ void Styleable::applyStylesheet()
             }
             break; }
         case StyleRuleName::BorderColor: {
-            if (ruleValue.size() == 7 && strncasecmp(ruleValue.c_str(), "initial", 7) == 0) {
+            if (ruleValue.initial) {
                 setColor(ColorType::Border, {});
             } else {
-                setColor(ColorType::Border, parseColor(ruleValue));
+                setColor(ColorType::Border, ruleValue.color);
             }
             break; }
         case StyleRuleName::BorderRadius: {
-            if (ruleValue.size() == 7 && strncasecmp(ruleValue.c_str(), "initial", 7) == 0) {
+            if (ruleValue.initial) {
                 mBorderRadius = {};
             } else {
                 std::array<StyleNumber, 4> numbers;
-                const auto numNumbers = spacedNumbers(numbers, ruleValue);
+                const auto numNumbers = spacedNumbers(numbers, declaration->parts);
                 switch (numNumbers) {
                 case 1:
                     if (!numbers[0].percentage) {
@@ -943,7 +1363,7 @@ void Styleable::applyStylesheet()
             }
             break; }
         case StyleRuleName::BoxShadow: {
-            if (ruleValue.size() == 7 && strncasecmp(ruleValue.c_str(), "initial", 7) == 0) {
+            if (ruleValue.initial) {
                 setColor(ColorType::Shadow, {});
                 mBoxShadow = {};
             } else {
@@ -952,24 +1372,24 @@ void Styleable::applyStylesheet()
                 // h-offset v-offset blur spread color
                 bool done = false;
                 uint32_t pos = 0;
-                StringSpaceSkipper skipper(ruleValue);
-                while (!done && skipper.cur != skipper.end) {
+                for (auto it = declaration->parts.begin(); !done && it != declaration->parts.end(); ++it) {
+                    const auto& part = *it;
                     switch (pos) {
                     case 0:
                         // h-offset
-                        mBoxShadow.hoffset = nameToStyleNumber(skipper.cur).value_or(StyleNumber {}).number;
+                        mBoxShadow.hoffset = part.number.value_or(StyleNumber {}).number;
                         break;
                     case 1:
                         // v-offset
-                        mBoxShadow.voffset = nameToStyleNumber(skipper.cur).value_or(StyleNumber {}).number;
+                        mBoxShadow.voffset = part.number.value_or(StyleNumber {}).number;
                         break;
                     case 2: {
                         // blur or color
-                        auto blur = nameToStyleNumber(skipper.cur);
+                        const auto& blur = part.number;
                         if (blur.has_value()) {
                             mBoxShadow.blur = blur.value().number;
                         } else {
-                            auto color = parseColor(skipper.cur, skipper.next - skipper.cur);
+                            const auto& color = part.color;
                             if (color.has_value()) {
                                 setColor(ColorType::Shadow, color.value());
                                 done = true;
@@ -978,11 +1398,11 @@ void Styleable::applyStylesheet()
                         break; }
                     case 3: {
                         // spread or color
-                        auto spread = nameToStyleNumber(skipper.cur);
+                        const auto& spread = part.number;
                         if (spread.has_value()) {
                             mBoxShadow.spread = spread.value().number;
                         } else {
-                            auto color = parseColor(skipper.cur, skipper.next - skipper.cur);
+                            const auto& color = part.color;
                             if (color.has_value()) {
                                 setColor(ColorType::Shadow, color.value());
                                 done = true;
@@ -991,7 +1411,7 @@ void Styleable::applyStylesheet()
                         break; }
                     case 4: {
                         // color
-                        auto color = parseColor(skipper.cur, skipper.next - skipper.cur);
+                        const auto& color = part.color;
                         if (color.has_value()) {
                             setColor(ColorType::Shadow, color.value());
                         }
@@ -999,29 +1419,27 @@ void Styleable::applyStylesheet()
                         break; }
                     }
                     ++pos;
-                    skipper.advance();
                 }
             }
             break; }
         case StyleRuleName::ShadowColor: {
-            if (ruleValue.size() == 7 && strncasecmp(ruleValue.c_str(), "initial", 7) == 0) {
+            if (ruleValue.initial) {
                 setColor(ColorType::Shadow, {});
             } else {
-                setColor(ColorType::Shadow, parseColor(ruleValue));
+                setColor(ColorType::Shadow, ruleValue.color);
             }
             break; }
         case StyleRuleName::Color: {
-            if (ruleValue.size() == 7 && strncasecmp(ruleValue.c_str(), "initial", 7) == 0) {
+            if (ruleValue.initial) {
                 setColor(ColorType::Foreground, {});
             } else {
-                setColor(ColorType::Foreground, parseColor(ruleValue));
+                setColor(ColorType::Foreground, ruleValue.color);
             }
             break; }
         case StyleRuleName::Flex: {
             // not 100% sure this is correct
-            StringSpaceSkipper skipper(ruleValue);
-            while (skipper.cur != skipper.end) {
-                auto basis = nameToStyleFlexBasisName(skipper.cur, skipper.next - skipper.cur);
+            for (const auto& part : declaration->parts) {
+                const auto& basis = part.basis;
                 if (std::holds_alternative<StyleNumber>(basis)) {
                     const auto& number = std::get<StyleNumber>(basis);
                     if (number.percentage) {
@@ -1043,12 +1461,10 @@ void Styleable::applyStylesheet()
                         break;
                     }
                 }
-
-                skipper.advance();
             }
             break; }
         case StyleRuleName::FlexBasis: {
-            auto basis = nameToStyleFlexBasisName(ruleValue.c_str(), ruleValue.size());
+            const auto& basis = ruleValue.basis;
             if (std::holds_alternative<StyleNumber>(basis)) {
                 const auto& number = std::get<StyleNumber>(basis);
                 if (number.percentage) {
@@ -1072,7 +1488,7 @@ void Styleable::applyStylesheet()
             }
             break; }
         case StyleRuleName::FlexDirection: {
-            auto dir = nameToStyleFlexDirectionName(ruleValue.c_str(), ruleValue.size());
+            const auto dir = ruleValue.direction;
             switch (dir) {
             case StyleFlexDirectionName::Initial:
             case StyleFlexDirectionName::Row:
@@ -1096,10 +1512,9 @@ void Styleable::applyStylesheet()
             break; }
         case StyleRuleName::FlexFlow: {
             // flow can be either direction or wrap
-            StringSpaceSkipper skipper(ruleValue);
-            while (skipper.cur != skipper.end) {
+            for (const auto& part : declaration->parts) {
                 // direction?
-                auto dir = nameToStyleFlexDirectionName(skipper.cur, skipper.next - skipper.cur);
+                const auto dir = part.direction;
                 if (dir != StyleFlexDirectionName::Unknown) {
                     switch (dir) {
                     case StyleFlexDirectionName::Initial:
@@ -1123,7 +1538,7 @@ void Styleable::applyStylesheet()
                     }
                 } else {
                     // maybe wrap?
-                    auto wrap = nameToStyleFlexWrapName(skipper.cur, skipper.next - skipper.cur);
+                    const auto wrap = part.wrap;
                     switch (wrap) {
                     case StyleFlexWrapName::Wrap:
                         YGNodeStyleSetFlexWrap(mYogaNode, YGWrapWrap);
@@ -1141,12 +1556,10 @@ void Styleable::applyStylesheet()
                         break;
                     }
                 }
-
-                skipper.advance();
             }
             break; }
         case StyleRuleName::FlexGrow: {
-            auto grow = nameToStyleFlexInitialInheritNumberName(ruleValue.c_str(), ruleValue.size());
+            const auto& grow = ruleValue.initialInheritNumber;
             if (std::holds_alternative<StyleNumber>(grow)) {
                 const auto& number = std::get<StyleNumber>(grow);
                 if (!number.percentage) {
@@ -1161,7 +1574,7 @@ void Styleable::applyStylesheet()
             }
             break; }
         case StyleRuleName::FlexShrink: {
-            auto grow = nameToStyleFlexInitialInheritNumberName(ruleValue.c_str(), ruleValue.size());
+            const auto& grow = ruleValue.initialInheritNumber;
             if (std::holds_alternative<StyleNumber>(grow)) {
                 const auto& number = std::get<StyleNumber>(grow);
                 if (!number.percentage) {
@@ -1176,7 +1589,7 @@ void Styleable::applyStylesheet()
             }
             break; }
         case StyleRuleName::FlexWrap: {
-            auto wrap = nameToStyleFlexWrapName(ruleValue.c_str(), ruleValue.size());
+            const auto wrap = ruleValue.wrap;
             switch (wrap) {
             case StyleFlexWrapName::Wrap:
                 YGNodeStyleSetFlexWrap(mYogaNode, YGWrapWrap);
@@ -1195,11 +1608,11 @@ void Styleable::applyStylesheet()
             }
             break; }
         case StyleRuleName::Gap: {
-            if (ruleValue.size() == 7 && strncasecmp(ruleValue.c_str(), "initial", 7) == 0) {
+            if (ruleValue.initial) {
                 YGNodeStyleSetGap(mYogaNode, YGGutterAll, 0.f);
             } else {
                 std::array<StyleNumber, 2> numbers;
-                const auto numNumbers = spacedNumbers(numbers, ruleValue);
+                const auto numNumbers = spacedNumbers(numbers, declaration->parts);
                 switch (numNumbers) {
                 case 1:
                     if (numbers[0].percentage) {
@@ -1224,11 +1637,11 @@ void Styleable::applyStylesheet()
             }
             break; }
         case StyleRuleName::Margin: {
-            if (ruleValue.size() == 7 && strncasecmp(ruleValue.c_str(), "initial", 7) == 0) {
+            if (ruleValue.initial) {
                 YGNodeStyleSetMargin(mYogaNode, YGEdgeAll, 0.f);
             } else {
                 std::array<StyleNumber, 4> numbers;
-                const auto numNumbers = spacedNumbers(numbers, ruleValue);
+                const auto numNumbers = spacedNumbers(numbers, declaration->parts);
                 switch (numNumbers) {
                 case 1:
                     if (numbers[0].percentage) {
@@ -1298,11 +1711,11 @@ void Styleable::applyStylesheet()
             }
             break; }
         case StyleRuleName::Padding: {
-            if (ruleValue.size() == 7 && strncasecmp(ruleValue.c_str(), "initial", 7) == 0) {
+            if (ruleValue.initial) {
                 YGNodeStyleSetPadding(mYogaNode, YGEdgeAll, 0.f);
             } else {
                 std::array<StyleNumber, 4> numbers;
-                const auto numNumbers = spacedNumbers(numbers, ruleValue);
+                const auto numNumbers = spacedNumbers(numbers, declaration->parts);
                 switch (numNumbers) {
                 case 1:
                     if (numbers[0].percentage) {
@@ -5,12 +5,16 @@
 #include <Geometry.h>
 #include <qssdocument.h>
 #include <yoga/Yoga.h>
+#include <limits>
+#include <memory>
 #include <optional>
 #include <string>
 #include <vector>
 
 namespace spurv {
 
+struct StyleRules;
+
 /* Styleables
 
    generally the selector syntax matches that of Qt style sheets,
@@ -108,12 +112,23 @@ protected:
 
     void clearStyleData();
     void applyStylesheet();
+    // to be called when the selector changed, restyles this and whatever
+    // else in the tree might match differently because of it
+    void invalidateStyle();
+    // the indexes of the rules of the merged stylesheet whose last element has the
+    // classes of element, in order. the only ones element can be generalized from
+    std::vector<uint32_t> generalizableRules(const qss::SelectorElement& element) const;
+    // the selector of a rule of the merged stylesheet and the color of type it sets, if any
+    const qss::Selector& ruleSelector(uint32_t rule) const;
+    std::optional<Color> ruleColor(uint32_t rule, ColorType type) const;
 
     void relayout();
 
 protected:
     qss::Selector mSelector;
     qss::Document mQss, mMergedQss;
+    // mMergedQss compiled, styling doesn't parse anything
+    std::shared_ptr<const StyleRules> mRules;
     std::array<std::optional<Color>, 4> mColors;
     // left, top, right, bottom
     std::array<uint32_t, 4> mBorder = {}, mBorderRadius = {}, mPadding = {}, mMargin = {};
@@ -129,6 +144,43 @@ protected:
 private:
     static bool matchesSelector(const Styleable* styleable, const qss::Selector& selector, std::size_t inputOffset);
 
+    // how out of date the style is, from least to most
+    enum class StyleState : uint8_t {
+        Clean,
+        // an ancestor or earlier sibling changed, only selectors with combinators can match differently
+        RelativesChanged,
+        // the styleable's own selector changed
+        SelectorChanged,
+        // nothing that's cached is valid
+        StylesheetChanged
+    };
+    // how far the selectors of a stylesheet look from the styleable they match, in levels
+    // of ancestors and earlier siblings. a change to a styleable only affects what's that close
+    struct StyleReach
+    {
+        static constexpr uint32_t Unbounded = std::numeric_limits<uint32_t>::max();
+        uint32_t depth = 0, siblings = 0;
+
+        bool operator==(const StyleReach&) const = default;
+    };
+    void markStyleDirty(StyleState state);
+    void markRelativesDirty(uint32_t depth, uint32_t siblings);
+    void updateSubtreeReach();
+    void updateStyles();
+    void updateCandidateRules();
+    bool updateSelectorMatches();
+
+    StyleState mStyleState = StyleState::StylesheetChanged;
+    // some descendant's style is out of date
+    bool mDescendantStyleDirty = false;
+    // whether each selector of mMergedQss matches, in order
+    std::vector<bool> mSelectorMatches;
+    // the rules that can match going by the styleable's own selector, the others never do
+    std::vector<uint32_t> mCandidateRules;
+    bool mHasCompoundSelectors = false;
+    // the furthest any selector of this styleable or its descendants reaches
+    StyleReach mSubtreeReach;
+
 private:
     Styleable(const Styleable&) = delete;
     Styleable& operator=(const Styleable&) = delete;
@@ -147,6 +199,7 @@ inline EventEmitter<void()>& Styleable::onAppliedStylesheet()
 inline void Styleable::setSelector(const qss::Selector& selector)
 {
     mSelector = selector;
+    invalidateStyle();
 }
 
 inline void Styleable::setSelector(const std::string& selector)
@@ -178,6 +231,7 @@ inline void Styleable::setName(const std::string& name)
 {
     const std::string oldName = mSelector[0].id();
     mutableSelector()[0].id(name);
+    invalidateStyle();
     mOnNameChanged.emit(oldName);
 }
 
@@ -189,21 +243,25 @@ inline std::string Styleable::name() const
 inline void Styleable::setTag(const std::string& key, const std::string& value)
 {
     mSelector[0].on(key, value);
+    invalidateStyle();
 }
 
 inline void Styleable::removeTag(const std::string& key)
 {
     mSelector[0].off(key);
+    invalidateStyle();
 }
 
 inline void Styleable::addClass(const std::string& name)
 {
     mSelector[0].clazz(name);
+    invalidateStyle();
 }
 
 inline void Styleable::removeClass(const std::string& name)
 {
     mSelector[0].noclazz(name);
+    invalidateStyle();
 }
 
 inline const std::optional<Color>& Styleable::color(ColorType type) const
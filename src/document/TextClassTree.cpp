@@ -0,0 +1,574 @@
+#include "TextClassTree.h"
+#include <algorithm>
+#include <cassert>
+#include <numeric>
+#include <optional>
+
+using namespace spurv;
+
+TextClassSet::TextClassSet(std::initializer_list<uint32_t> classes)
+    : TextClassSet(std::span<const uint32_t>(classes.begin(), classes.size()))
+{
+}
+
+TextClassSet::TextClassSet(std::span<const uint32_t> classes)
+{
+    for (auto clazz : classes) {
+        insert(clazz);
+    }
+}
+
+TextClassSet::TextClassSet(const TextClassSet& other)
+    : mSize(other.mSize)
+{
+    if (other.mOverflow) {
+        mOverflow = std::make_unique<std::vector<uint32_t>>(*other.mOverflow);
+    } else {
+        std::copy(other.mInline, other.mInline + InlineSize, mInline);
+    }
+}
+
+TextClassSet::TextClassSet(TextClassSet&& other) noexcept
+    : mSize(other.mSize), mOverflow(std::move(other.mOverflow))
+{
+    std::copy(other.mInline, other.mInline + InlineSize, mInline);
+    other.mSize = 0;
+}
+
+TextClassSet& TextClassSet::operator=(const TextClassSet& other)
+{
+    if (this != &other) {
+        mSize = other.mSize;
+        if (other.mOverflow) {
+            mOverflow = std::make_unique<std::vector<uint32_t>>(*other.mOverflow);
+        } else {
+            mOverflow.reset();
+            std::copy(other.mInline, other.mInline + InlineSize, mInline);
+        }
+    }
+    return *this;
+}
+
+TextClassSet& TextClassSet::operator=(TextClassSet&& other) noexcept
+{
+    if (this != &other) {
+        mSize = other.mSize;
+        mOverflow = std::move(other.mOverflow);
+        std::copy(other.mInline, other.mInline + InlineSize, mInline);
+        other.mSize = 0;
+    }
+    return *this;
+}
+
+bool TextClassSet::contains(uint32_t clazz) const
+{
+    const auto set = classes();
+    return std::find(set.begin(), set.end(), clazz) != set.end();
+}
+
+void TextClassSet::insert(uint32_t clazz)
+{
+    if (contains(clazz)) {
+        return;
+    }
+    if (mOverflow) {
+        mOverflow->push_back(clazz);
+    } else if (mSize < InlineSize) {
+        mInline[mSize] = clazz;
+    } else {
+        mOverflow = std::make_unique<std::vector<uint32_t>>(mInline, mInline + mSize);
+        mOverflow->push_back(clazz);
+    }
+    ++mSize;
+}
+
+void TextClassSet::insert(const TextClassSet& classes)
+{
+    for (auto clazz : classes.classes()) {
+        insert(clazz);
+    }
+}
+
+void TextClassSet::erase(uint32_t clazz)
+{
+    uint32_t* set = data();
+    uint32_t* last = set + mSize;
+    uint32_t* it = std::find(set, last, clazz);
+    if (it == last) {
+        return;
+    }
+    std::copy(it + 1, last, it);
+    --mSize;
+    if (mOverflow) {
+        mOverflow->pop_back();
+    }
+}
+
+TextClassTree::TextClassTree()
+    : mNodes(1)
+{
+}
+
+void TextClassTree::clear()
+{
+    mNodes.resize(1);
+    mFree.clear();
+    mRoot = Null;
+    mSize = 0;
+}
+
+uint32_t TextClassTree::createNode(std::size_t start, std::size_t end, const TextClassSet& classes)
+{
+    // xorshift, the priorities only need to be spread out
+    mSeed ^= mSeed << 13;
+    mSeed ^= mSeed >> 17;
+    mSeed ^= mSeed << 5;
+
+    uint32_t node;
+    if (!mFree.empty()) {
+        node = mFree.back();
+        mFree.pop_back();
+    } else {
+        node = static_cast<uint32_t>(mNodes.size());
+        mNodes.emplace_back();
+    }
+    auto& n = mNodes[node];
+    n.start = start;
+    n.end = end;
+    n.maxEnd = end;
+    n.pending = 0;
+    n.left = n.right = Null;
+    n.priority = mSeed;
+    n.classes = classes;
+    ++mSize;
+    return node;
+}
+
+void TextClassTree::destroyNode(uint32_t node)
+{
+    mNodes[node].classes = {};
+    mFree.push_back(node);
+    --mSize;
+}
+
+void TextClassTree::destroyTree(uint32_t node)
+{
+    while (node != Null) {
+        destroyTree(mNodes[node].left);
+        const uint32_t right = mNodes[node].right;
+        destroyNode(node);
+        node = right;
+    }
+}
+
+void TextClassTree::shift(uint32_t node, std::ptrdiff_t delta)
+{
+    if (node != Null) {
+        auto& n = mNodes[node];
+        n.start += delta;
+        n.end += delta;
+        n.maxEnd += delta;
+        n.pending += delta;
+    }
+}
+
+void TextClassTree::push(uint32_t node)
+{
+    auto& n = mNodes[node];
+    if (n.pending != 0) {
+        shift(n.left, n.pending);
+        shift(n.right, n.pending);
+        n.pending = 0;
+    }
+}
+
+void TextClassTree::update(uint32_t node)
+{
+    auto& n = mNodes[node];
+    assert(n.pending == 0);
+    n.maxEnd = n.end;
+    if (n.left != Null) {
+        n.maxEnd = std::max(n.maxEnd, mNodes[n.left].maxEnd);
+    }
+    if (n.right != Null) {
+        n.maxEnd = std::max(n.maxEnd, mNodes[n.right].maxEnd);
+    }
+}
+
+void TextClassTree::updateTree(uint32_t node)
+{
+    if (node != Null) {
+        updateTree(mNodes[node].left);
+        updateTree(mNodes[node].right);
+        update(node);
+    }
+}
+
+void TextClassTree::split(uint32_t node, std::size_t start, std::size_t end, uint32_t& left, uint32_t& right)
+{
+    if (node == Null) {
+        left = right = Null;
+        return;
+    }
+    push(node);
+    auto& n = mNodes[node];
+    if (n.start < start || (n.start == start && n.end < end)) {
+        split(n.right, start, end, mNodes[node].right, right);
+        left = node;
+    } else {
+        split(n.left, start, end, left, mNodes[node].left);
+        right = node;
+    }
+    update(node);
+}
+
+uint32_t TextClassTree::merge(uint32_t left, uint32_t right)
+{
+    if (left == Null) {
+        return right;
+    }
+    if (right == Null) {
+        return left;
+    }
+    if (mNodes[left].priority > mNodes[right].priority) {
+        push(left);
+        const uint32_t merged = merge(mNodes[left].right, right);
+        mNodes[left].right = merged;
+        update(left);
+        return left;
+    }
+    push(right);
+    const uint32_t merged = merge(left, mNodes[right].left);
+    mNodes[right].left = merged;
+    update(right);
+    return right;
+}
+
+void TextClassTree::insert(std::size_t start, std::size_t end, const TextClassSet& classes)
+{
+    assert(start < end);
+    if (classes.empty()) {
+        return;
+    }
+    uint32_t left, middle, right;
+    split(mRoot, start, end, left, right);
+    // the range itself, if it's there, is the first one of right
+    split(right, start, end + 1, middle, right);
+    if (middle != Null) {
+        assert(mNodes[middle].left == Null && mNodes[middle].right == Null);
+        mNodes[middle].classes.insert(classes);
+    } else {
+        middle = createNode(start, end, classes);
+    }
+    mRoot = merge(merge(left, middle), right);
+}
+
+void TextClassTree::insert(std::vector<Range>&& ranges)
+{
+    std::erase_if(ranges, [](const Range& range) { return range.start >= range.end || range.classes.empty(); });
+    if (ranges.empty()) {
+        return;
+    }
+    std::sort(ranges.begin(), ranges.end(), [](const Range& a, const Range& b) {
+        return a.start < b.start || (a.start == b.start && a.end < b.end);
+    });
+
+    // when no range in the tree sorts between the first and the last new one, like after
+    // clearing the text they cover, the new ones are built on their own and merged in between
+    uint32_t left, middle, right;
+    split(mRoot, ranges.front().start, ranges.front().end, left, right);
+    split(right, ranges.back().start, ranges.back().end + 1, middle, right);
+    if (middle == Null) {
+        mRoot = merge(merge(left, build(ranges)), right);
+        return;
+    }
+    mRoot = merge(merge(left, middle), right);
+    for (const auto& range : ranges) {
+        insert(range.start, range.end, range.classes);
+    }
+}
+
+uint32_t TextClassTree::build(const std::vector<Range>& ranges)
+{
+    // the nodes come in order so the treap can be built with a stack of its right spine.
+    // reserving only what's needed would move every node for each batch
+    if (mNodes.size() + ranges.size() > mNodes.capacity()) {
+        mNodes.reserve(std::max(mNodes.size() + ranges.size(), mNodes.capacity() * 2));
+    }
+    std::vector<uint32_t> spine;
+    for (const auto& range : ranges) {
+        if (!spine.empty() && mNodes[spine.back()].start == range.start && mNodes[spine.back()].end == range.end) {
+            mNodes[spine.back()].classes.insert(range.classes);
+            continue;
+        }
+        const uint32_t node = createNode(range.start, range.end, range.classes);
+        uint32_t last = Null;
+        while (!spine.empty() && mNodes[spine.back()].priority < mNodes[node].priority) {
+            last = spine.back();
+            spine.pop_back();
+        }
+        mNodes[node].left = last;
+        if (!spine.empty()) {
+            mNodes[spine.back()].right = node;
+        }
+        spine.push_back(node);
+    }
+    if (spine.empty()) {
+        return Null;
+    }
+    updateTree(spine.front());
+    return spine.front();
+}
+
+void TextClassTree::add(uint32_t clazz, std::size_t start, std::size_t end)
+{
+    insert(start, end, { clazz });
+}
+
+void TextClassTree::collect(uint32_t node, std::size_t start, std::size_t end, std::vector<Range>& out)
+{
+    while (node != Null && mNodes[node].maxEnd > start) {
+        push(node);
+        collect(mNodes[node].left, start, end, out);
+        auto& n = mNodes[node];
+        if (n.start >= end) {
+            return;
+        }
+        if (n.end > start) {
+            out.push_back({ n.start, n.end, std::move(n.classes) });
+        }
+        node = n.right;
+    }
+}
+
+void TextClassTree::extract(uint32_t& root, std::size_t start, std::size_t end, std::vector<Range>& out)
+{
+    // the ranges that start in [start, end) are a subtree of their own, the few that
+    // start before it and reach into it are taken out one at a time
+    uint32_t left, middle, right;
+    split(root, start, 0, left, middle);
+    split(middle, end, 0, middle, right);
+    const std::size_t first = out.size();
+    collect(left, start, end, out);
+    for (std::size_t idx = first; idx < out.size(); ++idx) {
+        uint32_t before, range, after;
+        split(left, out[idx].start, out[idx].end, before, after);
+        split(after, out[idx].start, out[idx].end + 1, range, after);
+        assert(range != Null);
+        destroyTree(range);
+        left = merge(before, after);
+    }
+    collect(middle, start, end, out);
+    destroyTree(middle);
+    root = merge(left, right);
+}
+
+void TextClassTree::remove(uint32_t clazz, std::size_t start, std::size_t end)
+{
+    assert(start < end);
+    std::vector<Range> ranges;
+    extract(mRoot, start, end, ranges);
+    for (auto& range : ranges) {
+        if (!range.classes.contains(clazz)) {
+            insert(range.start, range.end, range.classes);
+            continue;
+        }
+        if (range.start < start) {
+            insert(range.start, start, range.classes);
+        }
+        if (range.end > end) {
+            insert(end, range.end, range.classes);
+        }
+        range.classes.erase(clazz);
+        insert(std::max(range.start, start), std::min(range.end, end), range.classes);
+    }
+}
+
+void TextClassTree::overwrite(uint32_t clazz, std::size_t start, std::size_t end)
+{
+    clear(start, end);
+    insert(start, end, { clazz });
+}
+
+void TextClassTree::clear(std::size_t start, std::size_t end)
+{
+    assert(start < end);
+    std::vector<Range> ranges;
+    extract(mRoot, start, end, ranges);
+    for (const auto& range : ranges) {
+        if (range.start < start) {
+            insert(range.start, start, range.classes);
+        }
+        if (range.end > end) {
+            insert(end, range.end, range.classes);
+        }
+    }
+}
+
+// like TextClassTree::remove with a class and TextClassTree::clear without, the parts of
+// ranges outside [start, end) stay as they were. pieces are added at the end and ranges
+// that lose all their classes are kept without them. returns true if any range was split
+static inline bool splitRanges(std::vector<TextClassTree::Range>& ranges, std::size_t start, std::size_t end,
+                               std::optional<uint32_t> clazz)
+{
+    const std::size_t count = ranges.size();
+    bool split = false;
+    for (std::size_t idx = 0; idx < count; ++idx) {
+        if (ranges[idx].start >= end || ranges[idx].end <= start || ranges[idx].classes.empty()
+            || (clazz && !ranges[idx].classes.contains(*clazz))) {
+            continue;
+        }
+        split = true;
+        TextClassTree::Range range = std::move(ranges[idx]);
+        TextClassSet classes;
+        if (clazz) {
+            classes = range.classes;
+            classes.erase(*clazz);
+        }
+        if (range.start < start) {
+            ranges.push_back({ range.start, start, range.classes });
+        }
+        if (range.end > end) {
+            ranges.push_back({ end, range.end, range.classes });
+        }
+        ranges[idx] = { std::max(range.start, start), std::min(range.end, end), std::move(classes) };
+    }
+    return split;
+}
+
+// ranges with the same start and end become one, the ones without classes go away
+static inline void mergeRanges(std::vector<TextClassTree::Range>& ranges)
+{
+    std::erase_if(ranges, [](const TextClassTree::Range& range) { return range.classes.empty(); });
+    std::sort(ranges.begin(), ranges.end(), [](const TextClassTree::Range& a, const TextClassTree::Range& b) {
+        return a.start < b.start || (a.start == b.start && a.end < b.end);
+    });
+    std::size_t last = 0;
+    for (std::size_t idx = 1; idx < ranges.size(); ++idx) {
+        if (ranges[idx].start == ranges[last].start && ranges[idx].end == ranges[last].end) {
+            ranges[last].classes.insert(ranges[idx].classes);
+        } else if (++last != idx) {
+            ranges[last] = std::move(ranges[idx]);
+        }
+    }
+    ranges.resize(std::min(ranges.size(), last + 1));
+}
+
+void TextClassTree::apply(std::span<const Change> changes)
+{
+    if (changes.empty()) {
+        return;
+    }
+    // sorted by start, changes that start at the same offset keep their order
+    std::vector<uint32_t> order(changes.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [changes](uint32_t a, uint32_t b) {
+        return changes[a].start < changes[b].start;
+    });
+    std::size_t start = std::numeric_limits<std::size_t>::max(), end = 0;
+    for (const auto& change : changes) {
+        assert(change.start < change.end);
+        start = std::min(start, change.start);
+        end = std::max(end, change.end);
+    }
+    std::vector<Range> touched;
+    extract(mRoot, start, end, touched);
+
+    // changes and ranges that overlap form a group, what happens in one can't change the
+    // outcome of another so the groups are made from left to right. the changes in a
+    // group are made in their original order
+    std::vector<Range> out, ranges;
+    std::vector<uint32_t> group;
+    std::size_t nextChange = 0, nextRange = 0;
+    while (nextChange < order.size() || nextRange < touched.size()) {
+        std::size_t groupEnd = 0;
+        group.clear();
+        ranges.clear();
+        while (true) {
+            const bool changeFirst = nextChange < order.size()
+                && (nextRange == touched.size() || changes[order[nextChange]].start <= touched[nextRange].start);
+            const std::size_t itemStart = changeFirst ? changes[order[nextChange]].start
+                : nextRange < touched.size() ? touched[nextRange].start : std::numeric_limits<std::size_t>::max();
+            if (itemStart == std::numeric_limits<std::size_t>::max() || (groupEnd > 0 && itemStart >= groupEnd)) {
+                break;
+            }
+            if (changeFirst) {
+                group.push_back(order[nextChange++]);
+                groupEnd = std::max(groupEnd, changes[group.back()].end);
+            } else {
+                ranges.push_back(std::move(touched[nextRange++]));
+                groupEnd = std::max(groupEnd, ranges.back().end);
+            }
+        }
+        std::sort(group.begin(), group.end());
+
+        // added ranges and pieces may have the same start and end as others. they're merged
+        // when a remove needs to know which ranges have a class and when they go back in
+        bool merged = true;
+        for (const auto idx : group) {
+            const auto& change = changes[idx];
+            switch (change.type) {
+            case Change::Type::Add:
+                ranges.push_back({ change.start, change.end, { change.clazz } });
+                merged = false;
+                break;
+            case Change::Type::Remove:
+                if (!merged) {
+                    mergeRanges(ranges);
+                }
+                merged = !splitRanges(ranges, change.start, change.end, change.clazz);
+                break;
+            case Change::Type::Overwrite:
+            case Change::Type::Clear:
+                merged = !splitRanges(ranges, change.start, change.end, std::nullopt) && merged;
+                if (change.type == Change::Type::Overwrite) {
+                    ranges.push_back({ change.start, change.end, { change.clazz } });
+                    merged = false;
+                }
+                break;
+            }
+        }
+        for (auto& range : ranges) {
+            if (!range.classes.empty()) {
+                out.push_back(std::move(range));
+            }
+        }
+    }
+    insert(std::move(out));
+}
+
+void TextClassTree::edit(std::size_t offset, std::size_t removed, std::size_t inserted)
+{
+    if (mRoot == Null || (removed == 0 && inserted == 0)) {
+        return;
+    }
+    // the ranges that start after the removed text only move
+    uint32_t left, right;
+    split(mRoot, offset + removed, 0, left, right);
+    shift(right, static_cast<std::ptrdiff_t>(inserted) - static_cast<std::ptrdiff_t>(removed));
+
+    // the ones before it that reach into it or past it change size
+    std::vector<Range> touched;
+    extract(left, offset, std::numeric_limits<std::size_t>::max(), touched);
+    mRoot = merge(left, right);
+
+    auto shiftStart = [=](std::size_t pos) -> std::size_t {
+        if (pos < offset) {
+            return pos;
+        }
+        return pos >= offset + removed ? pos - removed + inserted : offset + inserted;
+    };
+    auto shiftEnd = [=](std::size_t pos) -> std::size_t {
+        if (pos <= offset) {
+            return pos;
+        }
+        return pos >= offset + removed ? pos - removed + inserted : offset;
+    };
+    for (const auto& range : touched) {
+        const std::size_t start = shiftStart(range.start);
+        const std::size_t end = shiftEnd(range.end);
+        if (start < end) {
+            insert(start, end, range.classes);
+        }
+    }
+}
@@ -0,0 +1,224 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <limits>
+#include <memory>
+#include <span>
+#include <vector>
+
+namespace spurv {
+
+// the text classes of a range, a handful of them are kept inline
+class TextClassSet
+{
+public:
+    TextClassSet() = default;
+    TextClassSet(std::initializer_list<uint32_t> classes);
+    TextClassSet(std::span<const uint32_t> classes);
+    TextClassSet(const TextClassSet& other);
+    TextClassSet(TextClassSet&& other) noexcept;
+
+    TextClassSet& operator=(const TextClassSet& other);
+    TextClassSet& operator=(TextClassSet&& other) noexcept;
+
+    bool empty() const;
+    std::size_t size() const;
+    bool contains(uint32_t clazz) const;
+    bool isOnly(uint32_t clazz) const;
+
+    // classes keep the order they were added in
+    void insert(uint32_t clazz);
+    void insert(const TextClassSet& classes);
+    void erase(uint32_t clazz);
+
+    std::span<const uint32_t> classes() const;
+
+    static constexpr std::size_t InlineSize = 3;
+
+private:
+    uint32_t* data();
+    const uint32_t* data() const;
+
+private:
+    uint32_t mSize = 0;
+    uint32_t mInline[InlineSize] = {};
+    // all the classes once there are more than fit inline
+    std::unique_ptr<std::vector<uint32_t>> mOverflow;
+};
+
+/*
+   TextClassTree holds ranges of text classes. Ranges may overlap, two ranges
+   with the same start and end are a single one with the classes of both.
+
+   It's a treap ordered by start and then end, where each node also knows the
+   biggest end in its subtree so that the ranges overlapping a query are found
+   in O(log n + k). Nodes live in one vector and refer to each other by index.
+
+   Edits to the text shift every range after them. That's a lazy shift on a
+   subtree, only the ranges that the edit touches are visited.
+*/
+
+class TextClassTree
+{
+public:
+    TextClassTree();
+
+    struct Range
+    {
+        std::size_t start, end;
+        TextClassSet classes;
+    };
+
+    bool empty() const;
+    std::size_t size() const;
+    void clear();
+
+    // merges classes into the range if it's already there
+    void insert(std::size_t start, std::size_t end, const TextClassSet& classes);
+    // the same for many ranges, in any order. it's O(n + log size()) if none of the
+    // ranges in the tree sort between the new ones, as in an empty tree
+    void insert(std::vector<Range>&& ranges);
+    // adds clazz to the range [start, end), which becomes a range of its own
+    void add(uint32_t clazz, std::size_t start, std::size_t end);
+    // removes clazz from [start, end), ranges sticking out of it are split
+    void remove(uint32_t clazz, std::size_t start, std::size_t end);
+    // replaces all classes in [start, end) with clazz
+    void overwrite(uint32_t clazz, std::size_t start, std::size_t end);
+    // removes all classes in [start, end)
+    void clear(std::size_t start, std::size_t end);
+
+    struct Change
+    {
+        enum class Type { Add, Remove, Overwrite, Clear };
+        Type type;
+        uint32_t clazz;
+        std::size_t start, end;
+    };
+    // the same as making the changes one after the other. they're sorted by range and the
+    // ranges they touch are taken out of the tree once, changed, and put back in one batch
+    void apply(std::span<const Change> changes);
+
+    // moves the ranges along with the text when removed code units at offset are
+    // replaced with inserted ones. text inserted at either end of a range isn't part of it
+    void edit(std::size_t offset, std::size_t removed, std::size_t inserted);
+
+    // calls func(start, end, classes) for each range overlapping [start, end), in order
+    template<typename Func>
+    void forEachOverlapping(std::size_t start, std::size_t end, Func&& func) const;
+
+private:
+    static constexpr uint32_t Null = 0;
+
+    struct Node
+    {
+        std::size_t start = 0, end = 0;
+        // the biggest end in the subtree
+        std::size_t maxEnd = 0;
+        // shift that still has to be applied to the children's subtrees
+        std::ptrdiff_t pending = 0;
+        uint32_t left = Null, right = Null;
+        uint32_t priority = 0;
+        TextClassSet classes;
+    };
+
+    uint32_t createNode(std::size_t start, std::size_t end, const TextClassSet& classes);
+    void destroyNode(uint32_t node);
+    void destroyTree(uint32_t node);
+    void shift(uint32_t node, std::ptrdiff_t delta);
+    void push(uint32_t node);
+    void update(uint32_t node);
+    void updateTree(uint32_t node);
+    // a treap of sorted ranges, in O(n)
+    uint32_t build(const std::vector<Range>& ranges);
+    // left gets the ranges before (start, end)
+    void split(uint32_t node, std::size_t start, std::size_t end, uint32_t& left, uint32_t& right);
+    uint32_t merge(uint32_t left, uint32_t right);
+    // takes the ranges overlapping [start, end) out of the tree
+    void extract(uint32_t& root, std::size_t start, std::size_t end, std::vector<Range>& out);
+    // moves the classes out, the nodes are about to be destroyed
+    void collect(uint32_t node, std::size_t start, std::size_t end, std::vector<Range>& out);
+
+    template<typename Func>
+    void visit(uint32_t node, std::ptrdiff_t offset, std::size_t start, std::size_t end, Func& func) const;
+
+private:
+    // node 0 is the null node
+    std::vector<Node> mNodes;
+    std::vector<uint32_t> mFree;
+    uint32_t mRoot = Null;
+    std::size_t mSize = 0;
+    uint32_t mSeed = 0x9e3779b9;
+};
+
+inline bool TextClassSet::empty() const
+{
+    return mSize == 0;
+}
+
+inline std::size_t TextClassSet::size() const
+{
+    return mSize;
+}
+
+inline uint32_t* TextClassSet::data()
+{
+    return mOverflow ? mOverflow->data() : mInline;
+}
+
+inline const uint32_t* TextClassSet::data() const
+{
+    return mOverflow ? mOverflow->data() : mInline;
+}
+
+inline std::span<const uint32_t> TextClassSet::classes() const
+{
+    return { data(), mSize };
+}
+
+inline bool TextClassSet::isOnly(uint32_t clazz) const
+{
+    return mSize == 1 && data()[0] == clazz;
+}
+
+inline bool TextClassTree::empty() const
+{
+    return mSize == 0;
+}
+
+inline std::size_t TextClassTree::size() const
+{
+    return mSize;
+}
+
+template<typename Func>
+inline void TextClassTree::forEachOverlapping(std::size_t start, std::size_t end, Func&& func) const
+{
+    visit(mRoot, 0, start, end, func);
+}
+
+template<typename Func>
+void TextClassTree::visit(uint32_t node, std::ptrdiff_t offset, std::size_t start, std::size_t end, Func& func) const
+{
+    // queries don't push the pending shifts down, they carry them instead
+    while (node != Null) {
+        const Node& n = mNodes[node];
+        if (n.maxEnd + offset <= start) {
+            return;
+        }
+        const std::ptrdiff_t childOffset = offset + n.pending;
+        visit(n.left, childOffset, start, end, func);
+        const std::size_t nodeStart = n.start + offset;
+        if (nodeStart >= end) {
+            return;
+        }
+        if (n.end + offset > start) {
+            func(nodeStart, n.end + offset, n.classes.classes());
+        }
+        node = n.right;
+        offset = childOffset;
+    }
+}
+
+} // namespace spurv
@@ -33,6 +33,7 @@ uint32_t TextClasses::registerTextClass(const std::string& name)
             nextAvailable = idx;
         }
     }
+    ++mGeneration;
     if (nextAvailable < sz) {
         mRegisteredClasses[nextAvailable] = std::move(selector);
         return nextAvailable + 1;
@@ -49,6 +50,7 @@ bool TextClasses::unregisterTextClass(uint32_t clazz)
     }
     if (clazz < mRegisteredClasses.size() && mRegisteredClasses[clazz - 1].has_value()) {
         mRegisteredClasses[clazz - 1] = {};
+        ++mGeneration;
         return true;
     }
     return false;
@@ -57,4 +59,5 @@ bool TextClasses::unregisterTextClass(uint32_t clazz)
 void TextClasses::clearRegisteredTextClasses()
 {
     mRegisteredClasses.clear();
+    ++mGeneration;
 }
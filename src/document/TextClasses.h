@@ -22,8 +22,12 @@ public:
     bool unregisterTextClass(uint32_t clazz);
     void clearRegisteredTextClasses();
 
+    // bumped whenever a class is registered or unregistered
+    uint64_t generation() const;
+
 private:
     std::vector<std::optional<qss::Selector>> mRegisteredClasses;
+    uint64_t mGeneration = 1;
 
 private:
     static std::unique_ptr<TextClasses> sInstance;
@@ -38,4 +42,9 @@ private:
     TextClasses& operator=(const TextClasses&) = delete;
 };
 
+inline uint64_t TextClasses::generation() const
+{
+    return mGeneration;
+}
+
 } // namespace spurv
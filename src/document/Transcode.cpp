@@ -0,0 +1,197 @@
+#include "Transcode.h"
+#include <Logger.h>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// number of bytes looked at when detecting the encoding
+static constexpr std::size_t EncodingSampleSize = 65536;
+// number of utf-32 code units byte swapped at a time, small enough to stay in L1
+static constexpr std::size_t SwapBlockSize = 1024;
+
+static inline std::size_t convertUtf32beToUtf16(const uint32_t* data, std::size_t size, char16_t* out)
+{
+    // simdutf only converts native endian utf-32, swap a block at a time so
+    // that the swapped data is still in cache when it's being converted
+    char32_t block[SwapBlockSize];
+    std::size_t words = 0;
+    for (std::size_t off = 0; off < size; off += SwapBlockSize) {
+        const std::size_t num = std::min(size - off, SwapBlockSize);
+        for (std::size_t n = 0; n < num; ++n) {
+            block[n] = static_cast<char32_t>(__builtin_bswap32(data[off + n]));
+        }
+        const std::size_t converted = simdutf::convert_utf32_to_utf16(block, num, out + words);
+        if (converted == 0) {
+            return 0;
+        }
+        words += converted;
+    }
+    return words;
+}
+
+// what the utf-32 conversions fall back to when they fail, anything that isn't
+// a code point becomes a replacement character so that no text is lost
+static inline std::size_t convertUtf32ToUtf16Replacing(const uint32_t* data, std::size_t size, bool swap, char16_t* out)
+{
+    std::size_t words = 0;
+    for (std::size_t n = 0; n < size; ++n) {
+        const uint32_t cp = swap ? __builtin_bswap32(data[n]) : data[n];
+        if (cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF)) {
+            out[words++] = u'\uFFFD';
+        } else if (cp >= 0x10000) {
+            out[words++] = static_cast<char16_t>(0xD800 + ((cp - 0x10000) >> 10));
+            out[words++] = static_cast<char16_t>(0xDC00 + ((cp - 0x10000) & 0x3FF));
+        } else {
+            out[words++] = static_cast<char16_t>(cp);
+        }
+    }
+    return words;
+}
+
+namespace spurv {
+
+simdutf::encoding_type detectEncoding(const char* data, std::size_t size, bool last, std::size_t& bomSize)
+{
+    const auto bom = simdutf::BOM::check_bom(reinterpret_cast<const uint8_t*>(data), size);
+    if (bom != simdutf::unspecified) {
+        bomSize = simdutf::BOM::bom_byte_size(bom);
+        return bom;
+    }
+    bomSize = 0;
+
+    const std::size_t sample = std::min(size, EncodingSampleSize);
+    auto encoding = simdutf::autodetect_encoding(data, sample);
+    if (encoding != simdutf::UTF8 && (!last || sample < size)) {
+        // a multibyte sequence cut in half at the end of the sample makes utf-8 look invalid
+        const std::size_t trimmed = simdutf::trim_partial_utf8(data, sample);
+        if (trimmed > 0 && trimmed < sample && simdutf::autodetect_encoding(data, trimmed) == simdutf::UTF8) {
+            encoding = simdutf::UTF8;
+        }
+    }
+    return encoding;
+}
+
+std::size_t codePointBoundary(simdutf::encoding_type encoding, const char* data, std::size_t size, bool last)
+{
+    switch (encoding) {
+    case simdutf::UTF8:
+        if (!last) {
+            const std::size_t trimmed = simdutf::trim_partial_utf8(data, size);
+            // invalid utf-8 might not have a boundary at all, we'll fall back to latin1 for those
+            if (trimmed > 0) {
+                return trimmed;
+            }
+        }
+        return size;
+    case simdutf::UTF16_BE:
+    case simdutf::UTF16_LE: {
+        std::size_t utf16len = size / sizeof(char16_t);
+        if (!last && utf16len > 1) {
+            // don't split a surrogate pair
+            uint16_t unit;
+            memcpy(&unit, data + (utf16len - 1) * sizeof(char16_t), sizeof(unit));
+            if (encoding == simdutf::UTF16_BE) {
+                unit = __builtin_bswap16(unit);
+            }
+            if (unit >= 0xD800 && unit <= 0xDBFF) {
+                --utf16len;
+            }
+        }
+        return utf16len * sizeof(char16_t); }
+    case simdutf::UTF32_BE:
+    case simdutf::UTF32_LE:
+        return (size / sizeof(char32_t)) * sizeof(char32_t);
+    default:
+        break;
+    }
+    return size;
+}
+
+std::size_t maxUtf16Length(simdutf::encoding_type encoding, std::size_t size)
+{
+    switch (encoding) {
+    case simdutf::Latin1:
+    case simdutf::UTF8:
+        return size;
+    case simdutf::UTF16_BE:
+    case simdutf::UTF16_LE:
+        return size / sizeof(char16_t);
+    case simdutf::UTF32_BE:
+    case simdutf::UTF32_LE:
+        // a surrogate pair at most
+        return (size / sizeof(char32_t)) * 2;
+    default:
+        break;
+    }
+    return 0;
+}
+
+std::size_t maxBytesForUtf16Length(simdutf::encoding_type encoding, std::size_t units)
+{
+    switch (encoding) {
+    case simdutf::Latin1:
+    case simdutf::UTF8:
+        return units;
+    case simdutf::UTF16_BE:
+    case simdutf::UTF16_LE:
+        return units * sizeof(char16_t);
+    case simdutf::UTF32_BE:
+    case simdutf::UTF32_LE:
+        return (units / 2) * sizeof(char32_t);
+    default:
+        break;
+    }
+    return 0;
+}
+
+std::size_t transcodeToUtf16(simdutf::encoding_type encoding, const char* data, std::size_t size, char16_t* out)
+{
+    switch (encoding) {
+    case simdutf::Latin1:
+        return simdutf::convert_latin1_to_utf16(data, size, out);
+    case simdutf::UTF8: {
+        const std::size_t words = simdutf::convert_utf8_to_utf16(data, size, out);
+        if (words == 0 && size > 0) {
+            spdlog::warn("Invalid utf-8, treating chunk as latin1");
+            return simdutf::convert_latin1_to_utf16(data, size, out);
+        }
+        return words; }
+    case simdutf::UTF16_BE:
+    case simdutf::UTF16_LE: {
+        const std::size_t utf16len = size / sizeof(char16_t);
+        if (encoding == simdutf::UTF16_BE) {
+            simdutf::change_endianness_utf16(reinterpret_cast<const char16_t*>(data), utf16len, out);
+        } else {
+            memcpy(out, data, utf16len * sizeof(char16_t));
+        }
+        return utf16len; }
+    case simdutf::UTF32_BE: {
+        const std::size_t utf32len = size / sizeof(char32_t);
+        const std::size_t words = convertUtf32beToUtf16(reinterpret_cast<const uint32_t*>(data), utf32len, out);
+        if (words == 0 && utf32len > 0) {
+            spdlog::warn("Invalid utf-32, replacing what isn't a code point");
+            return convertUtf32ToUtf16Replacing(reinterpret_cast<const uint32_t*>(data), utf32len, true, out);
+        }
+        return words; }
+    case simdutf::UTF32_LE: {
+        const std::size_t utf32len = size / sizeof(char32_t);
+        const std::size_t words = simdutf::convert_utf32_to_utf16(reinterpret_cast<const char32_t*>(data), utf32len, out);
+        if (words == 0 && utf32len > 0) {
+            spdlog::warn("Invalid utf-32, replacing what isn't a code point");
+            return convertUtf32ToUtf16Replacing(reinterpret_cast<const uint32_t*>(data), utf32len, false, out);
+        }
+        return words; }
+    default:
+        break;
+    }
+    return 0;
+}
+
+void transcodeToUtf16(simdutf::encoding_type encoding, const char* data, std::size_t size, std::u16string& text)
+{
+    text.resize(maxUtf16Length(encoding, size));
+    text.resize(transcodeToUtf16(encoding, data, size, text.data()));
+}
+
+} // namespace spurv
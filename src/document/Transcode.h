@@ -0,0 +1,27 @@
+#pragma once
+
+#include <simdutf.h>
+#include <string>
+#include <cstddef>
+
+namespace spurv {
+
+// detects the encoding of data, a byte order mark takes precedence over the contents
+// bomSize is set to the number of bytes the byte order mark occupies, if any.
+// last should be false if data is only the start of the text
+simdutf::encoding_type detectEncoding(const char* data, std::size_t size, bool last, std::size_t& bomSize);
+
+// returns the number of bytes at the start of data that end on a code point boundary
+std::size_t codePointBoundary(simdutf::encoding_type encoding, const char* data, std::size_t size, bool last);
+
+// the most utf-16 code units that size bytes of data can transcode to
+std::size_t maxUtf16Length(simdutf::encoding_type encoding, std::size_t size);
+// the most bytes of data that always fit in units utf-16 code units
+std::size_t maxBytesForUtf16Length(simdutf::encoding_type encoding, std::size_t units);
+
+// transcodes data, which must end on a code point boundary, to utf-16
+void transcodeToUtf16(simdutf::encoding_type encoding, const char* data, std::size_t size, std::u16string& text);
+// same, but writes to out which must have room for maxUtf16Length code units. returns the number written
+std::size_t transcodeToUtf16(simdutf::encoding_type encoding, const char* data, std::size_t size, char16_t* out);
+
+} // namespace spurv
@@ -2,15 +2,31 @@
 #include "View.h"
 #include <Logger.h>
 #include <TextClasses.h>
+#include <algorithm>
+#include <functional>
+#include <span>
 
 using namespace spurv;
 
-static inline uint32_t endClusterForLine(const Layout::LineInfo& line)
+// the length of the line, the line doesn't need to be shaped
+static inline uint32_t endClusterForLine(const Layout& layout, std::size_t line)
 {
-    if (line.endCluster == line.startCluster + 1) {
+    return static_cast<uint32_t>(layout.lineEndOffset(line) - layout.lineOffset(line));
+}
+
+// the first glyph of cluster or clusters.size(). clusters go up in left to
+// right text and down in right to left text so this is a binary search
+static inline uint32_t glyphForCluster(std::span<const uint32_t> clusters, uint32_t cluster)
+{
+    if (clusters.empty()) {
         return 0;
     }
-    return line.endCluster - line.startCluster;
+    if (clusters.front() <= clusters.back()) {
+        const auto it = std::lower_bound(clusters.begin(), clusters.end(), cluster);
+        return it != clusters.end() && *it == cluster ? it - clusters.begin() : clusters.size();
+    }
+    const auto it = std::lower_bound(clusters.begin(), clusters.end(), cluster, std::greater<uint32_t>());
+    return it != clusters.end() && *it == cluster ? it - clusters.begin() : clusters.size();
 }
 
 Cursor::Cursor()
@@ -82,10 +98,10 @@ void Cursor::setPosition(std::size_t line, uint32_t cluster)
     if (line >= numLines) {
         return;
     }
-    const auto& lineInfo = layout.lineAt(line);
-    if (lineInfo.startCluster + cluster > lineInfo.endCluster) {
+    const auto lineEndCluster = endClusterForLine(layout, line);
+    if (cluster > lineEndCluster) {
         mLine = line;
-        mCluster = endClusterForLine(lineInfo);
+        mCluster = lineEndCluster;
     } else {
         mLine = line;
         mCluster = mRetainedCluster = cluster;
@@ -102,11 +118,10 @@ size_t Cursor::offset() const
     if (mLine >= numLines) {
         return 0;
     }
-    const auto& lineInfo = layout.lineAt(mLine);
-    if (lineInfo.startCluster + mCluster > lineInfo.endCluster) {
+    if (mCluster > endClusterForLine(layout, mLine)) {
         return 0;
     }
-    return lineInfo.startCluster + mCluster;
+    return layout.lineOffset(mLine) + mCluster;
 }
 
 void Cursor::setOffset(std::size_t cluster)
@@ -116,23 +131,18 @@ void Cursor::setOffset(std::size_t cluster)
     }
     const auto& layout = mView->document()->mLayout;
     const auto numLines = layout.numLines();
-    for (std::size_t line = 0; line < numLines; ++line) {
-        const auto& lineInfo = layout.lineAt(line);
-        if (lineInfo.endCluster >= cluster) {
-            mLine = line;
-            mCluster = mRetainedCluster = lineInfo.endCluster - cluster;
-            return;
-        }
-    }
     // outside the document?
     if (numLines == 0) {
         mLine = 0;
         mCluster = mRetainedCluster = 0;
-    } else {
-        mLine = numLines - 1;
-        const auto& lineInfo = layout.lineAt(mLine);
-        mCluster = mRetainedCluster = lineInfo.endCluster - 1;
+        return;
     }
+    // clusters are offsets in the text
+    const std::size_t line = layout.lineForOffset(cluster);
+    const std::size_t lineStart = layout.lineOffset(line);
+    const std::size_t lineEnd = layout.lineEndOffset(line);
+    mLine = line;
+    mCluster = mRetainedCluster = static_cast<uint32_t>(std::min(cluster, lineEnd) - std::min(cluster, lineStart));
 }
 
 bool Cursor::navigate(Navigate nav)
@@ -146,34 +156,41 @@ bool Cursor::navigate(Navigate nav)
         return false;
     }
     const auto& lineInfo = layout.lineAt(mLine);
-    if (lineInfo.startCluster + mCluster > lineInfo.endCluster) {
+    const auto lineEndCluster = endClusterForLine(layout, mLine);
+    if (mCluster > lineEndCluster) {
         return false;
     }
-    const auto lineEndCluster = endClusterForLine(lineInfo);
 
     auto relativeCluster = [cluster = &mCluster](const Layout::LineInfo& lineInfo, int32_t dir) -> uint32_t {
-        if (!lineInfo.buffer) {
+        if (!lineInfo.glyphs.isValid()) {
             return *cluster;
         }
-        uint32_t highLineCluster = 0;
-        uint32_t glyphCount;
-        auto glyphInfo = hb_buffer_get_glyph_infos(lineInfo.buffer, &glyphCount);
-        for (uint32_t gi = 0; gi < glyphCount; ++gi) {
-            if (glyphInfo[gi].cluster == *cluster) {
-                if (dir < 0 && static_cast<uint32_t>(abs(dir)) <= gi) {
-                    return glyphInfo[gi + dir].cluster;
-                } else if (dir >= 0 && gi + dir < glyphCount) {
-                    return glyphInfo[gi + dir].cluster;
-                }
+        if (lineInfo.isPartial() && *cluster >= lineInfo.shapedLength) {
+            // past the part of a long line that's shaped, move a code unit at a time
+            const int64_t next = static_cast<int64_t>(*cluster) + dir;
+            if (next < 0 || next > static_cast<int64_t>(lineInfo.endOffset - lineInfo.startOffset)) {
                 return std::numeric_limits<uint32_t>::max();
-            } else if (glyphInfo[gi].cluster > highLineCluster) {
-                highLineCluster = glyphInfo[gi].cluster;
             }
+            return static_cast<uint32_t>(next);
         }
+        const auto clusters = lineInfo.glyphs.clusters();
+        const uint32_t glyphCount = clusters.size();
+        const uint32_t gi = glyphForCluster(clusters, *cluster);
+        if (gi < glyphCount) {
+            if (dir < 0 && static_cast<uint32_t>(abs(dir)) <= gi) {
+                return clusters[gi + dir];
+            } else if (dir >= 0 && gi + dir < glyphCount) {
+                return clusters[gi + dir];
+            } else if (dir > 0 && lineInfo.isPartial()) {
+                return lineInfo.shapedLength;
+            }
+            return std::numeric_limits<uint32_t>::max();
+        }
+        const uint32_t highLineCluster = glyphCount > 0 ? std::max(clusters.front(), clusters.back()) : 0;
         if (*cluster == highLineCluster + 1) {
             if (dir < 0) { // at end of line
                 if (static_cast<uint32_t>(abs(dir)) <= highLineCluster + 1) {
-                    return glyphInfo[highLineCluster + 1 + dir].cluster;
+                    return clusters[highLineCluster + 1 + dir];
                 }
             } else if (dir == 0) {
                 return *cluster;
@@ -201,8 +218,7 @@ bool Cursor::navigate(Navigate nav)
             // previous line?
             if (mLine > 0) {
                 mLine -= 1;
-                const auto& newLineInfo = layout.lineAt(mLine);
-                mCluster = mRetainedCluster = endClusterForLine(newLineInfo);
+                mCluster = mRetainedCluster = endClusterForLine(layout, mLine);
             }
         } else {
             mCluster = mRetainedCluster = newCluster;
@@ -215,8 +231,7 @@ bool Cursor::navigate(Navigate nav)
             mCluster = mRetainedCluster;
             mCluster = relativeCluster(layout.lineAt(mLine), 0);
             if (mCluster == std::numeric_limits<uint32_t>::max()) {
-                const auto& newLineInfo = layout.lineAt(mLine);
-                mCluster = endClusterForLine(newLineInfo);
+                mCluster = endClusterForLine(layout, mLine);
             }
         }
         break;
@@ -227,8 +242,7 @@ bool Cursor::navigate(Navigate nav)
             mCluster = mRetainedCluster;
             mCluster = relativeCluster(layout.lineAt(mLine), 0);
             if (mCluster == std::numeric_limits<uint32_t>::max()) {
-                const auto& newLineInfo = layout.lineAt(mLine);
-                mCluster = endClusterForLine(newLineInfo);
+                mCluster = endClusterForLine(layout, mLine);
             }
         }
         break;
@@ -247,12 +261,13 @@ bool Cursor::navigate(Navigate nav)
             }
         } else {
             // find the next word
-            const auto& words = lineInfo.wordBreaks;
+            const auto words = lineInfo.glyphs.wordBreaks();
             auto it = std::find_if(words.begin(), words.end(), [cluster = mCluster](auto wordBreak) -> bool {
                 return wordBreak > cluster;
             });
-            assert(it != words.end());
-            mCluster = mRetainedCluster = *it;
+            // the part of a long line that isn't shaped has no word breaks
+            assert(it != words.end() || lineInfo.isPartial());
+            mCluster = mRetainedCluster = it != words.end() ? *it : lineEndCluster;
         }
         break;
     case Navigate::WordBackward:
@@ -260,17 +275,16 @@ bool Cursor::navigate(Navigate nav)
             if (mLine > 0) {
                 mLine -= 1;
                 // now at end of line
-                const auto& newLineInfo = layout.lineAt(mLine);
-                mCluster = mRetainedCluster = endClusterForLine(newLineInfo);
+                mCluster = mRetainedCluster = endClusterForLine(layout, mLine);
             }
         } else {
             // find the previous word
-            const auto& words = lineInfo.wordBreaks;
+            const auto words = lineInfo.glyphs.wordBreaks();
             auto it = std::find_if(words.begin(), words.end(), [cluster = mCluster](auto wordBreak) -> bool {
                 return wordBreak >= cluster;
             });
-            assert(it != words.begin() && it != words.end());
-            mCluster = mRetainedCluster = *(it - 1);
+            assert(it != words.begin() && (it != words.end() || lineInfo.isPartial()));
+            mCluster = mRetainedCluster = it != words.begin() ? *(it - 1) : 0;
         }
         break;
     }
@@ -285,12 +299,7 @@ uint32_t Cursor::globalCluster() const
     if (mLine >= numLines) {
         return std::numeric_limits<uint32_t>::max();
     }
-    auto c = mCluster;
-    if (mLine > 0) {
-        const auto& lineInfo = layout.lineAt(mLine - 1);
-        c += lineInfo.endCluster;
-    }
-    return c;
+    return static_cast<uint32_t>(layout.lineOffset(mLine) + mCluster);
 }
 
 void Cursor::setVisible(bool v)
@@ -1,6 +1,7 @@
 #include "Editor.h"
 #include "Cursor.h"
 #include "View.h"
+#include <CLexer.h>
 #include <Logger.h>
 #include <MainEventLoop.h>
 #include <Renderer.h>
@@ -11,6 +12,7 @@
 #include <Promise.h>
 #include <uv.h>
 #include <Thread.h>
+#include <Transcode.h>
 
 using namespace spurv;
 
@@ -176,11 +178,86 @@ void Editor::thread_internal()
                     // ### could reject the previous one
                     return ScriptValue::makeError("Already loading");
                 }
+                auto mode = Document::LoadMode::Mapped;
+                if (args.size() > 1) {
+                    auto modeName = args[1].toString();
+                    if (!modeName.ok()) {
+                        return ScriptValue::makeError("Bad arg");
+                    }
+                    if (*modeName == "read") {
+                        mode = Document::LoadMode::Read;
+                    } else if (*modeName != "mapped") {
+                        return ScriptValue::makeError("Invalid load mode");
+                    }
+                }
                 d->loadPromise = std::make_shared<Promise>();
-                d->document->load(std::filesystem::path(*path));
+                d->document->load(std::filesystem::path(*path), mode);
                 return d->loadPromise->value();
             });
 
+            // offsets and lengths are in utf-16 code units, like js strings
+            auto edit = [](ScriptClassInstance *instance, std::vector<ScriptValue> &&args, bool remove, bool insert) -> ScriptValue {
+                DocumentInstance *d = static_cast<DocumentInstance *>(instance);
+                if (!d->document->isReady()) {
+                    return ScriptValue::makeError("Document not ready");
+                }
+                const std::size_t numArgs = 1 + (remove ? 1 : 0) + (insert ? 1 : 0);
+                if (args.size() < numArgs) {
+                    return ScriptValue::makeError("Not enough arguments");
+                }
+                auto offset = args[0].toUint();
+                if (!offset.ok()) {
+                    return ScriptValue::makeError("Bad arg");
+                }
+                uint32_t length = 0;
+                if (remove) {
+                    auto len = args[1].toUint();
+                    if (!len.ok()) {
+                        return ScriptValue::makeError("Bad arg");
+                    }
+                    length = *len;
+                }
+                std::u16string text;
+                if (insert) {
+                    auto str = args[numArgs - 1].toString();
+                    if (!str.ok()) {
+                        return ScriptValue::makeError("Bad arg");
+                    }
+                    transcodeToUtf16(simdutf::UTF8, str->data(), str->size(), text);
+                }
+                d->document->replace(*offset, length, text);
+                return {};
+            };
+            clazz.addMethod("insert", [edit](ScriptClassInstance *instance, std::vector<ScriptValue> &&args) -> ScriptValue {
+                return edit(instance, std::move(args), false, true);
+            });
+            clazz.addMethod("remove", [edit](ScriptClassInstance *instance, std::vector<ScriptValue> &&args) -> ScriptValue {
+                return edit(instance, std::move(args), true, false);
+            });
+            clazz.addMethod("replace", [edit](ScriptClassInstance *instance, std::vector<ScriptValue> &&args) -> ScriptValue {
+                return edit(instance, std::move(args), true, true);
+            });
+
+            // "c" highlights the document as c, an empty string turns highlighting off
+            clazz.addMethod("setSyntax", [](ScriptClassInstance *instance, std::vector<ScriptValue> &&args) -> ScriptValue {
+                if (args.empty()) {
+                    return ScriptValue::makeError("Not enough arguments");
+                }
+                auto name = args[0].toString();
+                if (!name.ok()) {
+                    return ScriptValue::makeError("Bad arg");
+                }
+                DocumentInstance *d = static_cast<DocumentInstance *>(instance);
+                if (*name == "c") {
+                    d->document->setSyntaxLexer(std::make_shared<CLexer>());
+                } else if (name->empty()) {
+                    d->document->setSyntaxLexer({});
+                } else {
+                    return ScriptValue::makeError("Unknown syntax");
+                }
+                return {};
+            });
+
             ScriptEngine::scriptEngine()->addClass(std::move(clazz));
         }
 
@@ -374,6 +451,7 @@ void Editor::setName(const std::string& name)
     mName = name;
     if (mContainer) {
         mContainer->mutableSelector()[0].id(name);
+        mContainer->invalidateStyle();
     }
 }
 
@@ -22,6 +22,8 @@ public:
 
 protected:
     virtual void updateLayout(const Rect& rect) override;
+    // the rect inside the border and padding
+    const Rect& contentRect() const;
 
 private:
     void extractRenderViewData();
@@ -40,4 +42,9 @@ inline uint64_t Frame::frameNo() const
     return mFrameNo;
 }
 
+inline const Rect& Frame::contentRect() const
+{
+    return mRenderViewData.content;
+}
+
 } // namespace spurv
@@ -7,6 +7,9 @@
 
 using namespace spurv;
 
+// ### should be based on the height of the view and the line height
+static constexpr std::size_t MaxVisibleLines = 500;
+
 View::View()
 {
     setSelector("view");
@@ -24,20 +27,13 @@ void View::processDocument()
     const uint64_t nm = frameNo();
     auto renderer = Renderer::instance();
     renderer->setPropertyFloat(nm, Renderer::Property::FirstLine, static_cast<float>(mFirstLine));
-    renderer->clearTextProperties(nm);
+    renderer->clearTextSpans(nm);
     spdlog::info("view process doc {}", mDocument->numLines());
     if (mDocument->numLines() == 0) {
         // no text
         renderer->clearTextLines(nm);
     } else {
-        auto textLines = mDocument->textForRange(0, std::min<std::size_t>(mDocument->numLines(), 500));
-        renderer->addTextLines(nm, std::move(textLines));
-
-        auto props = mDocument->propertiesForRange(0, std::min<std::size_t>(mDocument->numLines(), 500));
-        for (auto& prop : props) {
-            spdlog::debug("prop {}-{}, color {}", prop.start, prop.end, prop.foreground);
-        }
-        renderer->addTextProperties(nm, std::move(props));
+        updateText();
 
         // start animating the first line just for shits and giggles
         // auto loop = EventLoop::eventLoop();
@@ -57,11 +53,111 @@ void View::processDocument()
     }
 }
 
+// sends the visible rows and the properties of their lines to the renderer
+void View::updateText()
+{
+    const uint64_t nm = frameNo();
+    auto renderer = Renderer::instance();
+    const std::size_t lastRow = std::min<std::size_t>(mDocument->numRows(), mFirstLine + MaxVisibleLines);
+    auto textLines = mDocument->textForRows(mFirstLine, lastRow);
+    renderer->addTextLines(nm, std::move(textLines));
+
+    const std::size_t firstLine = mDocument->lineForRow(mFirstLine);
+    const std::size_t lastLine = lastRow > mFirstLine ? mDocument->lineForRow(lastRow - 1) + 1 : firstLine;
+    auto spans = mDocument->spansForRange(firstLine, lastLine);
+    updatePalette(true);
+    renderer->setTextSpans(nm, std::move(spans));
+}
+
+// sends the styles of the visible lines in [startLine, endLine) that changed
+void View::updateSpans(std::size_t startLine, std::size_t endLine)
+{
+    const std::size_t lastRow = std::min<std::size_t>(mDocument->numRows(), mFirstLine + MaxVisibleLines);
+    if (lastRow <= mFirstLine) {
+        return;
+    }
+    startLine = std::max<std::size_t>(startLine, mDocument->lineForRow(mFirstLine));
+    endLine = std::min<std::size_t>(endLine, mDocument->lineForRow(lastRow - 1) + 1);
+    if (startLine >= endLine) {
+        return;
+    }
+    auto spans = mDocument->spansForRange(startLine, endLine);
+    spdlog::debug("updated spans {}-{}, {} runs", spans.start, spans.end, spans.runs.size());
+    updatePalette(false);
+    Renderer::instance()->updateTextSpans(frameNo(), std::move(spans));
+}
+
+// the lines in [startLine, endLine) were edited and laid out again
+void View::textChanged(std::size_t startLine, std::size_t endLine)
+{
+    if (!mDocument->isReady() || endLine <= startLine) {
+        return;
+    }
+    const std::size_t numRows = mDocument->numRows();
+    if (mFirstLine >= numRows) {
+        // the text the view was showing is gone
+        mFirstLine = numRows > 0 ? numRows - 1 : 0;
+        Renderer::instance()->setPropertyFloat(frameNo(), Renderer::Property::FirstLine, static_cast<float>(mFirstLine));
+    }
+    const std::size_t lastRow = std::min<std::size_t>(numRows, mFirstLine + MaxVisibleLines);
+    if (lastRow > mFirstLine && startLine > mDocument->lineForRow(lastRow - 1)) {
+        // below what's visible
+        return;
+    }
+    if (mDocument->numLines() == 0) {
+        Renderer::instance()->clearTextLines(frameNo());
+        return;
+    }
+    // an edit above the visible rows can move them, so they're all sent again
+    updateText();
+}
+
+void View::updatePalette(bool force)
+{
+    const auto& palette = mDocument->textPalette();
+    if (!force && palette.size() == mPaletteSize && mDocument->textPaletteGeneration() == mPaletteGeneration) {
+        return;
+    }
+    mPaletteGeneration = mDocument->textPaletteGeneration();
+    mPaletteSize = palette.size();
+    Renderer::instance()->setTextPalette(frameNo(), std::vector<TextSpanStyle>(palette));
+}
+
+void View::setSoftWrap(bool wrap)
+{
+    if (wrap == mSoftWrap) {
+        return;
+    }
+    mSoftWrap = wrap;
+    updateWrapWidth();
+}
+
+void View::updateWrapWidth()
+{
+    if (!mDocument) {
+        return;
+    }
+    // font units are 64 per pixel
+    const int32_t width = mSoftWrap ? static_cast<int32_t>(contentRect().width) * 64 : 0;
+    if (width == mDocument->wrapWidth()) {
+        return;
+    }
+    // keep the line at the top in view
+    const std::size_t firstLine = mDocument->lineForRow(mFirstLine);
+    mDocument->setWrapWidth(width);
+    mFirstLine = mDocument->rowForLine(firstLine);
+    if (mDocument->isReady() && mDocument->numLines() > 0) {
+        Renderer::instance()->setPropertyFloat(frameNo(), Renderer::Property::FirstLine, static_cast<float>(mFirstLine));
+        updateText();
+    }
+}
+
 void View::setDocument(const std::shared_ptr<Document>& doc)
 {
     if (mDocument) {
         removeStyleableChild(mDocument.get());
         mDocument->onPropertiesChanged().disconnectAll();
+        mDocument->onTextChanged().disconnectAll();
     }
 
     auto oldDocument = mDocument;
@@ -69,13 +165,14 @@ void View::setDocument(const std::shared_ptr<Document>& doc)
     mDocument = doc;
     if (mDocument) {
         addStyleableChild(mDocument.get());
+        mDocument->setViewport(mDocument->lineForRow(mFirstLine), MaxVisibleLines);
+        updateWrapWidth();
         mDocument->onPropertiesChanged().connect([this](std::size_t start, std::size_t end) {
-            auto props = mDocument->propertiesForRange(start, end);
-            for (auto& prop : props) {
-                spdlog::debug("updated prop {}-{}, color {}", prop.start, prop.end, prop.foreground);
-            }
-            auto renderer = Renderer::instance();
-            renderer->addTextProperties(frameNo(), std::move(props));
+            // end is the line the change ends in
+            updateSpans(start, end + 1);
+        });
+        mDocument->onTextChanged().connect([this](std::size_t start, std::size_t end) {
+            textChanged(start, end);
         });
 
         if (mDocument->isReady()) {
@@ -93,4 +190,5 @@ void View::setDocument(const std::shared_ptr<Document>& doc)
 void View::updateLayout(const Rect& rect)
 {
     Frame::updateLayout(rect);
+    updateWrapWidth();
 }
@@ -21,6 +21,10 @@ public:
     void setActive(bool active);
     bool isActive() const;
 
+    // wraps lines at the width of the view
+    void setSoftWrap(bool wrap);
+    bool softWrap() const;
+
     EventEmitter<void(const std::shared_ptr<Document>&)>& onDocumentChanged();
 
 protected:
@@ -28,11 +32,21 @@ protected:
 
 private:
     void processDocument();
+    void updateText();
+    void updateSpans(std::size_t startLine, std::size_t endLine);
+    void textChanged(std::size_t startLine, std::size_t endLine);
+    void updatePalette(bool force);
+    void updateWrapWidth();
 
 private:
     std::shared_ptr<Document> mDocument;
+    // the first row with soft wrapping
     uint64_t mFirstLine = 0;
     bool mActive = false;
+    bool mSoftWrap = false;
+    // the generation and size of the document's text palette when it was last sent to the renderer
+    uint64_t mPaletteGeneration = 0;
+    std::size_t mPaletteSize = 0;
     EventEmitter<void(const std::shared_ptr<Document>&)> mOnDocumentChanged;
 
 private:
@@ -56,6 +70,7 @@ inline void View::setActive(bool active)
         mutableSelector()[0].nowhen("active");
     }
     mActive = active;
+    invalidateStyle();
 }
 
 inline bool View::isActive() const
@@ -63,6 +78,11 @@ inline bool View::isActive() const
     return mActive;
 }
 
+inline bool View::softWrap() const
+{
+    return mSoftWrap;
+}
+
 inline EventEmitter<void(const std::shared_ptr<Document>&)>& View::onDocumentChanged()
 {
     return mOnDocumentChanged;
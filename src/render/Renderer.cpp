@@ -39,28 +39,6 @@ namespace std
 # endif
 #endif
 
-namespace std
-{
-template<>
-struct hash<TextProperty> {
-    std::size_t operator()(const TextProperty& v) const
-    {
-        return std::hash<std::size_t>()(v.start)
-        ^ std::hash<std::size_t>()(v.end)
-        ^ std::hash<float>()(v.foreground.r)
-        ^ std::hash<float>()(v.foreground.g)
-        ^ std::hash<float>()(v.foreground.b)
-        ^ std::hash<float>()(v.foreground.a)
-        ^ std::hash<float>()(v.background.r)
-        ^ std::hash<float>()(v.background.g)
-        ^ std::hash<float>()(v.background.b)
-        ^ std::hash<float>()(v.background.a)
-        ^ std::hash<std::underlying_type_t<TextStyle>>()(static_cast<std::underlying_type_t<TextStyle>>(v.style))
-        ^ std::hash<int32_t>()(v.sizeDelta);
-    }
-};
-};
-
 namespace spurv_vk {
 PFN_vkCmdPushDescriptorSetKHR vkCmdPushDescriptorSetKHR;
 }
@@ -136,7 +114,8 @@ struct ViewData
 {
     RenderViewData renderData = {};
     std::vector<TextLine> textLines = {};
-    std::vector<TextProperty> textProperties = {};
+    std::vector<TextSpanStyle> textPalette = { TextSpanStyle() };
+    TextSpans textSpans = {};
     std::vector<TextVBO> textVBOs = {};
     std::vector<std::variant<int32_t, float>> renderProperties = {};
     std::vector<Animation> animatingProperties = {};
@@ -148,7 +127,8 @@ struct ViewData
 
     VkBuffer textVertUniformBuffer = VK_NULL_HANDLE;
     VmaAllocation textVertUniformBufferAllocation = VK_NULL_HANDLE;
-    unordered_dense::map<TextProperty, std::pair<VkBuffer, VmaAllocation>> textFragUniformBuffers;
+    // by palette index
+    unordered_dense::map<uint32_t, std::pair<VkBuffer, VmaAllocation>> textFragUniformBuffers;
 };
 
 struct RendererImpl
@@ -202,8 +182,6 @@ struct RendererImpl
 
     VkSampler textSampler = VK_NULL_HANDLE;
 
-    TextProperty defaultTextProperty = {};
-
     VkDescriptorSetLayout textUniformLayout = VK_NULL_HANDLE;
     VkPipelineLayout textPipelineLayout = VK_NULL_HANDLE;
     VkPipeline textPipeline = VK_NULL_HANDLE;
@@ -220,8 +198,10 @@ struct RendererImpl
 
     void addTextLines(uint64_t ident, std::vector<TextLine>&& lines);
     void clearTextLines(uint64_t ident);
-    void addTextProperties(uint64_t ident, std::vector<TextProperty>&& properties);
-    void clearTextProperties(uint64_t ident);
+    void setTextPalette(uint64_t ident, std::vector<TextSpanStyle>&& palette);
+    void setTextSpans(uint64_t ident, TextSpans&& spans);
+    void updateTextSpans(uint64_t ident, TextSpans&& spans);
+    void clearTextSpans(uint64_t ident);
     void setRenderViewData(uint64_t ident, const RenderViewData& data);
 
     template<typename ValueType>
@@ -248,8 +228,8 @@ struct RendererImpl
     template<typename T>
     void writeUniformBuffer(VkCommandBuffer cmdbuffer, VkBuffer buffer, const T& data, uint32_t bufferOffset);
     GlyphAtlas& atlasFor(const Font& font);
-    void makeTextFragUniformBuffer(ViewData& view, VkCommandBuffer cmdbuffer, const TextProperty& prop);
-    VkBuffer textFragUniformBuffer(ViewData& view, const TextProperty& prop);
+    void makeTextFragUniformBuffer(ViewData& view, VkCommandBuffer cmdbuffer, uint32_t style);
+    VkBuffer textFragUniformBuffer(ViewData& view, uint32_t style);
 
     static void idleCallback(uv_idle_t* idle);
     static void processStop(uv_async_t* handle);
@@ -362,12 +342,7 @@ void RendererImpl::addTextLines(uint64_t ident, std::vector<TextLine>&& lines)
         }
         currentAtlas = &atlas;
 
-        uint32_t glyph_count;
-        hb_glyph_info_t* glyph_info = hb_buffer_get_glyph_infos(line.buffer, &glyph_count);
-
-        for (uint32_t i = 0; i < glyph_count; i++) {
-            hb_codepoint_t glyphid = glyph_info[i].codepoint;
-
+        for (hb_codepoint_t glyphid : line.glyphs.glyphs().subspan(line.firstGlyph, line.lastGlyph - line.firstGlyph)) {
             auto glyphInfo = atlas.glyphBox(glyphid);
             if (glyphInfo == nullptr) {
                 missing.insert(glyphid);
@@ -403,16 +378,40 @@ void RendererImpl::setRenderViewData(uint64_t ident, const RenderViewData& data)
     recreateUniformBuffers(ident, view);
 }
 
-void RendererImpl::addTextProperties(uint64_t ident, std::vector<TextProperty>&& properties)
+void RendererImpl::setTextPalette(uint64_t ident, std::vector<TextSpanStyle>&& palette)
+{
+    auto& view = views[ident];
+    // a palette that only grew keeps the buffers of the styles that were already there
+    const bool grew = palette.size() >= view.textPalette.size()
+        && std::equal(view.textPalette.begin(), view.textPalette.end(), palette.begin());
+    view.textPalette = std::move(palette);
+    if (view.textPalette.empty()) {
+        view.textPalette.push_back(TextSpanStyle());
+    }
+    if (!grew) {
+        recreateUniformBuffers(ident, view);
+    }
+}
+
+void RendererImpl::setTextSpans(uint64_t ident, TextSpans&& spans)
+{
+    auto& view = views[ident];
+    view.textSpans = std::move(spans);
+    view.textVBOs.clear();
+}
+
+void RendererImpl::updateTextSpans(uint64_t ident, TextSpans&& spans)
 {
     auto& view = views[ident];
-    view.textProperties = std::move(properties);
+    view.textSpans.splice(spans);
+    view.textVBOs.clear();
 }
 
-void RendererImpl::clearTextProperties(uint64_t ident)
+void RendererImpl::clearTextSpans(uint64_t ident)
 {
     auto& view = views[ident];
-    view.textProperties.clear();
+    view.textSpans = {};
+    view.textVBOs.clear();
 }
 
 template<typename ValueType>
@@ -545,9 +544,9 @@ void RendererImpl::updateAnimations()
     lastRender = now;
 }
 
-VkBuffer RendererImpl::textFragUniformBuffer(ViewData& view, const TextProperty& prop)
+VkBuffer RendererImpl::textFragUniformBuffer(ViewData& view, uint32_t style)
 {
-    auto it = view.textFragUniformBuffers.find(prop);
+    auto it = view.textFragUniformBuffers.find(style);
     if (it != view.textFragUniformBuffers.end()) {
         return it->second.first;
     }
@@ -555,12 +554,13 @@ VkBuffer RendererImpl::textFragUniformBuffer(ViewData& view, const TextProperty&
     return VK_NULL_HANDLE;
 }
 
-void RendererImpl::makeTextFragUniformBuffer(ViewData& view, VkCommandBuffer cmdbuffer, const TextProperty& prop)
+void RendererImpl::makeTextFragUniformBuffer(ViewData& view, VkCommandBuffer cmdbuffer, uint32_t style)
 {
-    auto it = view.textFragUniformBuffers.find(prop);
+    auto it = view.textFragUniformBuffers.find(style);
     if (it != view.textFragUniformBuffers.end()) {
         return;
     }
+    const auto& prop = style < view.textPalette.size() ? view.textPalette[style] : view.textPalette.front();
 
     // create the text vert ubo
     VkBufferCreateInfo bufferInfo = {};
@@ -586,7 +586,7 @@ void RendererImpl::makeTextFragUniformBuffer(ViewData& view, VkCommandBuffer cmd
 
     writeUniformBuffer(cmdbuffer, buffer, &textFragData, sizeof(TextFrag), 0);
 
-    view.textFragUniformBuffers[prop] = std::make_pair(buffer, allocation);
+    view.textFragUniformBuffers[style] = std::make_pair(buffer, allocation);
 }
 
 void RendererImpl::clearAllVBOs()
@@ -610,66 +610,40 @@ void RendererImpl::generateVBOs(ViewData& view, VkCommandBuffer cmdbuffer)
         return;
     }
 
-    auto props = &view.textProperties;
-    auto getProp = [&props](std::size_t propIdx) -> const TextProperty* {
-        if (props == nullptr) {
-            return nullptr;
-        }
-        if (propIdx >= props->size()) {
-            return nullptr;
-        }
-        return &(*props)[propIdx];
-    };
-
-    std::size_t propStart = 0;
-    // better not have more than 32 matching props for a given character
-    std::bitset<32> propMatching = {}, propCurrent = {};
-    std::size_t highestMatching = 0;
-
-    const TextProperty* curProp = getProp(propStart);
-    if (curProp && curProp->start > 0) {
-        curProp = nullptr;
-    }
-    auto scanMatching = [&](std::size_t idx) -> void {
-        propMatching.reset();
-        if (curProp == nullptr) {
-            return;
+    // glyphs are mostly in text order, so the runs are walked along with them
+    const auto& spans = view.textSpans;
+    std::size_t runIdx = 0, runStart = spans.start;
+    auto styleAt = [&](std::size_t offset) -> uint32_t {
+        if (offset < spans.start) {
+            return 0;
         }
-        for (std::size_t n = 0; n < 32; ++n) {
-            auto np = getProp(propStart + n);
-            if (np == nullptr || idx < np->start) {
-                return;
-            }
-            if (idx < np->end) {
-                propMatching.set(n);
-            }
+        if (offset < runStart) {
+            // right to left text
+            runIdx = 0;
+            runStart = spans.start;
         }
-        if (propMatching.to_ullong() > 0) {
-            highestMatching = 31 - __builtin_clzll(propMatching.to_ullong());
-        } else {
-            highestMatching = 0;
+        while (runIdx < spans.runs.size() && offset >= runStart + spans.runs[runIdx].length) {
+            runStart += spans.runs[runIdx++].length;
         }
+        return runIdx < spans.runs.size() ? spans.runs[runIdx].style : 0;
     };
-    if (curProp != nullptr) {
-        scanMatching(propStart);
-        propCurrent = propMatching;
-    }
 
     float linePos = 0;
     auto& vbos = view.textVBOs;
     for (const auto& line : lines) {
         vbos.push_back(TextVBO());
         auto* vbo = &vbos.back();
-        const auto& vboTextProp = curProp != nullptr ? *curProp : defaultTextProperty;
-        makeTextFragUniformBuffer(view, cmdbuffer, vboTextProp);
-        vbo->setProperty(vboTextProp);
+        const auto glyphs = line.glyphs.glyphs().subspan(line.firstGlyph, line.lastGlyph - line.firstGlyph);
+        const auto clusters = line.glyphs.clusters().subspan(line.firstGlyph, line.lastGlyph - line.firstGlyph);
+        // clusters are relative to the start of the line, which is at offset
+        uint32_t currentStyle = styleAt(line.offset + (clusters.empty() ? 0 : clusters[0]));
+        makeTextFragUniformBuffer(view, cmdbuffer, currentStyle);
+        vbo->setStyle(currentStyle);
         vbo->setFirstLine(line.line);
         vbo->setLinePosition(linePos);
         auto& atlas = atlasFor(line.font);
         const auto fontSize = line.font.size();
 
-        std::size_t glyphOffset = line.offset;
-
         hb_font_extents_t fontExtents;
         hb_font_get_h_extents(line.font.font(), &fontExtents);
         const float lineHeight = ceilf(((fontExtents.ascender + fontExtents.descender + fontExtents.line_gap) / 64.f) + (fontSize / 4.f));
@@ -677,11 +651,9 @@ void RendererImpl::generateVBOs(ViewData& view, VkCommandBuffer cmdbuffer)
         const float x_tracking = std::max(floorf(fontSize / 10.f), 1.f);
 
         VkImageView imageView = VK_NULL_HANDLE;
-        uint32_t glyph_count;
         float cursor_x = 0.f;
-        hb_glyph_info_t *glyph_info = hb_buffer_get_glyph_infos(line.buffer, &glyph_count);
-        for (uint32_t i = 0; i < glyph_count; ++i, ++glyphOffset) {
-            hb_codepoint_t glyphid = glyph_info[i].codepoint;
+        for (uint32_t i = 0; i < glyphs.size(); ++i) {
+            hb_codepoint_t glyphid = glyphs[i];
             auto glyphInfo = atlas.glyphBox(glyphid);
             if (glyphInfo == nullptr || glyphInfo->image == VK_NULL_HANDLE) {
                 ++missing;
@@ -699,46 +671,22 @@ void RendererImpl::generateVBOs(ViewData& view, VkCommandBuffer cmdbuffer)
             const float y_bottom = glyphInfo->box.bounds.b * fontSize;
             const float y_top = glyphInfo->box.bounds.t * fontSize;
 
-            if (props != nullptr) {
-                // check if any of the properties match
-                if (curProp == nullptr || glyphOffset >= curProp->end) {
-                    // find the first new prop (if any)
-                    for (;;) {
-                        curProp = getProp(propStart);
-                        if (curProp == nullptr) {
-                            // done, no more props
-                            props = nullptr;
-                            break;
-                        }
-                        if (glyphOffset < curProp->start) {
-                            curProp = nullptr;
-                            break;
-                        }
-                        if (glyphOffset >= curProp->start && glyphOffset < curProp->end) {
-                            break;
-                        }
-                        ++propStart;
-                    }
-                }
-                scanMatching(glyphOffset);
-                if (propCurrent != propMatching) {
-                    spdlog::info("text props changed {} {:#x}", glyphOffset, propMatching.to_ullong());
-                    propCurrent = propMatching;
+            const uint32_t style = styleAt(line.offset + clusters[i]);
+            if (style != currentStyle) {
+                currentStyle = style;
 
-                    vbo->generate(allocator, cmdbuffer);
+                vbo->generate(allocator, cmdbuffer);
 
-                    vbos.push_back(TextVBO());
-                    vbo = &vbos.back();
+                vbos.push_back(TextVBO());
+                vbo = &vbos.back();
 
-                    assert(imageView != VK_NULL_HANDLE);
-                    vbo->setView(imageView);
-                    vbo->setFirstLine(line.line);
-                    vbo->setLinePosition(linePos);
+                assert(imageView != VK_NULL_HANDLE);
+                vbo->setView(imageView);
+                vbo->setFirstLine(line.line);
+                vbo->setLinePosition(linePos);
 
-                    const auto& newVboTextProp = curProp != nullptr ? *curProp : defaultTextProperty;
-                    makeTextFragUniformBuffer(view, cmdbuffer, newVboTextProp);
-                    vbo->setProperty(newVboTextProp);
-                }
+                makeTextFragUniformBuffer(view, cmdbuffer, style);
+                vbo->setStyle(style);
             }
 
             vbo->add(
@@ -834,7 +782,7 @@ void RendererImpl::recreateUniformBuffers(uint64_t ident, ViewData& view)
         };
         impl->writeUniformBuffer(cmdbuffer, frameView.textVertUniformBuffer, &textVertData, sizeof(TextVert), 0);
 
-        auto& defaultTextFragBuffer = frameView.textFragUniformBuffers[impl->defaultTextProperty];
+        auto& defaultTextFragBuffer = frameView.textFragUniformBuffers[0];
         // create the text frag ubo
         bufferInfo.size = sizeof(TextFrag);
         VK_CHECK_SUCCESS(vmaCreateBuffer(impl->allocator, &bufferInfo, &bufferAllocationInfo, &defaultTextFragBuffer.first, &defaultTextFragBuffer.second, nullptr));
@@ -1670,17 +1618,31 @@ void Renderer::clearTextLines(uint64_t ident)
     });
 }
 
-void Renderer::addTextProperties(uint64_t ident, std::vector<TextProperty>&& properties)
+void Renderer::setTextPalette(uint64_t ident, std::vector<TextSpanStyle>&& palette)
+{
+    mEventLoop->post([ident, palette = std::move(palette), impl = mImpl]() mutable {
+        impl->setTextPalette(ident, std::move(palette));
+    });
+}
+
+void Renderer::setTextSpans(uint64_t ident, TextSpans&& spans)
+{
+    mEventLoop->post([ident, spans = std::move(spans), impl = mImpl]() mutable {
+        impl->setTextSpans(ident, std::move(spans));
+    });
+}
+
+void Renderer::updateTextSpans(uint64_t ident, TextSpans&& spans)
 {
-    mEventLoop->post([ident, properties = std::move(properties), impl = mImpl]() mutable {
-        impl->addTextProperties(ident, std::move(properties));
+    mEventLoop->post([ident, spans = std::move(spans), impl = mImpl]() mutable {
+        impl->updateTextSpans(ident, std::move(spans));
     });
 }
 
-void Renderer::clearTextProperties(uint64_t ident)
+void Renderer::clearTextSpans(uint64_t ident)
 {
     mEventLoop->post([ident, impl = mImpl]() {
-        impl->clearTextProperties(ident);
+        impl->clearTextSpans(ident);
     });
 }
 
@@ -1916,7 +1878,7 @@ void Renderer::render()
                 if (vbo.view() == VK_NULL_HANDLE) {
                     continue;
                 }
-                auto fragbuf = mImpl->textFragUniformBuffer(view, vbo.property());
+                auto fragbuf = mImpl->textFragUniformBuffer(view, vbo.style());
                 if (fragbuf == VK_NULL_HANDLE) {
                     continue;
                 }
@@ -6,7 +6,7 @@
 #include <EventLoop.h>
 #include <Geometry.h>
 #include <TextLine.h>
-#include <TextProperty.h>
+#include <TextSpans.h>
 
 #include <volk.h>
 
@@ -65,8 +65,12 @@ public:
 
     void addTextLines(uint64_t ident, std::vector<TextLine>&& lines);
     void clearTextLines(uint64_t ident);
-    void addTextProperties(uint64_t ident, std::vector<TextProperty>&& lines);
-    void clearTextProperties(uint64_t ident);
+    // spans refer to the styles in the palette of the view by index
+    void setTextPalette(uint64_t ident, std::vector<TextSpanStyle>&& palette);
+    void setTextSpans(uint64_t ident, TextSpans&& spans);
+    // replaces the part of the spans that spans covers
+    void updateTextSpans(uint64_t ident, TextSpans&& spans);
+    void clearTextSpans(uint64_t ident);
 
     void setPropertyInt(uint64_t ident, Property prop, int32_t value);
     void setPropertyFloat(uint64_t ident, Property prop, float value);
@@ -9,7 +9,7 @@ TextVBO::TextVBO(TextVBO&& other) noexcept
     : mMemory(std::move(other.mMemory)), mOffset(other.mOffset), mSize(other.mSize),
       mFirstLine(other.mFirstLine), mLinePosition(other.mLinePosition),
       mAllocator(other.mAllocator), mAllocation(other.mAllocation),
-      mBuffer(other.mBuffer), mView(other.mView), mProperty(std::move(other.mProperty))
+      mBuffer(other.mBuffer), mView(other.mView), mStyle(other.mStyle)
 {
     other.mAllocator = VK_NULL_HANDLE;
     other.mAllocation = VK_NULL_HANDLE;
@@ -46,7 +46,7 @@ TextVBO& TextVBO::operator=(TextVBO&& other) noexcept
     mAllocation = other.mAllocation;
     mBuffer = other.mBuffer;
     mView = other.mView;
-    mProperty = other.mProperty;
+    mStyle = other.mStyle;
     other.mAllocator = VK_NULL_HANDLE;
     other.mAllocation = VK_NULL_HANDLE;
     other.mBuffer = VK_NULL_HANDLE;
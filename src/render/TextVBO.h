@@ -1,7 +1,6 @@
 #pragma once
 
 #include <Geometry.h>
-#include <TextProperty.h>
 #include <msdf-atlas-gen/msdf-atlas-gen.h>
 #include <volk.h>
 #include <vk_mem_alloc.h>
@@ -23,7 +22,8 @@ public:
     void generate(VmaAllocator allocator, VkCommandBuffer cmdbuffer);
 
     void setView(VkImageView view);
-    void setProperty(const TextProperty& property);
+    // an index into the text palette of the view
+    void setStyle(uint32_t style);
     void setFirstLine(uint64_t line);
     void setLinePosition(uint64_t pos);
 
@@ -33,7 +33,7 @@ public:
     uint64_t linePosition() const;
 
     VkImageView view() const;
-    const TextProperty& property() const;
+    uint32_t style() const;
 
 private:
     TextVBO(const TextVBO&) = delete;
@@ -47,7 +47,7 @@ private:
     VmaAllocation mAllocation = VK_NULL_HANDLE;
     VkBuffer mBuffer = VK_NULL_HANDLE;
     VkImageView mView = VK_NULL_HANDLE;
-    TextProperty mProperty = {};
+    uint32_t mStyle = 0;
 };
 
 inline void TextVBO::setView(VkImageView view)
@@ -60,14 +60,14 @@ inline VkImageView TextVBO::view() const
     return mView;
 }
 
-inline void TextVBO::setProperty(const TextProperty& property)
+inline void TextVBO::setStyle(uint32_t style)
 {
-    mProperty = property;
+    mStyle = style;
 }
 
-inline const TextProperty& TextVBO::property() const
+inline uint32_t TextVBO::style() const
 {
-    return mProperty;
+    return mStyle;
 }
 
 inline void TextVBO::setFirstLine(uint64_t line)
@@ -0,0 +1,77 @@
+#include <CLexer.h>
+#include <TextClasses.h>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+using namespace spurv;
+
+namespace {
+
+enum Class { Comment, String, Number, Keyword };
+
+struct Token
+{
+    uint32_t start, length;
+    Class clazz;
+};
+
+struct Line
+{
+    std::u16string_view text;
+    // the state the line starts in and the one it ends in, 1 is a block comment
+    uint32_t state, end;
+    std::vector<Token> tokens;
+};
+
+const Line lines[] = {
+    { u"", 0, 0, {} },
+    { u"int x = 0x1f;", 0, 0, { { 0, 3, Keyword }, { 8, 4, Number } } },
+    { u"return \"a \\\" b\" + 'c';", 0, 0, { { 0, 6, Keyword }, { 7, 8, String }, { 18, 3, String } } },
+    { u"\"not closed", 0, 0, { { 0, 11, String } } },
+    { u"x // int /* y", 0, 0, { { 2, 11, Comment } } },
+    // the * of the opener doesn't close the comment
+    { u"/*/", 0, 1, { { 0, 3, Comment } } },
+    { u"/*/ int */ int", 0, 0, { { 0, 10, Comment }, { 11, 3, Keyword } } },
+    { u"/**/int", 0, 0, { { 0, 4, Comment }, { 4, 3, Keyword } } },
+    { u"int /*", 0, 1, { { 0, 3, Keyword }, { 4, 2, Comment } } },
+    { u"int */ int", 1, 0, { { 0, 6, Comment }, { 7, 3, Keyword } } },
+    { u"/ int", 1, 1, { { 0, 5, Comment } } },
+    { u"*/", 0, 0, {} },
+    { u"a /* b */ c /* d", 0, 1, { { 2, 7, Comment }, { 12, 4, Comment } } },
+};
+
+} // anonymous namespace
+
+int main()
+{
+    CLexer lexer;
+    auto classes = TextClasses::instance();
+    // the names the lexer registers, the same name gets the same class
+    const uint32_t ids[] = {
+        classes->registerTextClass("comment"),
+        classes->registerTextClass("string"),
+        classes->registerTextClass("number"),
+        classes->registerTextClass("keyword")
+    };
+
+    int failed = 0;
+    std::vector<SyntaxToken> tokens;
+    for (const auto& line : lines) {
+        tokens.clear();
+        const uint32_t end = lexer.lexLine(line.text, line.state, tokens);
+        bool ok = end == line.end && tokens.size() == line.tokens.size();
+        for (std::size_t idx = 0; ok && idx < tokens.size(); ++idx) {
+            const auto& want = line.tokens[idx];
+            ok = tokens[idx].start == want.start && tokens[idx].length == want.length && tokens[idx].clazz == ids[want.clazz];
+        }
+        if (!ok) {
+            const std::string text(line.text.begin(), line.text.end());
+            fprintf(stderr, "'%s' from state %u: ended in %u with %zu tokens, expected %u with %zu\n",
+                    text.c_str(), line.state, end, tokens.size(), line.end, line.tokens.size());
+            ++failed;
+        }
+    }
+    TextClasses::destroy();
+    return failed > 0 ? 1 : 0;
+}
@@ -0,0 +1,129 @@
+#include <FenwickTree.h>
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <type_traits>
+#include <vector>
+
+using namespace spurv;
+
+namespace {
+
+// the values themselves, every sum adds them up from the start
+template<typename Type>
+class Model
+{
+public:
+    std::vector<Type> values;
+
+    Type prefix(std::size_t count) const
+    {
+        Type sum {};
+        for (std::size_t idx = 0; idx < count; ++idx) {
+            sum += values[idx];
+        }
+        return sum;
+    }
+
+    // values can't be negative for this one, like FenwickTree::find
+    std::size_t find(Type position) const
+    {
+        Type sum {};
+        for (std::size_t idx = 0; idx < values.size(); ++idx) {
+            sum += values[idx];
+            if (position < sum) {
+                return idx;
+            }
+        }
+        return values.size();
+    }
+};
+
+template<typename Type>
+bool check(const FenwickTree<Type>& tree, const Model<Type>& model, bool findable)
+{
+    if (tree.size() != model.values.size() || tree.total() != model.prefix(model.values.size())) {
+        return false;
+    }
+    for (std::size_t idx = 0; idx < model.values.size(); ++idx) {
+        if (tree.prefix(idx) != model.prefix(idx) || tree.at(idx) != model.values[idx]) {
+            return false;
+        }
+    }
+    if (!findable) {
+        return true;
+    }
+    // every position up to one past the total, zeros are skipped over
+    const Type total = model.prefix(model.values.size());
+    for (Type position = 0; position <= total; ++position) {
+        if (tree.find(position) != model.find(position)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// sizes around the powers of two that find steps by, values that are often zero
+// like pages that lost all their lines. signed trees get negative values too, like
+// offset shifts, and aren't looked up by position
+template<typename Type>
+bool run(uint32_t seed)
+{
+    std::mt19937 rng(seed);
+    constexpr bool findable = std::is_unsigned_v<Type>;
+    auto value = [&rng]() -> Type {
+        const Type magnitude = rng() % 3 == 0 ? 0 : static_cast<Type>(rng() % 50);
+        return !findable && rng() % 2 == 0 ? -magnitude : magnitude;
+    };
+
+    for (int round = 0; round < 50; ++round) {
+        const std::size_t size = rng() % 4 == 0 ? rng() % 4 : (std::size_t(1) << (rng() % 8)) + rng() % 3 - 1;
+        Model<Type> model;
+        model.values.resize(size);
+        FenwickTree<Type> tree;
+        if (rng() % 2 == 0) {
+            for (auto& val : model.values) {
+                val = value();
+            }
+            tree.assign(model.values);
+        } else {
+            tree = FenwickTree<Type>(size);
+        }
+        if (!check(tree, model, findable)) {
+            fprintf(stderr, "seed %u, round %d: %zu values don't add up after assigning them\n", seed, round, size);
+            return false;
+        }
+        for (int op = 0; op < 20 && size > 0; ++op) {
+            const std::size_t idx = rng() % size;
+            // a value can go down as well, as long as it stays above zero if it has to
+            Type delta = value();
+            if (findable && rng() % 2 == 0) {
+                delta = -std::min(delta, model.values[idx]);
+            }
+            tree.add(idx, delta);
+            model.values[idx] += delta;
+            if (!check(tree, model, findable)) {
+                fprintf(stderr, "seed %u, round %d: %zu values don't add up after adding to %zu\n", seed, round, size, idx);
+                return false;
+            }
+        }
+        tree.clear();
+        if (tree.size() != 0 || tree.total() != 0 || tree.find(0) != 0) {
+            fprintf(stderr, "seed %u, round %d: not empty after clearing\n", seed, round);
+            return false;
+        }
+    }
+    return true;
+}
+
+} // anonymous namespace
+
+int main()
+{
+    for (uint32_t seed = 1; seed <= 10; ++seed) {
+        if (!run<std::size_t>(seed) || !run<std::ptrdiff_t>(seed)) {
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,133 @@
+#include <Layout.h>
+#include <Logger.h>
+#include <Rope.h>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace spurv;
+
+namespace {
+
+// the lines of a text the slow and obvious way, where each one starts and where
+// its line break is. a CR+LF is one line break, the line ends at its CR
+struct Model
+{
+    std::u16string text;
+    std::vector<std::size_t> starts, ends;
+
+    void update()
+    {
+        starts.assign(1, 0);
+        ends.clear();
+        for (std::size_t idx = 0; idx < text.size(); ++idx) {
+            if (!isLineBreak(text[idx]) || (text[idx] == u'\r' && idx + 1 < text.size() && text[idx + 1] == u'\n')) {
+                continue;
+            }
+            const bool crlf = text[idx] == u'\n' && idx > 0 && text[idx - 1] == u'\r';
+            ends.push_back(crlf ? idx - 1 : idx);
+            starts.push_back(idx + 1);
+        }
+        ends.push_back(text.size());
+    }
+};
+
+std::u16string randomText(std::mt19937& rng, std::size_t size)
+{
+    static const char16_t alphabet[] = { u'a', u'b', u' ', u'\r', u'\n', u'\n', 0x2028, 0x00E6 };
+    std::u16string text(size, u'\0');
+    for (auto& ch : text) {
+        ch = alphabet[rng() % std::size(alphabet)];
+    }
+    return text;
+}
+
+// nothing is shaped without a font, every line is a single row. what's left is
+// how the pages keep track of the lines as they come and go
+bool check(std::mt19937& rng, const Layout& layout, const Model& model, std::size_t numLines)
+{
+    if (layout.numLines() != numLines || layout.numRows() != numLines) {
+        return false;
+    }
+    // every line of a small text, some of a big one
+    const bool all = numLines < 2000;
+    for (std::size_t count = 0; count < (all ? numLines : 200); ++count) {
+        const std::size_t line = all ? count : rng() % numLines;
+        if (layout.lineOffset(line) != model.starts[line] || layout.lineEndOffset(line) != model.ends[line]) {
+            return false;
+        }
+        if (layout.rowForLine(line) != line || layout.lineForRow(line) != std::make_pair(line, std::size_t(0))) {
+            return false;
+        }
+        if (layout.lineForOffset(model.starts[line]) != line || layout.lineForOffset(model.ends[line]) != line) {
+            return false;
+        }
+    }
+    return layout.rowForLine(numLines) == numLines && layout.lineForRow(numLines).first == numLines;
+}
+
+bool run(uint32_t seed, Layout::Mode mode)
+{
+    std::mt19937 rng(seed);
+    auto below = [&rng](std::size_t max) -> std::size_t {
+        return max > 0 ? rng() % max : 0;
+    };
+
+    Layout layout;
+    layout.reset(mode);
+    Model model;
+    model.text = randomText(rng, below(20000));
+    Rope rope(model.text);
+
+    std::size_t loaded = 0;
+    if (mode == Layout::Mode::Chunked) {
+        // a document that's loading gets longer snapshots of the text, a CR at the
+        // end of one might become a CR+LF with the next one
+        while (loaded < model.text.size()) {
+            loaded = std::min(model.text.size(), loaded + 1 + below(3000));
+            layout.calculate(Rope(model.text.substr(0, loaded)));
+        }
+    }
+    layout.calculate(rope);
+    layout.finalize();
+    model.update();
+    if (!check(rng, layout, model, model.starts.size())) {
+        fprintf(stderr, "seed %u: %zu lines after loading, the model has %zu\n", seed, layout.numLines(), model.starts.size());
+        return false;
+    }
+
+    for (int op = 0; op < 300; ++op) {
+        // typing mostly, now and then a big paste or a big removal that takes pages with it
+        const std::size_t size = model.text.size();
+        const std::size_t amount = below(20) == 0 ? below(5000) : below(10);
+        const std::size_t offset = below(size + 1);
+        const std::size_t removed = below(3) == 0 ? std::min(size - offset, amount) : 0;
+        const auto inserted = removed == 0 || below(2) == 0 ? randomText(rng, amount) : std::u16string();
+        rope.remove(offset, removed);
+        rope.insert(offset, inserted);
+        model.text.replace(offset, removed, inserted);
+        layout.edit(rope, offset, removed, inserted.size());
+        model.update();
+        if (!check(rng, layout, model, model.starts.size())) {
+            fprintf(stderr, "seed %u, operation %d: %zu lines after replacing %zu at %zu with %zu, the model has %zu\n",
+                    seed, op, layout.numLines(), removed, offset, inserted.size(), model.starts.size());
+            return false;
+        }
+    }
+    return true;
+}
+
+} // anonymous namespace
+
+int main()
+{
+    // the layout complains about not having a font every time it would shape something
+    spdlog::set_level(spdlog::level::off);
+    for (uint32_t seed = 1; seed <= 10; ++seed) {
+        if (!run(seed, Layout::Mode::Single) || !run(seed, Layout::Mode::Chunked)) {
+            return 1;
+        }
+    }
+    return 0;
+}
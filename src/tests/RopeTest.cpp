@@ -0,0 +1,276 @@
+#include <Rope.h>
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <tuple>
+#include <vector>
+
+using namespace spurv;
+
+namespace {
+
+// what Rope does, the slow and obvious way. the text is a plain string and
+// every lookup walks it from the start
+class Model
+{
+public:
+    std::u16string text;
+
+    bool isLinebreakAt(std::size_t idx) const
+    {
+        if (!isLineBreak(text[idx])) {
+            return false;
+        }
+        // the LF of a CR+LF is the line break
+        return text[idx] != u'\r' || idx + 1 == text.size() || text[idx + 1] != u'\n';
+    }
+
+    std::vector<Linebreak> linebreaks() const
+    {
+        std::vector<Linebreak> out;
+        for (std::size_t idx = 0; idx < text.size(); ++idx) {
+            if (isLinebreakAt(idx)) {
+                const bool crlf = text[idx] == u'\n' && idx > 0 && text[idx - 1] == u'\r';
+                out.push_back({ idx, crlf ? u'\r' : text[idx] });
+            }
+        }
+        return out;
+    }
+
+    // the line lookups work from the line breaks, finding those is what's slow
+    static std::size_t lineForOffset(const std::vector<Linebreak>& linebreaks, std::size_t offset)
+    {
+        std::size_t line = 0;
+        while (line < linebreaks.size() && linebreaks[line].first < offset) {
+            ++line;
+        }
+        return line;
+    }
+
+    std::size_t offsetForLine(const std::vector<Linebreak>& linebreaks, std::size_t line) const
+    {
+        if (line == 0) {
+            return 0;
+        }
+        return line <= linebreaks.size() ? linebreaks[line - 1].first + 1 : text.size();
+    }
+
+    // the code point containing offset and how many code units it has
+    std::pair<char32_t, std::size_t> codePointAt(std::size_t& offset) const
+    {
+        auto high = [this](std::size_t idx) { return text[idx] >= 0xD800 && text[idx] <= 0xDBFF; };
+        auto low = [this](std::size_t idx) { return text[idx] >= 0xDC00 && text[idx] <= 0xDFFF; };
+        if (low(offset) && offset > 0 && high(offset - 1)) {
+            --offset;
+        }
+        if (high(offset) && offset + 1 < text.size() && low(offset + 1)) {
+            return { 0x10000 + ((static_cast<char32_t>(text[offset]) - 0xD800) << 10) + (text[offset + 1] - 0xDC00), 2 };
+        }
+        return { text[offset], 1 };
+    }
+};
+
+// line breaks of every kind, CRs and LFs that may pair up and halves of surrogate pairs
+// that may or may not end up next to each other
+std::u16string randomText(std::mt19937& rng, std::size_t size)
+{
+    static const char16_t alphabet[] = {
+        u'a', u'b', u'c', u'd', u' ', u'\r', u'\n', u'\n', u'\v', 0x0085, 0x2028, 0x2029, 0xD83D, 0xDE00, 0x00E6, 0x65E5
+    };
+    std::u16string text(size, u'\0');
+    for (auto& ch : text) {
+        ch = alphabet[rng() % std::size(alphabet)];
+    }
+    return text;
+}
+
+Rope build(std::mt19937& rng, const std::u16string& text)
+{
+    Rope::Builder builder;
+    std::size_t pos = 0;
+    while (pos < text.size()) {
+        // leaves are filled a random bit at a time, like a transcoder would
+        const std::size_t num = std::min({ text.size() - pos, builder.room(), static_cast<std::size_t>(1 + rng() % 1500) });
+        std::copy_n(text.data() + pos, num, builder.leaf());
+        builder.commit(num);
+        pos += num;
+    }
+    return builder.build();
+}
+
+bool checkIterators(const Rope& rope, const Model& model, std::size_t offset)
+{
+    // chunks from offset to the end and back again, they have to line up with the text
+    Rope::ChunkIterator chunks(rope, offset);
+    std::u16string forward;
+    const std::size_t first = chunks.offset();
+    if (first > offset || (chunks.isValid() && first + chunks.chunk().size() <= offset)) {
+        return false;
+    }
+    while (chunks.isValid()) {
+        forward += chunks.chunk();
+        chunks.next();
+    }
+    if (model.text.compare(first, std::u16string::npos, forward) != 0) {
+        return false;
+    }
+    std::u16string backward;
+    while (chunks.previous()) {
+        backward.append(chunks.chunk().rbegin(), chunks.chunk().rend());
+    }
+    std::reverse(backward.begin(), backward.end());
+    if (backward != model.text) {
+        return false;
+    }
+
+    if (offset >= model.text.size()) {
+        return true;
+    }
+    // a few code points both ways
+    Rope::CodePointIterator codePoints(rope, offset);
+    std::size_t pos = offset;
+    auto [codePoint, size] = model.codePointAt(pos);
+    for (int step = 0; step < 20 && codePoints.isValid(); ++step) {
+        if (codePoints.offset() != pos || codePoints.codePoint() != codePoint) {
+            return false;
+        }
+        pos += size;
+        if (!codePoints.next()) {
+            return pos == model.text.size();
+        }
+        std::tie(codePoint, size) = model.codePointAt(pos);
+    }
+    while (codePoints.previous()) {
+        std::size_t expected = codePoints.offset();
+        if (model.codePointAt(expected).first != codePoints.codePoint() || expected != codePoints.offset()) {
+            return false;
+        }
+        if (codePoints.offset() + 20 < offset) {
+            break;
+        }
+    }
+    return true;
+}
+
+bool check(std::mt19937& rng, const Rope& rope, const Model& model, bool all)
+{
+    const std::size_t size = model.text.size();
+    if (rope.length() != size || rope.empty() != (size == 0)) {
+        return false;
+    }
+    const auto linebreaks = model.linebreaks();
+    if (rope.numLines() != linebreaks.size() + 1) {
+        return false;
+    }
+    for (int idx = 0; idx < 10; ++idx) {
+        const std::size_t offset = rng() % (size + 2);
+        if (rope.lineForOffset(offset) != Model::lineForOffset(linebreaks, offset)) {
+            return false;
+        }
+        const std::size_t line = rng() % (linebreaks.size() + 2);
+        if (rope.offsetForLine(line) != model.offsetForLine(linebreaks, line)) {
+            return false;
+        }
+        if (offset < size && rope.at(offset) != model.text[offset]) {
+            return false;
+        }
+    }
+    const std::size_t start = rng() % (size + 1);
+    const std::size_t len = rng() % 3000;
+    if (rope.substring(start, len) != model.text.substr(start, len)) {
+        return false;
+    }
+    if (!checkIterators(rope, model, rng() % (size + 1))) {
+        return false;
+    }
+    if (!all) {
+        return true;
+    }
+    // everything now and then, it's slow with the model
+    if (rope.toString() != model.text || rope.linebreaks() != linebreaks) {
+        return false;
+    }
+    for (std::size_t line = 0; line <= linebreaks.size(); ++line) {
+        const std::size_t offset = model.offsetForLine(linebreaks, line);
+        if (rope.offsetForLine(line) != offset || (offset < size && rope.lineForOffset(offset) != line)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool run(uint32_t seed)
+{
+    std::mt19937 rng(seed);
+    auto below = [&rng](std::size_t max) -> std::size_t {
+        return max > 0 ? rng() % max : 0;
+    };
+
+    Rope rope;
+    Model model;
+    // a snapshot has to stay the way it was while the rope it was copied from changes
+    Rope snapshot;
+    Model snapshotModel;
+    for (int op = 0; op < 300; ++op) {
+        const std::size_t size = model.text.size();
+        // small edits mostly, sometimes big ones that split and merge nodes on every level.
+        // a big rope only gets smaller, the model is slow enough as it is
+        const std::size_t amount = below(10) == 0 ? below(10000) : below(100);
+        const std::size_t kind = size > 40000 ? 2 : below(8);
+        switch (kind) {
+        case 0:
+        case 1: {
+            const std::size_t offset = below(size + 1);
+            const auto text = randomText(rng, amount);
+            rope.insert(offset, text);
+            model.text.insert(offset, text);
+            break; }
+        case 2:
+        case 3: {
+            const std::size_t offset = below(size + 1);
+            const std::size_t len = std::min(size - offset, amount);
+            rope.remove(offset, len);
+            model.text.erase(offset, len);
+            break; }
+        case 4: {
+            const auto text = randomText(rng, amount);
+            rope.append(text);
+            model.text += text;
+            break; }
+        case 5: {
+            const auto text = randomText(rng, amount);
+            rope.append(build(rng, text));
+            model.text += text;
+            break; }
+        case 6: {
+            model.text = randomText(rng, below(4) == 0 ? 0 : below(40000));
+            rope = build(rng, model.text);
+            break; }
+        case 7:
+            snapshot = rope;
+            snapshotModel = model;
+            break;
+        }
+
+        const bool checkAll = op % 50 == 49;
+        if (!check(rng, rope, model, checkAll) || (op % 10 == 9 && !check(rng, snapshot, snapshotModel, checkAll))) {
+            fprintf(stderr, "seed %u, operation %d (%zu): the rope has %zu code units, the model %zu\n",
+                    seed, op, kind, rope.length(), model.text.size());
+            return false;
+        }
+    }
+    return true;
+}
+
+} // anonymous namespace
+
+int main()
+{
+    for (uint32_t seed = 1; seed <= 10; ++seed) {
+        if (!run(seed)) {
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,163 @@
+#include <SlabAllocator.h>
+#include <cstdio>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+using namespace spurv;
+
+namespace {
+
+// knows if anything else was written to it
+template<std::size_t Size>
+struct Item
+{
+    Item(uint64_t s)
+        : stamp(s)
+    {
+        for (auto& byte : payload) {
+            byte = static_cast<uint8_t>(stamp);
+        }
+    }
+
+    bool intact() const
+    {
+        for (auto byte : payload) {
+            if (byte != static_cast<uint8_t>(stamp)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    uint64_t stamp;
+    uint8_t payload[Size];
+};
+
+// small slabs so that they fill up, empty out and get unmapped all the time
+template<typename Type>
+using Allocator = SlabAllocator<Type, 65536>;
+
+// objects created by one thread and destroyed by another
+template<typename Type>
+struct Shared
+{
+    std::mutex mutex;
+    std::vector<Type*> objects;
+};
+
+// creates and destroys objects at random, the model is the set of objects that
+// are alive. every object has to keep its contents until it's destroyed
+template<typename Type>
+bool run(Allocator<Type>& allocator, Shared<Type>& shared, uint32_t seed)
+{
+    std::mt19937 rng(seed);
+    std::vector<Type*> objects;
+    std::unordered_set<Type*> alive;
+    uint64_t stamp = seed * 1000000ull;
+    auto destroy = [&](Type* object) -> bool {
+        if (!object->intact() || alive.erase(object) != 1) {
+            fprintf(stderr, "seed %u: object %p was overwritten or handed out twice\n", seed, static_cast<void*>(object));
+            return false;
+        }
+        allocator.destroy(object);
+        return true;
+    };
+
+    for (int op = 0; op < 20000; ++op) {
+        // grows and shrinks in waves so that slabs empty out
+        const bool growing = (op / 2000) % 2 == 0;
+        const std::size_t kind = rng() % 10;
+        if (kind < (growing ? 6u : 3u)) {
+            auto object = allocator.create(++stamp);
+            if (reinterpret_cast<uintptr_t>(object) % alignof(Type) != 0 || !alive.insert(object).second) {
+                fprintf(stderr, "seed %u: object %p is misaligned or still alive\n", seed, static_cast<void*>(object));
+                return false;
+            }
+            objects.push_back(object);
+        } else if (kind < 9 && !objects.empty()) {
+            const std::size_t idx = rng() % objects.size();
+            auto object = objects[idx];
+            objects[idx] = objects.back();
+            objects.pop_back();
+            if (!destroy(object)) {
+                return false;
+            }
+        } else if (!objects.empty()) {
+            // hand one to another thread and destroy one of theirs
+            std::lock_guard lock(shared.mutex);
+            auto object = objects.back();
+            objects.pop_back();
+            alive.erase(object);
+            shared.objects.push_back(object);
+            object = shared.objects[rng() % shared.objects.size()];
+            std::erase(shared.objects, object);
+            if (!object->intact()) {
+                fprintf(stderr, "seed %u: shared object %p was overwritten\n", seed, static_cast<void*>(object));
+                return false;
+            }
+            allocator.destroy(object);
+        }
+        if (allocator.stats().objects < alive.size()) {
+            fprintf(stderr, "seed %u, operation %d: %zu objects alive but the allocator counts %zu\n",
+                    seed, op, alive.size(), allocator.stats().objects);
+            return false;
+        }
+    }
+    for (auto object : objects) {
+        if (!destroy(object)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// a few threads at once, once they're gone and everything is destroyed only the spare slab is left
+template<typename Type>
+bool runThreads()
+{
+    Allocator<Type> allocator;
+    Shared<Type> shared;
+    std::vector<std::thread> threads;
+    bool ok[4] = {};
+    for (uint32_t idx = 0; idx < std::size(ok); ++idx) {
+        threads.emplace_back([&, idx]() {
+            ok[idx] = run(allocator, shared, idx + 1);
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    bool all = true;
+    for (auto result : ok) {
+        all = all && result;
+    }
+    // what's left is destroyed on a thread too, the free slots of a thread are given back when it exits
+    std::thread([&]() {
+        for (auto object : shared.objects) {
+            all = all && object->intact();
+            allocator.destroy(object);
+        }
+    }).join();
+    if (!all) {
+        return false;
+    }
+    const auto stats = allocator.stats();
+    if (stats.objects != 0 || stats.slabs > 1) {
+        fprintf(stderr, "%zu objects in %zu slabs after destroying everything\n", stats.objects, stats.slabs);
+        return false;
+    }
+    return true;
+}
+
+} // anonymous namespace
+
+int main()
+{
+    if (!runThreads<Item<8>>() || !runThreads<Item<1000>>()) {
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,298 @@
+#include <TextClassTree.h>
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <tuple>
+#include <vector>
+
+using namespace spurv;
+
+namespace {
+
+struct ModelRange
+{
+    std::size_t start, end;
+    std::vector<uint32_t> classes;
+
+    bool operator==(const ModelRange& other) const = default;
+};
+
+// what TextClassTree does, the slow and obvious way. ranges are kept in a
+// vector, unsorted, and every operation looks at all of them
+class Model
+{
+public:
+    void insert(std::size_t start, std::size_t end, const std::vector<uint32_t>& classes)
+    {
+        if (start >= end || classes.empty()) {
+            return;
+        }
+        for (auto& range : mRanges) {
+            if (range.start == start && range.end == end) {
+                mergeClasses(range, classes);
+                return;
+            }
+        }
+        mRanges.push_back({ start, end, classes });
+    }
+
+    void add(uint32_t clazz, std::size_t start, std::size_t end)
+    {
+        insert(start, end, { clazz });
+    }
+
+    void remove(uint32_t clazz, std::size_t start, std::size_t end)
+    {
+        for (auto& range : takeOverlapping(start, end)) {
+            auto it = std::find(range.classes.begin(), range.classes.end(), clazz);
+            if (it == range.classes.end()) {
+                insert(range.start, range.end, range.classes);
+                continue;
+            }
+            keepOutside(range, start, end);
+            range.classes.erase(it);
+            insert(std::max(range.start, start), std::min(range.end, end), range.classes);
+        }
+    }
+
+    void overwrite(uint32_t clazz, std::size_t start, std::size_t end)
+    {
+        clear(start, end);
+        insert(start, end, { clazz });
+    }
+
+    void clear()
+    {
+        mRanges.clear();
+    }
+
+    void clear(std::size_t start, std::size_t end)
+    {
+        for (const auto& range : takeOverlapping(start, end)) {
+            keepOutside(range, start, end);
+        }
+    }
+
+    void edit(std::size_t offset, std::size_t removed, std::size_t inserted)
+    {
+        auto ranges = std::move(mRanges);
+        mRanges.clear();
+        for (auto& range : ranges) {
+            // text inserted at either end of a range isn't part of it
+            range.start = range.start < offset ? range.start
+                : range.start >= offset + removed ? range.start - removed + inserted : offset + inserted;
+            range.end = range.end <= offset ? range.end
+                : range.end >= offset + removed ? range.end - removed + inserted : offset;
+        }
+        // ranges that end up the same become one, without looking at all of them for each
+        std::stable_sort(ranges.begin(), ranges.end(), [](const ModelRange& a, const ModelRange& b) {
+            return std::tie(a.start, a.end) < std::tie(b.start, b.end);
+        });
+        for (const auto& range : ranges) {
+            if (range.start >= range.end) {
+                continue;
+            }
+            if (!mRanges.empty() && mRanges.back().start == range.start && mRanges.back().end == range.end) {
+                mergeClasses(mRanges.back(), range.classes);
+                continue;
+            }
+            mRanges.push_back(range);
+        }
+    }
+
+    std::size_t size() const
+    {
+        return mRanges.size();
+    }
+
+    // sorted like the tree visits them
+    std::vector<ModelRange> overlapping(std::size_t start, std::size_t end) const
+    {
+        std::vector<ModelRange> out;
+        for (const auto& range : mRanges) {
+            if (range.start < end && range.end > start) {
+                out.push_back(range);
+            }
+        }
+        std::sort(out.begin(), out.end(), [](const ModelRange& a, const ModelRange& b) {
+            return std::tie(a.start, a.end) < std::tie(b.start, b.end);
+        });
+        return out;
+    }
+
+private:
+    static void mergeClasses(ModelRange& range, const std::vector<uint32_t>& classes)
+    {
+        for (auto clazz : classes) {
+            if (std::find(range.classes.begin(), range.classes.end(), clazz) == range.classes.end()) {
+                range.classes.push_back(clazz);
+            }
+        }
+    }
+
+    std::vector<ModelRange> takeOverlapping(std::size_t start, std::size_t end)
+    {
+        std::vector<ModelRange> taken;
+        std::erase_if(mRanges, [&](const ModelRange& range) {
+            if (range.start < end && range.end > start) {
+                taken.push_back(range);
+                return true;
+            }
+            return false;
+        });
+        return taken;
+    }
+
+    // the parts of range sticking out of [start, end)
+    void keepOutside(const ModelRange& range, std::size_t start, std::size_t end)
+    {
+        if (range.start < start) {
+            insert(range.start, start, range.classes);
+        }
+        if (range.end > end) {
+            insert(end, range.end, range.classes);
+        }
+    }
+
+private:
+    std::vector<ModelRange> mRanges;
+};
+
+std::vector<ModelRange> overlapping(const TextClassTree& tree, std::size_t start, std::size_t end)
+{
+    std::vector<ModelRange> out;
+    tree.forEachOverlapping(start, end, [&out](std::size_t from, std::size_t to, std::span<const uint32_t> classes) {
+        out.push_back({ from, to, { classes.begin(), classes.end() } });
+    });
+    return out;
+}
+
+// merging ranges may add classes in a different order than the model does
+void sortClasses(std::vector<ModelRange>& ranges)
+{
+    for (auto& range : ranges) {
+        std::sort(range.classes.begin(), range.classes.end());
+    }
+}
+
+bool check(const TextClassTree& tree, const Model& model, std::size_t start, std::size_t end)
+{
+    auto got = overlapping(tree, start, end);
+    auto want = model.overlapping(start, end);
+    sortClasses(got);
+    sortClasses(want);
+    return got == want && tree.size() == model.size();
+}
+
+bool run(uint32_t seed)
+{
+    std::mt19937 rng(seed);
+    auto below = [&rng](std::size_t max) -> std::size_t {
+        return max > 0 ? rng() % max : 0;
+    };
+
+    TextClassTree tree;
+    Model model;
+    std::size_t length = 1000;
+    for (int op = 0; op < 1000; ++op) {
+        if (op % 500 == 499) {
+            tree.clear();
+            model.clear();
+        }
+        const std::size_t start = below(length);
+        const std::size_t end = std::min(length, start + 1 + below(50));
+        // few classes so that ranges often share some
+        const uint32_t clazz = 1 + below(5);
+        const std::size_t kind = below(8);
+        switch (kind) {
+        case 0:
+        case 1:
+            tree.add(clazz, start, end);
+            model.add(clazz, start, end);
+            break;
+        case 2:
+            tree.remove(clazz, start, end);
+            model.remove(clazz, start, end);
+            break;
+        case 3:
+            tree.overwrite(clazz, start, end);
+            model.overwrite(clazz, start, end);
+            break;
+        case 4:
+            tree.clear(start, end);
+            model.clear(start, end);
+            break;
+        case 5: {
+            const std::size_t offset = below(length + 1);
+            const std::size_t removed = std::min(length - offset, below(20));
+            const std::size_t inserted = below(20);
+            tree.edit(offset, removed, inserted);
+            model.edit(offset, removed, inserted);
+            length = length - removed + inserted;
+            break; }
+        case 6: {
+            // a batch, like the highlighter installs after clearing what it lexed
+            std::vector<TextClassTree::Range> ranges;
+            const std::size_t count = below(50);
+            for (std::size_t idx = 0; idx < count; ++idx) {
+                const std::size_t from = below(length);
+                const std::size_t to = std::min(length, from + 1 + below(30));
+                const uint32_t batchClass = 1 + below(5);
+                ranges.push_back({ from, to, { batchClass } });
+                model.add(batchClass, from, to);
+            }
+            tree.insert(std::move(ranges));
+            break; }
+        case 7: {
+            // mixed changes in one go, overlapping ones have to be made in order
+            std::vector<TextClassTree::Change> changes;
+            const std::size_t count = below(30);
+            for (std::size_t idx = 0; idx < count; ++idx) {
+                const std::size_t from = below(length);
+                const std::size_t to = std::min(length, from + 1 + below(below(2) ? 10 : 100));
+                const uint32_t changeClass = 1 + below(5);
+                const auto type = static_cast<TextClassTree::Change::Type>(below(4));
+                changes.push_back({ type, changeClass, from, to });
+                switch (type) {
+                case TextClassTree::Change::Type::Add:
+                    model.add(changeClass, from, to);
+                    break;
+                case TextClassTree::Change::Type::Remove:
+                    model.remove(changeClass, from, to);
+                    break;
+                case TextClassTree::Change::Type::Overwrite:
+                    model.overwrite(changeClass, from, to);
+                    break;
+                case TextClassTree::Change::Type::Clear:
+                    model.clear(from, to);
+                    break;
+                }
+            }
+            tree.apply(changes);
+            break; }
+        }
+
+        const std::size_t queryStart = below(length + 1);
+        const std::size_t queryEnd = queryStart + below(200);
+        // everything now and then, it's slow with the model
+        const bool checkAll = op % 50 == 49;
+        if (!check(tree, model, queryStart, queryEnd) || (checkAll && !check(tree, model, 0, length + 1))) {
+            fprintf(stderr, "seed %u, operation %d (%zu): the tree has %zu ranges, the model %zu\n",
+                    seed, op, kind, tree.size(), model.size());
+            return false;
+        }
+    }
+    return true;
+}
+
+} // anonymous namespace
+
+int main()
+{
+    for (uint32_t seed = 1; seed <= 20; ++seed) {
+        if (!run(seed)) {
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,245 @@
+#include "GlyphRun.h"
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstring>
+#include <mutex>
+#include <new>
+
+namespace spurv {
+struct GlyphBlock
+{
+    // number of runs in the block, plus one while a thread is still filling it
+    std::atomic<uint32_t> refs { 1 };
+    uint32_t capacity = 0;
+    // only touched by the thread filling the block
+    uint32_t used = 0;
+
+    char* data() { return reinterpret_cast<char*>(this + 1); }
+};
+} // namespace spurv
+
+using namespace spurv;
+
+static_assert(sizeof(GlyphBlock) % alignof(uint32_t) == 0, "the arrays of a run need to be aligned");
+
+static std::atomic<std::size_t> sBlocks = 0, sBlockBytes = 0;
+
+static GlyphBlock* allocateBlock(std::size_t capacity)
+{
+    void* mem = ::operator new(sizeof(GlyphBlock) + capacity);
+    auto block = new (mem) GlyphBlock;
+    block->capacity = static_cast<uint32_t>(capacity);
+    ++sBlocks;
+    sBlockBytes += sizeof(GlyphBlock) + capacity;
+    return block;
+}
+
+static inline void retainBlock(GlyphBlock* block)
+{
+    if (block) {
+        ++block->refs;
+    }
+}
+
+static inline void releaseBlock(GlyphBlock* block)
+{
+    if (block && --block->refs == 0) {
+        --sBlocks;
+        sBlockBytes -= sizeof(GlyphBlock) + block->capacity;
+        block->~GlyphBlock();
+        ::operator delete(block);
+    }
+}
+
+namespace {
+// the block the current thread is filling
+struct CurrentBlock
+{
+    GlyphBlock* block = nullptr;
+
+    ~CurrentBlock()
+    {
+        releaseBlock(block);
+    }
+};
+} // anonymous namespace
+
+static thread_local CurrentBlock tCurrentBlock;
+
+GlyphRun::GlyphRun(const GlyphRun& other)
+    : mBlock(other.mBlock), mOffset(other.mOffset), mSize(other.mSize),
+      mNumWordBreaks(other.mNumWordBreaks), mFont(other.mFont)
+{
+    retainBlock(mBlock);
+}
+
+GlyphRun::GlyphRun(GlyphRun&& other)
+    : mBlock(other.mBlock), mOffset(other.mOffset), mSize(other.mSize),
+      mNumWordBreaks(other.mNumWordBreaks), mFont(other.mFont)
+{
+    other.mBlock = nullptr;
+    other.mSize = other.mNumWordBreaks = 0;
+}
+
+GlyphRun::~GlyphRun()
+{
+    releaseBlock(mBlock);
+}
+
+GlyphRun& GlyphRun::operator=(const GlyphRun& other)
+{
+    if (this != &other) {
+        retainBlock(other.mBlock);
+        releaseBlock(mBlock);
+        mBlock = other.mBlock;
+        mOffset = other.mOffset;
+        mSize = other.mSize;
+        mNumWordBreaks = other.mNumWordBreaks;
+        mFont = other.mFont;
+    }
+    return *this;
+}
+
+GlyphRun& GlyphRun::operator=(GlyphRun&& other)
+{
+    if (this != &other) {
+        releaseBlock(mBlock);
+        mBlock = other.mBlock;
+        mOffset = other.mOffset;
+        mSize = other.mSize;
+        mNumWordBreaks = other.mNumWordBreaks;
+        mFont = other.mFont;
+        other.mBlock = nullptr;
+        other.mSize = other.mNumWordBreaks = 0;
+    }
+    return *this;
+}
+
+char* GlyphRun::data() const
+{
+    assert(mBlock != nullptr || mSize + mNumWordBreaks == 0);
+    if (!mBlock) {
+        return nullptr;
+    }
+    return mBlock->data() + mOffset;
+}
+
+GlyphRun GlyphRun::create(uint32_t numGlyphs, uint32_t numWordBreaks, uint16_t font)
+{
+    const std::size_t bytes = bytesFor(numGlyphs, numWordBreaks);
+
+    GlyphRun run;
+    run.mSize = numGlyphs;
+    run.mNumWordBreaks = numWordBreaks;
+    run.mFont = font;
+
+    if (bytes > BlockSize / 4) {
+        // long lines get a block of their own so they don't waste the rest of the current one
+        run.mBlock = allocateBlock(bytes);
+        run.mBlock->used = static_cast<uint32_t>(bytes);
+        return run;
+    }
+
+    auto& current = tCurrentBlock.block;
+    if (!current || current->capacity - current->used < bytes) {
+        releaseBlock(current);
+        current = allocateBlock(BlockSize);
+    }
+    run.mBlock = current;
+    run.mOffset = current->used;
+    current->used += static_cast<uint32_t>(bytes);
+    retainBlock(current);
+    return run;
+}
+
+GlyphRun GlyphRun::fromBuffer(hb_buffer_t* buffer, std::span<const uint32_t> wordBreaks, uint16_t font)
+{
+    unsigned int numGlyphs = 0;
+    const auto infos = hb_buffer_get_glyph_infos(buffer, &numGlyphs);
+    const auto positions = hb_buffer_get_glyph_positions(buffer, nullptr);
+
+    auto run = create(numGlyphs, static_cast<uint32_t>(wordBreaks.size()), font);
+    auto glyphs = run.glyphs();
+    auto clusters = run.clusters();
+    auto advances = run.advances();
+    for (unsigned int i = 0; i < numGlyphs; ++i) {
+        // glyph ids in OpenType fonts are 16 bit
+        glyphs[i] = static_cast<uint16_t>(infos[i].codepoint);
+        clusters[i] = infos[i].cluster;
+        advances[i] = positions[i].x_advance;
+    }
+    std::copy(wordBreaks.begin(), wordBreaks.end(), run.wordBreaks().begin());
+    return run;
+}
+
+GlyphRun GlyphRun::detached() const
+{
+    if (!mBlock) {
+        return {};
+    }
+    const std::size_t bytes = bytesFor(mSize, mNumWordBreaks);
+    if (mBlock->capacity == bytes) {
+        // already on its own
+        return *this;
+    }
+    GlyphRun run;
+    run.mBlock = allocateBlock(bytes);
+    run.mBlock->used = static_cast<uint32_t>(bytes);
+    run.mSize = mSize;
+    run.mNumWordBreaks = mNumWordBreaks;
+    run.mFont = mFont;
+    memcpy(run.data(), data(), bytes);
+    return run;
+}
+
+GlyphRun::MemoryStats GlyphRun::memoryStats()
+{
+    return { sBlocks.load(), sBlockBytes.load() };
+}
+
+// ### fonts are never released, that's fine as long as only a handful of sizes are used
+static constexpr std::size_t MaxFonts = 1024;
+static Font sFonts[MaxFonts];
+static std::atomic<std::size_t> sNumFonts = 1;
+static std::mutex sFontsMutex;
+
+static inline std::size_t findFont(const Font& font, std::size_t numFonts)
+{
+    for (std::size_t idx = 1; idx < numFonts; ++idx) {
+        if (sFonts[idx].size() == font.size() && sFonts[idx].file() == font.file()) {
+            return idx;
+        }
+    }
+    return 0;
+}
+
+uint16_t spurv::internFont(const Font& font)
+{
+    if (!font.isValid()) {
+        return 0;
+    }
+    // published fonts are never modified so they can be looked at without the lock
+    if (const auto idx = findFont(font, sNumFonts.load(std::memory_order_acquire))) {
+        return static_cast<uint16_t>(idx);
+    }
+
+    std::lock_guard lock(sFontsMutex);
+    const auto numFonts = sNumFonts.load(std::memory_order_relaxed);
+    if (const auto idx = findFont(font, numFonts)) {
+        return static_cast<uint16_t>(idx);
+    }
+    assert(numFonts < MaxFonts);
+    if (numFonts == MaxFonts) {
+        return 0;
+    }
+    sFonts[numFonts] = font;
+    sNumFonts.store(numFonts + 1, std::memory_order_release);
+    return static_cast<uint16_t>(numFonts);
+}
+
+const Font& spurv::internedFont(uint16_t idx)
+{
+    assert(idx < sNumFonts.load(std::memory_order_acquire));
+    return sFonts[idx];
+}
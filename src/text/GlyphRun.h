@@ -0,0 +1,159 @@
+#pragma once
+
+#include "Font.h"
+#include <hb.h>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+namespace spurv {
+
+struct GlyphBlock;
+
+/*
+   GlyphRun is a shaped line of text: the glyph ids, the cluster (code unit in
+   the line) and the advance of each glyph, and the word breaks of the line.
+   Each of them is kept as a plain array, and the arrays of many runs are
+   packed into big shared blocks rather than every line owning allocations of
+   its own. A run holds a reference to its block, a block is freed once the
+   last run in it is gone.
+
+   A run is created in the block that the current thread is filling, so the
+   lines of a layout batch end up next to each other. Once a run has been
+   filled in it's immutable and can be shared between threads.
+*/
+
+class GlyphRun
+{
+public:
+    GlyphRun() = default;
+    GlyphRun(const GlyphRun& other);
+    GlyphRun(GlyphRun&& other);
+    ~GlyphRun();
+
+    GlyphRun& operator=(const GlyphRun& other);
+    GlyphRun& operator=(GlyphRun&& other);
+
+    // a run with room for numGlyphs glyphs and numWordBreaks word breaks, to be filled in
+    static GlyphRun create(uint32_t numGlyphs, uint32_t numWordBreaks, uint16_t font);
+    // copies the glyphs out of a shaped buffer
+    static GlyphRun fromBuffer(hb_buffer_t* buffer, std::span<const uint32_t> wordBreaks, uint16_t font);
+
+    // the run in a block of its own, so that keeping it around doesn't keep the
+    // rest of the block it was created in alive
+    GlyphRun detached() const;
+
+    // a run that's been laid out, it might still have no glyphs
+    bool isValid() const;
+    uint32_t size() const;
+    // an index from internFont()
+    uint16_t font() const;
+
+    std::span<const uint16_t> glyphs() const;
+    std::span<const uint32_t> clusters() const;
+    std::span<const int32_t> advances() const;
+    std::span<const uint32_t> wordBreaks() const;
+
+    // only for filling in a run that was just created
+    std::span<uint16_t> glyphs();
+    std::span<uint32_t> clusters();
+    std::span<int32_t> advances();
+    std::span<uint32_t> wordBreaks();
+
+    // the bytes used by the arrays of the run
+    std::size_t bytes() const;
+
+    struct MemoryStats
+    {
+        std::size_t blocks = 0, bytes = 0;
+    };
+    static MemoryStats memoryStats();
+
+    // size of the blocks that runs are packed into, longer runs get a block of their own
+    static constexpr std::size_t BlockSize = 256 * 1024;
+
+private:
+    static std::size_t bytesFor(uint32_t numGlyphs, uint32_t numWordBreaks);
+    char* data() const;
+
+private:
+    GlyphBlock* mBlock = nullptr;
+    // the run's bytes in the block, laid out as clusters, advances, word breaks and glyphs
+    uint32_t mOffset = 0;
+    uint32_t mSize = 0;
+    uint32_t mNumWordBreaks = 0;
+    uint16_t mFont = 0;
+};
+
+// glyph runs refer to their font by index, 0 is an invalid font
+uint16_t internFont(const Font& font);
+const Font& internedFont(uint16_t idx);
+
+inline bool GlyphRun::isValid() const
+{
+    return mBlock != nullptr;
+}
+
+inline uint32_t GlyphRun::size() const
+{
+    return mSize;
+}
+
+inline uint16_t GlyphRun::font() const
+{
+    return mFont;
+}
+
+inline std::span<const uint32_t> GlyphRun::clusters() const
+{
+    return { reinterpret_cast<const uint32_t*>(data()), mSize };
+}
+
+inline std::span<const int32_t> GlyphRun::advances() const
+{
+    return { reinterpret_cast<const int32_t*>(data()) + mSize, mSize };
+}
+
+inline std::span<const uint32_t> GlyphRun::wordBreaks() const
+{
+    return { reinterpret_cast<const uint32_t*>(data()) + mSize * 2, mNumWordBreaks };
+}
+
+inline std::span<const uint16_t> GlyphRun::glyphs() const
+{
+    return { reinterpret_cast<const uint16_t*>(reinterpret_cast<const uint32_t*>(data()) + mSize * 2 + mNumWordBreaks), mSize };
+}
+
+inline std::span<uint32_t> GlyphRun::clusters()
+{
+    return { reinterpret_cast<uint32_t*>(data()), mSize };
+}
+
+inline std::span<int32_t> GlyphRun::advances()
+{
+    return { reinterpret_cast<int32_t*>(data()) + mSize, mSize };
+}
+
+inline std::span<uint32_t> GlyphRun::wordBreaks()
+{
+    return { reinterpret_cast<uint32_t*>(data()) + mSize * 2, mNumWordBreaks };
+}
+
+inline std::span<uint16_t> GlyphRun::glyphs()
+{
+    return { reinterpret_cast<uint16_t*>(reinterpret_cast<uint32_t*>(data()) + mSize * 2 + mNumWordBreaks), mSize };
+}
+
+inline std::size_t GlyphRun::bytes() const
+{
+    return bytesFor(mSize, mNumWordBreaks);
+}
+
+inline std::size_t GlyphRun::bytesFor(uint32_t numGlyphs, uint32_t numWordBreaks)
+{
+    // 4 byte aligned so the next run's arrays are too
+    const std::size_t bytes = (numGlyphs * 2 + numWordBreaks) * sizeof(uint32_t) + numGlyphs * sizeof(uint16_t);
+    return (bytes + 3) & ~static_cast<std::size_t>(3);
+}
+
+} // namespace spurv
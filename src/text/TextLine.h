@@ -1,16 +1,21 @@
 #pragma once
 
 #include "Font.h"
-#include <hb.h>
+#include "GlyphRun.h"
 #include <cstddef>
+#include <cstdint>
 
 namespace spurv {
 
+// with soft wrapping a text line is a row, line is the row and the glyphs are
+// the part of the line's glyphs in [firstGlyph, lastGlyph). offset is where the
+// whole line starts in the text, even for a row that isn't the first one, the
+// clusters of the glyphs are relative to it
 struct TextLine
 {
-    // remember to call hb_buffer_reference/hb_buffer_destroy if copying this
     std::size_t line = 0, offset = 0;
-    hb_buffer_t* buffer = nullptr;
+    GlyphRun glyphs = {};
+    uint32_t firstGlyph = 0, lastGlyph = 0;
     Font font = {};
 };
 
@@ -0,0 +1,71 @@
+#include "TextSpans.h"
+#include <algorithm>
+#include <cassert>
+#include <functional>
+
+using namespace spurv;
+
+std::size_t TextSpanStyleHash::operator()(const TextSpanStyle& style) const
+{
+    std::size_t hash = 0;
+    auto combine = [&hash](std::size_t value) -> void {
+        // boost::hash_combine
+        hash ^= value + 0x9e3779b97f4a7c15ULL + (hash << 6) + (hash >> 2);
+    };
+    for (const auto& color : { style.foreground, style.background }) {
+        combine(std::hash<float>()(color.r));
+        combine(std::hash<float>()(color.g));
+        combine(std::hash<float>()(color.b));
+        combine(std::hash<float>()(color.a));
+    }
+    combine(static_cast<std::size_t>(style.style));
+    combine(static_cast<std::size_t>(style.sizeDelta));
+    return hash;
+}
+
+void TextSpans::append(uint32_t length, uint32_t style)
+{
+    if (length == 0) {
+        return;
+    }
+    if (!runs.empty() && runs.back().style == style) {
+        runs.back().length += length;
+    } else {
+        runs.push_back({ length, style });
+    }
+    end += length;
+}
+
+// appends the styles of [from, to) of spans to out, the default outside of spans
+static void appendRange(TextSpans& out, const TextSpans& spans, std::size_t from, std::size_t to)
+{
+    if (from >= to) {
+        return;
+    }
+    if (from < spans.start) {
+        out.append(static_cast<uint32_t>(std::min(to, spans.start) - from), 0);
+    }
+    std::size_t pos = spans.start;
+    for (auto it = spans.runs.begin(); it != spans.runs.end() && pos < to; pos += it->length, ++it) {
+        const std::size_t lo = std::max(pos, from), hi = std::min(pos + it->length, to);
+        if (lo < hi) {
+            out.append(static_cast<uint32_t>(hi - lo), it->style);
+        }
+    }
+    if (to > spans.end) {
+        out.append(static_cast<uint32_t>(to - std::max(from, spans.end)), 0);
+    }
+}
+
+void TextSpans::splice(const TextSpans& spans)
+{
+    TextSpans out;
+    out.start = out.end = std::min(start, spans.start);
+    appendRange(out, *this, out.start, spans.start);
+    for (const auto& run : spans.runs) {
+        out.append(run.length, run.style);
+    }
+    assert(out.end == spans.end);
+    appendRange(out, *this, spans.end, std::max(end, spans.end));
+    *this = std::move(out);
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <Color.h>
+#include "TextStyle.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace spurv {
+
+// what a span of text looks like. a view keeps a palette of these and spans
+// refer to them by index, index 0 is always the default
+struct TextSpanStyle
+{
+    Color foreground = { 1.f, 1.f, 1.f, 1.f };
+    Color background = {};
+    TextStyle style = {};
+    int32_t sizeDelta = 0;
+
+    bool operator==(const TextSpanStyle& other) const = default;
+};
+
+struct TextSpanStyleHash
+{
+    std::size_t operator()(const TextSpanStyle& style) const;
+};
+
+struct TextStyleRun
+{
+    uint32_t length;
+    uint32_t style;
+};
+
+// the styles of the code units [start, end) of a text as runs that follow
+// each other, the lengths of the runs add up to end - start
+struct TextSpans
+{
+    std::size_t start = 0, end = 0;
+    std::vector<TextStyleRun> runs;
+
+    // replaces the runs in [spans.start, spans.end) with the ones of spans,
+    // a gap between the two is filled with the default style
+    void splice(const TextSpans& spans);
+    // appends a run, merging it with the last one if the style is the same
+    void append(uint32_t length, uint32_t style);
+};
+
+} // namespace spurv
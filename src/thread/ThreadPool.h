@@ -32,6 +32,8 @@ public:
     bool isMainThreadPool() const;
     static ThreadPool* mainThreadPool();
 
+    std::size_t numThreads() const;
+
     template<NonVoidReturn Func>
     std::future<typename FunctionTraits<Func>::ReturnType> post(Func&& func);
 
@@ -123,4 +125,9 @@ inline ThreadPool* ThreadPool::mainThreadPool()
     return sMainThreadPool.get();
 }
 
+inline std::size_t ThreadPool::numThreads() const
+{
+    return mThreads.size();
+}
+
 } // namespacespurv
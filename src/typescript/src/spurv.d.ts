@@ -330,7 +330,15 @@ declare namespace spurv {
 
         constructor();
 
-        loadFile(path: string): Promise<void>;
+        loadFile(path: string, mode?: "mapped" | "read"): Promise<void>;
         setContents(contents: string): Promise<void>;
+
+        // offsets and lengths are in utf-16 code units, like js strings
+        insert(offset: number, text: string): void;
+        remove(offset: number, length: number): void;
+        replace(offset: number, length: number, text: string): void;
+
+        // "" turns highlighting off
+        setSyntax(syntax: "c" | ""): void;
     }
 }